@@ -0,0 +1,220 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef COMPACTFORMAT_H_INCLUDED
+#define COMPACTFORMAT_H_INCLUDED
+
+/**
+
+ Layout of the Compact format that EventBroadcaster sends events and spikes in.
+
+ This header only uses the standard library, so consumers can copy it into
+ their own projects. All values are little-endian. Every message starts with
+ a 32-byte CompactHeader, followed by a CompactTtl or CompactSpike. A spike's
+ waveform follows at COMPACT_WAVEFORM_OFFSET as numChannels * numSamples
+ values, one channel after another, so it can be mapped in place (e.g.
+ numpy.frombuffer(message, numpy.float32, offset=48)). Waveforms are float32,
+ or int16 that are multiplied by CompactSpike::scale to get the values back.
+
+ On high-density electrodes, only the channels around the one with the
+ largest spike may be sent. numChannels then counts the channels sent, and
+ their electrode channel numbers follow the waveform as uint16 values.
+
+ Batches of spikes can also be sent as columns: a CompactColumnsHeader and
+ then one array per field, so that each can be wrapped without copying.
+
+ Decimated continuous data is sent in blocks that start with a
+ CompactContinuousHeader, whatever the output format.
+
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+static const uint32_t COMPACT_MAGIC = 0x43424F45;        // "OEBC"
+static const uint8_t COMPACT_VERSION = 4;        // 4: uint32 TTL lines, batch entries 8-byte aligned
+
+/** Type of the waveform values */
+enum CompactSampleFormat : uint8_t
+{
+    COMPACT_SAMPLES_NONE = 0,       // no waveform
+    COMPACT_SAMPLES_FLOAT32 = 1,
+    COMPACT_SAMPLES_INT16 = 2       // value = sample * scale
+};
+
+struct CompactHeader
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;               // 0 = TTL, 1 = spike
+    uint16_t channelIndex;      // index in the channel catalog
+    uint64_t sequence;          // counts every Compact event and spike of an acquisition, to spot drops
+    int64_t sampleNumber;
+    int64_t sendTime;           // nanoseconds since the Unix epoch when the message was handed to ZMQ
+};
+
+struct CompactTtl
+{
+    uint32_t line;
+    uint8_t state;
+    uint8_t reserved[3];
+};
+
+struct CompactSpike
+{
+    uint16_t sortedId;
+    uint16_t numChannels;
+    uint32_t numSamples;        // per channel
+    uint8_t sampleFormat;       // COMPACT_SAMPLES_FLOAT32 or COMPACT_SAMPLES_INT16
+    uint8_t channelSubset;      // 1 if only some of the electrode's channels were sent
+    uint8_t reserved[2];
+    float scale;                // for int16 samples; 1 for float32
+    // followed by the waveform, then the channel numbers if channelSubset
+};
+
+static_assert(sizeof(CompactHeader) == 32, "CompactHeader must be 32 bytes");
+static_assert(sizeof(CompactTtl) == 8 && sizeof(CompactSpike) == 16, "unexpected padding in Compact bodies");
+
+/** Returns the size of one waveform value */
+inline size_t getCompactSampleSize(uint8_t sampleFormat)
+{
+    return sampleFormat == COMPACT_SAMPLES_INT16 ? 2 : (sampleFormat == COMPACT_SAMPLES_FLOAT32 ? 4 : 0);
+}
+
+/** Returns the space a batch entry of this size takes after its 8-byte prefix, so the next one starts on an 8-byte boundary */
+inline size_t getPaddedEntrySize(size_t entrySize)
+{
+    return (entrySize + 7) & ~(size_t) 7;
+}
+
+static const size_t COMPACT_TTL_SIZE = sizeof(CompactHeader) + sizeof(CompactTtl);
+static const size_t COMPACT_WAVEFORM_OFFSET = sizeof(CompactHeader) + sizeof(CompactSpike);
+
+
+// ---- spike columns ----
+
+static const uint32_t COMPACT_COLUMNS_MAGIC = 0x53424F45;    // "OEBS"
+static const uint8_t COMPACT_COLUMNS_VERSION = 3;
+
+/** Start of a message holding a batch of spikes as columns, all of the same shape.
+    The columns follow, each starting on an 8-byte boundary: see getCompactColumnOffsets(). */
+struct CompactColumnsHeader
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t sampleFormat;       // type of the waveform tensor, or COMPACT_SAMPLES_NONE
+    uint16_t numChannels;       // per spike
+    uint32_t numSamples;        // per channel
+    uint32_t numSpikes;
+    int64_t sendTime;           // nanoseconds since the Unix epoch
+    uint8_t channelSubset;      // 1 if each spike lists the electrode channels it was sent with
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(CompactColumnsHeader) == 32, "CompactColumnsHeader must be 32 bytes");
+
+/** Byte offsets of the columns in a spike-column message */
+struct CompactColumnOffsets
+{
+    size_t sampleNumbers;       // int64_t[numSpikes]
+    size_t channelIndices;      // uint16_t[numSpikes], index in the channel catalog
+    size_t sortedIds;           // uint16_t[numSpikes]
+    size_t peakAmplitudes;      // float[numSpikes]
+    size_t scales;              // float[numSpikes], if sampleFormat is COMPACT_SAMPLES_INT16
+    size_t electrodeChannels;   // uint16_t[numSpikes][numChannels], if channelSubset
+    size_t waveforms;           // [numSpikes][numChannels][numSamples] of sampleFormat
+    size_t totalSize;
+};
+
+inline CompactColumnOffsets getCompactColumnOffsets(const CompactColumnsHeader& header)
+{
+    auto align = [](size_t offset) { return (offset + 7) & ~(size_t) 7; };
+    const size_t n = header.numSpikes;
+
+    CompactColumnOffsets offsets;
+    offsets.sampleNumbers = sizeof(CompactColumnsHeader);
+    offsets.channelIndices = align(offsets.sampleNumbers + n * sizeof(int64_t));
+    offsets.sortedIds = align(offsets.channelIndices + n * sizeof(uint16_t));
+    offsets.peakAmplitudes = align(offsets.sortedIds + n * sizeof(uint16_t));
+    offsets.scales = align(offsets.peakAmplitudes + n * sizeof(float));
+    offsets.electrodeChannels = header.sampleFormat == COMPACT_SAMPLES_INT16
+        ? align(offsets.scales + n * sizeof(float))
+        : offsets.scales;
+    offsets.waveforms = header.channelSubset
+        ? align(offsets.electrodeChannels + n * header.numChannels * sizeof(uint16_t))
+        : offsets.electrodeChannels;
+    offsets.totalSize = offsets.waveforms
+        + n * header.numChannels * header.numSamples * getCompactSampleSize(header.sampleFormat);
+
+    return offsets;
+}
+
+
+// ---- continuous data ----
+
+static const uint32_t COMPACT_CONTINUOUS_MAGIC = 0x44424F45; // "OEBD"
+static const uint8_t COMPACT_CONTINUOUS_VERSION = 1;
+
+/** Start of a message holding a block of decimated continuous data from one stream.
+    For int16 samples a float scale per channel follows, then the samples of each
+    channel one after another: see getCompactContinuousOffsets(). */
+struct CompactContinuousHeader
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t sampleFormat;       // COMPACT_SAMPLES_FLOAT32 or COMPACT_SAMPLES_INT16
+    uint16_t streamIndex;       // index in the catalog's "continuous" list
+    uint16_t numChannels;
+    uint16_t reserved;
+    uint32_t numSamples;        // per channel
+    int64_t sampleNumber;       // input sample number of the first sample; the rest follow every factor samples
+    int64_t sendTime;           // nanoseconds since the Unix epoch
+};
+
+static_assert(sizeof(CompactContinuousHeader) == 32, "CompactContinuousHeader must be 32 bytes");
+
+/** Byte offsets of the parts of a continuous-data message */
+struct CompactContinuousOffsets
+{
+    size_t scales;              // float[numChannels], if sampleFormat is COMPACT_SAMPLES_INT16
+    size_t samples;             // [numChannels][numSamples] of sampleFormat
+    size_t totalSize;
+};
+
+inline CompactContinuousOffsets getCompactContinuousOffsets(const CompactContinuousHeader& header)
+{
+    auto align = [](size_t offset) { return (offset + 7) & ~(size_t) 7; };
+
+    CompactContinuousOffsets offsets;
+    offsets.scales = sizeof(CompactContinuousHeader);
+    offsets.samples = header.sampleFormat == COMPACT_SAMPLES_INT16
+        ? align(offsets.scales + header.numChannels * sizeof(float))
+        : offsets.scales;
+    offsets.totalSize = offsets.samples
+        + (size_t) header.numChannels * header.numSamples * getCompactSampleSize(header.sampleFormat);
+
+    return offsets;
+}
+
+
+#endif  // COMPACTFORMAT_H_INCLUDED
@@ -0,0 +1,160 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "Decimator.h"
+
+#include <cmath>
+
+// SSE2 is always there on x86-64
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define DECIMATOR_X86 1
+#else
+    #define DECIMATOR_X86 0
+#endif
+
+Decimator::Decimator()
+    : numTaps       (0)
+    , historySize   (0)
+    , factor        (1)
+    , numChannels   (0)
+    , phase         (0)
+{
+    prepare(1, 0);
+}
+
+void Decimator::prepare(int newFactor, int newNumChannels)
+{
+    jassert(newFactor >= 1);
+
+    factor = newFactor;
+    numChannels = newNumChannels;
+    numTaps = factor == 1 ? 1 : 16 * factor + 1;
+
+    taps.malloc(numTaps);
+
+    if (factor == 1)
+    {
+        taps[0] = 1.0f;
+    }
+    else
+    {
+        // cutoff at 0.8 of the output Nyquist frequency, in cycles per input sample
+        const double cutoff = 0.4 / factor;
+        const int centre = (numTaps - 1) / 2;
+        double sum = 0;
+
+        for (int i = 0; i < numTaps; ++i)
+        {
+            const double x = i - centre;
+            const double sinc = x == 0 ? 2 * cutoff : std::sin(2 * MathConstants<double>::pi * cutoff * x) / (MathConstants<double>::pi * x);
+            const double phi = 2 * MathConstants<double>::pi * i / (numTaps - 1);
+            const double window = 0.42 - 0.5 * std::cos(phi) + 0.08 * std::cos(2 * phi);
+
+            taps[i] = (float) (sinc * window);
+            sum += taps[i];
+        }
+
+        // unity gain at DC
+        for (int i = 0; i < numTaps; ++i)
+        {
+            taps[i] = (float) (taps[i] / sum);
+        }
+    }
+
+    historySize = numTaps - 1 + MAX_BLOCK_SIZE;
+    history.malloc((size_t) jmax(1, numChannels) * (size_t) historySize);
+
+    reset();
+}
+
+void Decimator::reset()
+{
+    history.clear((size_t) jmax(1, numChannels) * (size_t) historySize);
+    phase = 0;
+}
+
+int Decimator::getNumOutputs(int numSamples) const
+{
+    return phase < numSamples ? (numSamples - 1 - phase) / factor + 1 : 0;
+}
+
+void Decimator::process(const float* const* inputs, int numSamples, float* dest)
+{
+    jassert(numSamples <= MAX_BLOCK_SIZE);
+
+    const int numOutputs = getNumOutputs(numSamples);
+    const int kept = numTaps - 1;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        float* samples = history + (size_t) ch * historySize;
+        memcpy(samples + kept, inputs[ch], (size_t) numSamples * sizeof(float));
+
+        // output k covers the numTaps samples up to input sample phase + k * factor
+        float* outputs = dest + (size_t) ch * numOutputs;
+        for (int k = 0; k < numOutputs; ++k)
+        {
+            outputs[k] = dotProduct(taps, samples + phase + k * factor, numTaps);
+        }
+
+        memmove(samples, samples + numSamples, (size_t) kept * sizeof(float));
+    }
+
+    phase += numOutputs * factor - numSamples;
+}
+
+float Decimator::dotProductScalar(const float* a, const float* b, int count)
+{
+    float sum = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+
+    return sum;
+}
+
+float Decimator::dotProduct(const float* a, const float* b, int count)
+{
+#if DECIMATOR_X86
+    // two accumulators, so consecutive additions don't wait on each other
+    __m128 sumA = _mm_setzero_ps();
+    __m128 sumB = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        sumA = _mm_add_ps(sumA, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sumB = _mm_add_ps(sumB, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(sumA, sumB));
+
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + dotProductScalar(a + i, b + i, count - i);
+#else
+    return dotProductScalar(a, b, count);
+#endif
+}
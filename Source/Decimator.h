@@ -0,0 +1,100 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DECIMATOR_H_INCLUDED
+#define DECIMATOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Low-pass filters continuous data and keeps every factor-th sample, e.g. to
+ send LFP-rate data from a 30 kHz stream.
+
+ The filter is a Blackman-windowed sinc of 16 * factor + 1 taps, cut off
+ (-6 dB) at 0.8 of the output Nyquist frequency. Everything that would
+ alias below the cutoff is attenuated by more than 70 dB. Only the samples that are kept
+ are filtered, each as an SSE dot product over the taps. The filter is
+ symmetric, so outputs are delayed by getDelay() input samples.
+
+ Storage is allocated by prepare(), so process() never allocates and can be
+ called from the processing thread. All channels are processed together and
+ share the position of the next output.
+
+ */
+
+class Decimator
+{
+public:
+    /** Constructor; passes data through until prepare() is called */
+    Decimator();
+
+    /** Most input samples that one call to process() takes */
+    static const int MAX_BLOCK_SIZE = 1024;
+
+    /** Designs the filter for a decimation factor, and makes room for numChannels channels */
+    void prepare(int factor, int numChannels);
+
+    /** Forgets the samples of earlier blocks, e.g. at the start of acquisition */
+    void reset();
+
+    int getFactor() const       { return factor; }
+
+    int getNumChannels() const  { return numChannels; }
+
+    /** Returns by how many input samples the outputs lag the newest sample they're computed from */
+    int getDelay() const        { return (numTaps - 1) / 2; }
+
+    /** Returns the position, in the next block, of the input sample that the next output is computed up to */
+    int getNextOutputOffset() const { return phase; }
+
+    /** Returns how many outputs a block of numSamples input samples gives */
+    int getNumOutputs(int numSamples) const;
+
+    /** Filters a block of up to MAX_BLOCK_SIZE samples. Channel c is read from inputs[c] and
+        its getNumOutputs(numSamples) outputs are written from dest + c * getNumOutputs(numSamples). */
+    void process(const float* const* inputs, int numSamples, float* dest);
+
+    /** Returns the sum of a[i] * b[i], using SSE where available */
+    static float dotProduct(const float* a, const float* b, int count);
+
+    /** Plain C++ version of dotProduct() */
+    static float dotProductScalar(const float* a, const float* b, int count);
+
+private:
+    HeapBlock<float> taps;
+    int numTaps;
+
+    // per channel: the last numTaps - 1 samples, then room for a block
+    HeapBlock<float> history;
+    int historySize;
+
+    int factor;
+    int numChannels;
+    int phase;
+
+    JUCE_DECLARE_NON_COPYABLE(Decimator);
+};
+
+
+#endif  // DECIMATOR_H_INCLUDED
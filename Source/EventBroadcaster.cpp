@@ -23,9 +23,38 @@
 
 #include "EventBroadcaster.h"
 #include "EventBroadcasterEditor.h"
+#include "JsonWriter.h"
 
-#define SPIKE_BASE_SIZE 26
-#define EVENT_BASE_SIZE 24
+#if JUCE_WINDOWS
+    #include <process.h>
+    static int getProcessId() { return _getpid(); }
+#else
+    #include <unistd.h>
+    static int getProcessId() { return (int) getpid(); }
+#endif
+
+EventBroadcaster::ContextOptions EventBroadcaster::contextOptions = { 1, {}, -1, -1 }; // ZMQ defaults
+
+bool EventBroadcaster::SocketOptions::operator==(const SocketOptions& other) const
+{
+    return sendHighWaterMark == other.sendHighWaterMark
+        && sendBufferSize == other.sendBufferSize
+        && lingerMillis == other.lingerMillis
+        && immediate == other.immediate
+        && noDrop == other.noDrop
+        && tcpKeepalive == other.tcpKeepalive
+        && tcpKeepaliveIdle == other.tcpKeepaliveIdle
+        && tcpKeepaliveInterval == other.tcpKeepaliveInterval
+        && tcpKeepaliveCount == other.tcpKeepaliveCount;
+}
+
+bool EventBroadcaster::ContextOptions::operator==(const ContextOptions& other) const
+{
+    return ioThreads == other.ioThreads
+        && affinityCpus == other.affinityCpus
+        && threadPriority == other.threadPriority
+        && schedPolicy == other.schedPolicy;
+}
 
 EventBroadcaster::ZMQContext::ZMQContext()
 #ifdef ZEROMQ
@@ -33,7 +62,39 @@ EventBroadcaster::ZMQContext::ZMQContext()
 #else
     : context(nullptr)
 #endif
-{}
+    , options(contextOptions)
+{
+#ifdef ZEROMQ
+    // these only affect I/O threads, which start along with the first socket
+    if (context != nullptr)
+    {
+        if (0 != zmq_ctx_set(context, ZMQ_IO_THREADS, options.ioThreads))
+        {
+            std::cout << "Failed to set ZMQ I/O threads: " << zmq_strerror(zmq_errno()) << std::endl;
+        }
+
+        for (int cpu : options.affinityCpus)
+        {
+            if (0 != zmq_ctx_set(context, ZMQ_THREAD_AFFINITY_CPU_ADD, cpu))
+            {
+                std::cout << "Failed to pin ZMQ I/O threads to CPU " << cpu << ": "
+                    << zmq_strerror(zmq_errno()) << std::endl;
+            }
+        }
+
+        // the policy has to be set first for the priority to be valid
+        if (options.schedPolicy >= 0 && 0 != zmq_ctx_set(context, ZMQ_THREAD_SCHED_POLICY, options.schedPolicy))
+        {
+            std::cout << "Failed to set ZMQ thread scheduling policy: " << zmq_strerror(zmq_errno()) << std::endl;
+        }
+
+        if (options.threadPriority >= 0 && 0 != zmq_ctx_set(context, ZMQ_THREAD_PRIORITY, options.threadPriority))
+        {
+            std::cout << "Failed to set ZMQ thread priority: " << zmq_strerror(zmq_errno()) << std::endl;
+        }
+    }
+#endif
+}
 
 // ZMQContext is a ReferenceCountedObject with a pointer in each instance's
 // socket pointer, so this only happens when the last instance is destroyed.
@@ -48,25 +109,84 @@ void* EventBroadcaster::ZMQContext::createZMQSocket()
 {
 #ifdef ZEROMQ
     jassert(context != nullptr);
-    return zmq_socket(context, ZMQ_PUB);
+    // XPUB rather than PUB so we can see what subscribers are asking for
+    return zmq_socket(context, ZMQ_XPUB);
 #else
     jassertfalse; // should never be called in this case
     return nullptr;
 #endif
 }
 
-EventBroadcaster::ZMQSocket::ZMQSocket()
+void* EventBroadcaster::ZMQContext::getContext() const
+{
+    return context;
+}
+
+const EventBroadcaster::ContextOptions& EventBroadcaster::ZMQContext::getOptions() const
+{
+    return options;
+}
+
+static uint32 getNextSocketSerial()
+{
+    // 0 stands for no socket
+    static Atomic<int> lastSerial;
+    return (uint32) ++lastSerial;
+}
+
+EventBroadcaster::ZMQSocket::ZMQSocket(const SocketOptions& options)
     : socket    (nullptr)
     , boundPort (0)
+    , numDropped (0)
+    , serial    (getNextSocketSerial())
 {
 #ifdef ZEROMQ
     socket = context->createZMQSocket();
+
+    // options only apply to connections made after they're set, so set them before binding
+    if (socket != nullptr)
+    {
+        setOption(ZMQ_SNDHWM, options.sendHighWaterMark, "send high-water mark");
+        setOption(ZMQ_SNDBUF, options.sendBufferSize, "send buffer size");
+        setOption(ZMQ_LINGER, options.lingerMillis, "linger");
+        setOption(ZMQ_IMMEDIATE, options.immediate ? 1 : 0, "immediate");
+        setOption(ZMQ_XPUB_NODROP, options.noDrop ? 1 : 0, "XPUB no-drop");
+        setOption(ZMQ_TCP_KEEPALIVE, options.tcpKeepalive, "TCP keepalive");
+        setOption(ZMQ_TCP_KEEPALIVE_IDLE, options.tcpKeepaliveIdle, "TCP keepalive idle time");
+        setOption(ZMQ_TCP_KEEPALIVE_INTVL, options.tcpKeepaliveInterval, "TCP keepalive interval");
+        setOption(ZMQ_TCP_KEEPALIVE_CNT, options.tcpKeepaliveCount, "TCP keepalive count");
+    }
+#else
+    ignoreUnused(options);
+#endif
+}
+
+void EventBroadcaster::ZMQSocket::setOption(int option, int value, const char* name)
+{
+#ifdef ZEROMQ
+    if (value < 0)
+    {
+        return; // ZMQ's default
+    }
+
+    if (0 != zmq_setsockopt(socket, option, &value, sizeof(value)))
+    {
+        std::cout << "Failed to set socket " << name << ": " << zmq_strerror(zmq_errno()) << std::endl;
+    }
+#else
+    ignoreUnused(option, value, name);
 #endif
 }
 
+int64 EventBroadcaster::ZMQSocket::getNumDropped() const
+{
+    return numDropped.get();
+}
+
 EventBroadcaster::ZMQSocket::~ZMQSocket()
 {
 #ifdef ZEROMQ
+    unbindEndpoints();
     unbind(); // do this explicitly to free the port immediately
     zmq_close(socket);
 #endif
@@ -82,11 +202,49 @@ int EventBroadcaster::ZMQSocket::getBoundPort() const
     return boundPort;
 }
 
+const EventBroadcaster::ZMQContext& EventBroadcaster::ZMQSocket::getContext() const
+{
+    return *context;
+}
+
+int EventBroadcaster::ZMQSocket::getNumContextUsers() const
+{
+    return context.getReferenceCount();
+}
+
 int EventBroadcaster::ZMQSocket::send(const void* buf, size_t len, int flags)
 {
 #ifdef ZEROMQ
-    return zmq_send(socket, buf, len, flags);
+    // never block the sending thread on a slow subscriber
+    int status = zmq_send(socket, buf, len, flags | ZMQ_DONTWAIT);
+    if (status == -1 && zmq_errno() == EAGAIN)
+    {
+        ++numDropped;
+    }
+    return status;
+#endif
+    return 0;
+}
+
+int EventBroadcaster::ZMQSocket::send(MessagePool::Buffer* buffer, const void* buf, size_t len, int flags)
+{
+#ifdef ZEROMQ
+    // ZMQ takes ownership of the buffer and returns it to the pool once sent
+    zmq_msg_t msg;
+    zmq_msg_init_data(&msg, const_cast<void*>(buf), len, &MessagePool::releaseFromZMQ, buffer);
+
+    int status = zmq_msg_send(&msg, socket, flags | ZMQ_DONTWAIT);
+    if (status == -1)
+    {
+        if (zmq_errno() == EAGAIN)
+        {
+            ++numDropped;
+        }
+        zmq_msg_close(&msg);
+    }
+    return status;
 #endif
+    MessagePool::release(buffer);
     return 0;
 }
 
@@ -102,6 +260,36 @@ int EventBroadcaster::ZMQSocket::bind(int port)
             if (status == 0)
             {
                 boundPort = port;
+                boundEndpoint = getEndpoint(port);
+            }
+        }
+        return status;
+    }
+#endif
+    return 0;
+}
+
+int EventBroadcaster::ZMQSocket::bindAnyPort()
+{
+#ifdef ZEROMQ
+    if (isValid())
+    {
+        int status = unbind();
+        if (status == 0)
+        {
+            status = zmq_bind(socket, "tcp://*:*");
+        }
+        if (status == 0)
+        {
+            // e.g. "tcp://0.0.0.0:49152"
+            char endpoint[256];
+            size_t size = sizeof(endpoint);
+            status = zmq_getsockopt(socket, ZMQ_LAST_ENDPOINT, endpoint, &size);
+
+            if (status == 0)
+            {
+                boundEndpoint = String(CharPointer_UTF8(endpoint));
+                boundPort = boundEndpoint.fromLastOccurrenceOf(":", false, false).getIntValue();
             }
         }
         return status;
@@ -115,10 +303,11 @@ int EventBroadcaster::ZMQSocket::unbind()
 #ifdef ZEROMQ
     if (isValid() && boundPort != 0)
     {
-        int status = zmq_unbind(socket, getEndpoint(boundPort).toRawUTF8());
+        int status = zmq_unbind(socket, boundEndpoint.toRawUTF8());
         if (status == 0)
         {
             boundPort = 0;
+            boundEndpoint = String();
         }
         return status;
     }
@@ -127,384 +316,2101 @@ int EventBroadcaster::ZMQSocket::unbind()
 }
 
 
-String EventBroadcaster::getEndpoint(int port)
+int EventBroadcaster::ZMQSocket::bindEndpoint(const String& endpoint)
 {
-    return String("tcp://*:") + String(port);
+#ifdef ZEROMQ
+    if (isValid())
+    {
+        int status = zmq_bind(socket, endpoint.toRawUTF8());
+        if (status == 0)
+        {
+            boundEndpoints.add(endpoint);
+        }
+        return status;
+    }
+#endif
+    return 0;
 }
 
-
-EventBroadcaster::EventBroadcaster()
-    : GenericProcessor  ("Event Broadcaster")
-    , listeningPort     (0)
-    , outputFormat      (JSON_STRING)
+bool EventBroadcaster::ZMQSocket::isBoundToAny(const StringArray& endpoints) const
 {
-    // set port to 5557; search for an available one if necessary; and do it asynchronously.
-    setListeningPort(5557, false, true, false);
+    for (auto& endpoint : endpoints)
+    {
+        if (boundEndpoints.contains(endpoint))
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
-
-AudioProcessorEditor* EventBroadcaster::createEditor()
+void EventBroadcaster::ZMQSocket::unbindEndpoints()
 {
-    editor = std::make_unique<EventBroadcasterEditor>(this);
-    return editor.get();
+#ifdef ZEROMQ
+    if (isValid())
+    {
+        for (auto& endpoint : boundEndpoints)
+        {
+            zmq_unbind(socket, endpoint.toRawUTF8());
+        }
+    }
+#endif
+    boundEndpoints.clear();
 }
 
-
-int EventBroadcaster::getListeningPort() const
+int EventBroadcaster::ZMQSocket::receive(void* buffer, size_t size)
 {
-    if (zmqSocket == nullptr)
+#ifdef ZEROMQ
+    if (isValid())
     {
-        return 0;
+        return zmq_recv(socket, buffer, size, ZMQ_DONTWAIT);
     }
-    return zmqSocket->getBoundPort();
+#else
+    ignoreUnused(buffer, size);
+#endif
+    return -1;
+}
+
+uint32 EventBroadcaster::ZMQSocket::getSerial() const
+{
+    return serial;
 }
 
 
-int EventBroadcaster::setListeningPort(int port, bool forceRestart, bool searchForPort, bool synchronous)
+bool EventBroadcaster::SubscriptionSet::apply(const char* message, size_t size, bool& changed)
 {
-    if (!synchronous)
+    if (size == 0)
     {
-        const MessageManagerLock mmLock; // since the callback happens in the message thread
+        return false;
+    }
 
-        asyncPort = port;
-        asyncForceRestart = forceRestart;
-        asyncSearchForPort = searchForPort;
+    MemoryBlock prefix(message + 1, size - 1);
+    bool newPrefix = false;
 
-        triggerAsyncUpdate();
-        return 0;
+    if (message[0] == 1)
+    {
+        newPrefix = prefixes.addIfNotAlreadyThere(prefix);
+    }
+    else if (message[0] == 0)
+    {
+        prefixes.removeFirstMatchingValue(prefix);
     }
 
-    int status = 0;
-    //int currPort = getListeningPort();
-    if ((listeningPort != port) || forceRestart)
+    changed = true;
+    return newPrefix;
+}
+
+void EventBroadcaster::SubscriptionSet::clear()
+{
+    prefixes.clear();
+}
+
+bool EventBroadcaster::SubscriptionSet::hasSubscriber(const void* firstFrame, size_t size) const
+{
+    for (auto& prefix : prefixes)
     {
-#ifdef ZEROMQ
-        // unbind current socket (if any) to free up port
-        if (zmqSocket != nullptr)
+        if (prefix.getSize() <= size && memcmp(prefix.getData(), firstFrame, prefix.getSize()) == 0)
         {
-            zmqSocket->unbind();
+            return true;
         }
+    }
+    return false;
+}
 
-        ScopedPointer<ZMQSocket> newSocket = new ZMQSocket();
-
-        if (!newSocket->isValid())
+bool EventBroadcaster::SubscriptionSet::hasSubscriberUnder(const void* prefix, size_t size) const
+{
+    for (auto& subscription : prefixes)
+    {
+        size_t common = jmin(size, subscription.getSize());
+        if (memcmp(subscription.getData(), prefix, common) == 0)
         {
-            status = zmq_errno();
-            std::cout << "Failed to create socket: " << zmq_strerror(status) << std::endl;
+            return true;
         }
-        else
+    }
+    return false;
+}
+
+
+int EventBroadcaster::replaceSocket(int port, bool searchForPort,
+                                    const SocketOptions& options, const StringArray& endpoints)
+{
+    int status = 0;
+
+#ifdef ZEROMQ
+    const ScopedLock replaceLock(socketReplaceLock);
+
+    // bound to what the new socket wants, so it has to go before that can be bound again
+    bool clashes;
+    {
+        const ScopedLock lock(socketLock);
+        ZMQSocket* oldSocket = zmqSocket.get();
+        clashes = oldSocket != nullptr
+            && ((port != 0 && port == oldSocket->getBoundPort()) || oldSocket->isBoundToAny(endpoints));
+    }
+
+    if (clashes)
+    {
+        // until the new socket is published, the sending thread sees no
+        // socket and drops what it would have sent
+        publishSocket(nullptr);
+
+        // giving up here would leave no socket at all, so wait for as long as it takes;
+        // stopping acquisition lets the old socket go straight away
+        if (!waitForRetiredSockets(2000))
         {
-            if (searchForPort) // look for an unused port
+            std::cout << "Still waiting for the sending thread to release the old socket" << std::endl;
+
+            if (!waitForRetiredSockets(-1))
             {
-                while (0 != newSocket->bind(port) && zmq_errno() == EADDRINUSE)
-                {
-                    ++port;
-                }
-                if (newSocket->getBoundPort() != port)
-                {
-                    status = zmq_errno();
-                }
+                return ETIMEDOUT; // the socket thread is being stopped
             }
-            else if (0 != newSocket->bind(port))
+        }
+    }
+
+    ScopedPointer<ZMQSocket> newSocket = new ZMQSocket(options);
+
+    if (!newSocket->isValid())
+    {
+        status = zmq_errno();
+        std::cout << "Failed to create socket: " << zmq_strerror(status) << std::endl;
+    }
+    else
+    {
+        if (port == 0) // any free port
+        {
+            if (0 != newSocket->bindAnyPort())
             {
                 status = zmq_errno();
             }
-
-            if (status != 0)
+        }
+        else if (0 != newSocket->bind(port))
+        {
+            // let the system pick a free port rather than trying one after another
+            if (searchForPort && zmq_errno() == EADDRINUSE && 0 == newSocket->bindAnyPort())
             {
-                std::cout << "Failed to bind to port " << port << ": "
-                    << zmq_strerror(status) << std::endl;
+                std::cout << "Port " << port << " is in use; listening on port "
+                    << newSocket->getBoundPort() << " instead" << std::endl;
             }
             else
             {
-                // success
-                zmqSocket = newSocket;
-                listeningPort = getListeningPort();
+                status = zmq_errno();
             }
         }
 
-
-        if (status != 0 && zmqSocket != nullptr)
+        if (status != 0)
         {
-            // try to rebind current socket to previous port
-            zmqSocket->bind(listeningPort);
+            std::cout << "Failed to bind to port " << port << ": "
+                << zmq_strerror(status) << std::endl;
         }
-#endif
     }
 
-    // update editor
-    auto editor = static_cast<EventBroadcasterEditor*>(getEditor());
-    if (editor != nullptr)
+    if (status != 0)
     {
-        editor->setDisplayedPort(getListeningPort());
+        // unless it had to go first, the old socket carries on
+        return status;
     }
-    return status;
-}
 
-EventBroadcaster::Format EventBroadcaster::getOutputFormat() const
-{
-    return outputFormat;
-}
+    bindExtraEndpoints(*newSocket, endpoints);
+    publishSocket(newSocket.release());
 
+    // otherwise the old socket holds on to its port until the next replacement
+    if (!clashes)
+    {
+        waitForRetiredSockets(2000);
+    }
+#else
+    ignoreUnused(port, searchForPort, options, endpoints);
+#endif
 
-void EventBroadcaster::setOutputFormat(Format format)
-{
-    outputFormat = format;
+    return status;
 }
 
-
-void EventBroadcaster::process(AudioSampleBuffer& continuousBuffer)
+void EventBroadcaster::publishSocket(ZMQSocket* socket)
 {
-    checkForEvents(true);
+    // subscribers have to subscribe again on the new socket, which
+    // updateSubscriptions() sees from the serial of its messages
+    const ScopedLock lock(socketLock);
+    zmqSocket.publish(socket);
 }
 
-void EventBroadcaster::sendEvent(TTLEventPtr event) const
+bool EventBroadcaster::waitForRetiredSockets(int timeoutMs)
 {
-#ifdef ZEROMQ
-
-    Array<MsgPart> message;
+    const uint32 start = Time::getMillisecondCounter();
 
-    uint16 baseType16 = 0; // 0 for TTL events, 1 for spikes
-    message.add({ "type", { &baseType16, sizeof(baseType16) } });
-
-    auto channel = event->getChannelInfo();
-
-    if (outputFormat == RAW_BINARY) // serialize the event
+    for (;;)
     {
-        size_t size = event->getChannelInfo()->getDataSize() 
-            + event->getChannelInfo()->getTotalEventMetadataSize() + EVENT_BASE_SIZE;
-
-        HeapBlock<char> buffer(size);
+        {
+            const ScopedLock lock(socketLock);
+            if (zmqSocket.reclaim())
+            {
+                return true;
+            }
+        }
 
-        event->serialize(buffer, size);
+        if ((timeoutMs >= 0 && Time::getMillisecondCounter() - start > (uint32) timeoutMs)
+            || Thread::currentThreadShouldExit())
+        {
+            return false;
+        }
 
-        message.add({ "data", { buffer, size } });
+        // the sending thread passes a quiescent point at least once per block
+        Thread::sleep(1);
     }
-    else // create a JSON string
-    {
-        DynamicObject::Ptr jsonObj = new DynamicObject();
+}
 
-        // Add common info to JSON
-        jsonObj->setProperty("event_type", "ttl");
-        jsonObj->setProperty("stream", channel->getStreamName());
-        jsonObj->setProperty("source_node", channel->getNodeId());
-        jsonObj->setProperty("sample_rate", channel->getSampleRate());
-        jsonObj->setProperty("channel_name", channel->getName());
-        jsonObj->setProperty("sample_number", event->getSampleNumber());
-        jsonObj->setProperty("line", event->getLine());
-        jsonObj->setProperty("state", event->getState());
 
-        String jsonString = JSON::toString(var(jsonObj));
-        message.add({ "json", { jsonString.toRawUTF8(), jsonString.getNumBytesAsUTF8() } });
+EventBroadcaster::SubscriptionThread::SubscriptionThread(EventBroadcaster& owner_)
+    : Thread    ("Event Broadcaster subscriptions")
+    , owner     (owner_)
+{}
 
+void EventBroadcaster::SubscriptionThread::run()
+{
+    while (!threadShouldExit())
+    {
+        // woken up by the sending thread when subscriptions arrive
+        wait(100);
+        owner.updateSubscriptions();
     }
+}
 
-    sendMessage(message);
-
-#endif
 
-}
+EventBroadcaster::SocketThread::SocketThread(EventBroadcaster& owner_, int port_, bool searchForPort_,
+                                             const SocketOptions& options_, const StringArray& endpoints_)
+    : Thread("Event Broadcaster socket")
+    , owner         (owner_)
+    , port          (port_)
+    , searchForPort (searchForPort_)
+    , options       (options_)
+    , endpoints     (endpoints_)
+{}
 
-void EventBroadcaster::sendSpike(SpikePtr spike) const
+void EventBroadcaster::SocketThread::run()
 {
-#ifdef ZEROMQ
+    owner.asyncSocketStatus = owner.replaceSocket(port, searchForPort, options, endpoints);
 
-    Array<MsgPart> message;
+    // the editor and discovery file are updated on the message thread
+    owner.asyncSocketReplaced = 1;
+    owner.triggerAsyncUpdate();
+}
 
-    uint16 baseType16 = 1; // 0 for TTL events, 1 for spikes
-    message.add({ "type", { &baseType16, sizeof(baseType16) } });
 
-    auto channel = spike->getChannelInfo();
+String EventBroadcaster::getEndpoint(int port)
+{
+    return String("tcp://*:") + String(port);
+}
 
-    if (outputFormat == RAW_BINARY) // serialize the spike
-    {
-        size_t size = SPIKE_BASE_SIZE
-            + channel->getDataSize()
-            + channel->getTotalEventMetadataSize()
-            + channel->getNumChannels() * sizeof(float);
 
-        HeapBlock<char> buffer(size);
+EventBroadcaster::SenderThread::SenderThread(EventBroadcaster& owner_)
+    : Thread    ("Event Broadcaster Sender")
+    , owner     (owner_)
+{}
 
-        spike->serialize(buffer, size);
+void EventBroadcaster::SenderThread::run()
+{
+    while (!threadShouldExit())
+    {
+        owner.drainQueue();
+        owner.zmqSocket.quiescent();
+        owner.liveConfig.quiescent(SENDING_READER);
 
-        message.add({ "data", { buffer, size } });
+        // woken up by the processing thread at the end of each block
+        wait(100);
     }
-    else // create a JSON string
-    {
-        DynamicObject::Ptr jsonObj = new DynamicObject();
 
-        // Add common info to JSON
-        jsonObj->setProperty("event_type", "spike");
-        jsonObj->setProperty("stream", channel->getStreamName());
-        jsonObj->setProperty("source_node", channel->getNodeId());
-        jsonObj->setProperty("electrode", channel->getName());
-        jsonObj->setProperty("num_channels", (int) channel->getNumChannels());
-        jsonObj->setProperty("sample_rate", channel->getSampleRate());
-        jsonObj->setProperty("sample_number", spike->getSampleNumber());
-        jsonObj->setProperty("sorted_id", spike->getSortedId());
+    // flush whatever was queued before acquisition stopped
+    owner.drainQueue();
+    owner.flushBatch();
+}
 
-        // get channel amplitudes
-        for (int ch = 0; ch < channel->getNumChannels(); ch++)
-        {
-            const float* data = spike->getDataPointer(ch);
-            float amp = -data[channel->getPrePeakSamples() + 1];
-            jsonObj->setProperty("amp" + String(ch + 1), amp);
+
+EventBroadcaster::EventBroadcaster()
+    : GenericProcessor  ("Event Broadcaster")
+    , socketOptions     ({ -1, -1, -1, false, false, -1, -1, -1, -1 })
+    , listeningPort     (0)
+    , outputFormat      (JSON_STRING)
+    , batchEnabled      (false)
+    , topicsEnabled     (false)
+    , quantizeWaveforms (false)
+    , neighbourChannels (0)
+    , blockConfig       (nullptr)
+    , sendMode          (SEND_INLINE)
+    , activeSendMode    (SEND_INLINE)
+    , queueCapacity     (8 * 1024 * 1024)
+    , sharedRingSlots   (4096)
+    , sharedRingBytes   (16 * 1024 * 1024)
+    , continuousRate    (0)
+    , continuousQuantized (false)
+    , catalogRequested  (0)
+    , subscriptionMessages (64 * 1024)
+    , polledSocket      (0)
+    , subscribedSocket  (0)
+    , numSkipped        (0)
+    , profilingEnabled  (false)
+    , activeProfiling   (false)
+    , captureBuffer     (nullptr)
+    , continuousBuffer  (nullptr)
+    , recordBuffer      (nullptr)
+    , captureBufferSize (0)
+    , continuousBufferSize (0)
+    , blockNeedsFlush   (false)
+    , maxBatchEvents    (1000)
+    , maxBatchMicros    (0)
+    , spikeColumnMode   (SPIKE_COLUMNS_OFF)
+    , activeSpikeColumnMode (SPIKE_COLUMNS_OFF)
+{
+    publishConfig();
+
+    // set port to 5557; search for an available one if necessary; and do it asynchronously.
+    setListeningPort(5557, false, true, false);
+}
+
+
+EventBroadcaster::~EventBroadcaster()
+{
+    discoveryFile.deleteFile();
+
+    if (socketThread != nullptr)
+    {
+        socketThread->stopThread(-1);
+    }
+
+    if (senderThread != nullptr)
+    {
+        senderThread->stopThread(1000);
+    }
+
+    if (subscriptionThread != nullptr)
+    {
+        subscriptionThread->stopThread(1000);
+    }
+
+    MessagePool::release(captureBuffer);
+    MessagePool::release(continuousBuffer);
+    MessagePool::release(recordBuffer);
+}
+
+
+AudioProcessorEditor* EventBroadcaster::createEditor()
+{
+    editor = std::make_unique<EventBroadcasterEditor>(this);
+    return editor.get();
+}
+
+
+int EventBroadcaster::getListeningPort() const
+{
+    const ScopedLock lock(socketLock);
+
+    ZMQSocket* socket = zmqSocket.get();
+    if (socket == nullptr)
+    {
+        return 0;
+    }
+    return socket->getBoundPort();
+}
+
+
+int EventBroadcaster::setListeningPort(int port, bool forceRestart, bool searchForPort, bool synchronous)
+{
+    if (!synchronous)
+    {
+        const MessageManagerLock mmLock; // since the callback happens in the message thread
+
+        asyncPort = port;
+        asyncForceRestart = forceRestart;
+        asyncSearchForPort = searchForPort;
+        asyncPortPending = 1;
+
+        triggerAsyncUpdate();
+        return 0;
+    }
+
+    int status = 0;
+    //int currPort = getListeningPort();
+    if ((listeningPort != port) || forceRestart)
+    {
+        if (zmqSocket.isReaderOnline())
+        {
+            // the sending thread may have to finish with the old socket first,
+            // so don't hold up the message thread; the result is reported later
+            if (socketThread != nullptr)
+            {
+                socketThread->stopThread(-1);
+            }
+
+            // it gets copies of the settings, which may change again while it runs
+            socketThread = std::make_unique<SocketThread>(*this, port, searchForPort, socketOptions, extraEndpoints);
+            socketThread->startThread();
+            return 0;
+        }
+
+        status = replaceSocket(port, searchForPort, socketOptions, extraEndpoints);
+        listeningPort = getListeningPort();
+        updateDiscoveryFile();
+    }
+
+    // update editor
+    auto editor = static_cast<EventBroadcasterEditor*>(getEditor());
+    if (editor != nullptr)
+    {
+        editor->setDisplayedPort(getListeningPort());
+    }
+    return status;
+}
+
+File EventBroadcaster::getDiscoveryFile() const
+{
+    return discoveryFile;
+}
+
+
+void EventBroadcaster::updateDiscoveryFile()
+{
+    discoveryFile.deleteFile();
+    discoveryFile = File();
+
+    const int port = getListeningPort();
+    if (port == 0)
+    {
+        return;
+    }
+
+    // one file per port, so that several broadcasters (or GUIs) don't overwrite each other
+    File directory = File::getSpecialLocation(File::userApplicationDataDirectory)
+        .getChildFile("open-ephys")
+        .getChildFile("event-broadcaster");
+
+    if (!directory.createDirectory())
+    {
+        std::cout << "Failed to create " << directory.getFullPathName() << std::endl;
+        return;
+    }
+
+    MemoryOutputStream text;
+    JsonWriter json(text);
+    json.beginObject();
+    json.key("port");           json.value(port);
+    json.key("endpoint");       json.value("tcp://127.0.0.1:" + String(port));
+    json.key("pid");            json.value((int64) getProcessId());
+    json.key("endpoints");
+    json.beginArray();
+    for (auto& endpoint : extraEndpoints)
+    {
+        json.value(endpoint);
+    }
+    json.endArray();
+    json.key("shm_name");       json.value(sharedRingName);
+    json.endObject();
+
+    File file = directory.getChildFile(String(port) + ".json");
+
+    if (file.replaceWithData(text.getData(), text.getDataSize()))
+    {
+        discoveryFile = file;
+    }
+    else
+    {
+        std::cout << "Failed to write " << file.getFullPathName() << std::endl;
+    }
+}
+
+
+StringArray EventBroadcaster::getExtraEndpoints() const
+{
+    return extraEndpoints;
+}
+
+
+int EventBroadcaster::setExtraEndpoints(const StringArray& endpoints)
+{
+    // the endpoints are bound on a fresh socket, which is then swapped in
+    return storeExtraEndpoints(endpoints) ? setListeningPort(listeningPort, true) : 0;
+}
+
+
+bool EventBroadcaster::storeExtraEndpoints(const StringArray& endpoints)
+{
+    StringArray cleaned = endpoints;
+    cleaned.trim();
+    cleaned.removeEmptyStrings();
+    cleaned.removeDuplicates(false);
+
+    if (cleaned == extraEndpoints)
+    {
+        return false;
+    }
+
+    extraEndpoints = cleaned;
+
+    // otherwise they're bound along with the port
+    return getListeningPort() != 0;
+}
+
+
+int EventBroadcaster::bindExtraEndpoints(ZMQSocket& socket, const StringArray& endpoints)
+{
+    int firstError = 0;
+
+#ifdef ZEROMQ
+    for (auto& endpoint : endpoints)
+    {
+        if (0 != socket.bindEndpoint(endpoint))
+        {
+            int status = zmq_errno();
+            std::cout << "Failed to bind to " << endpoint << ": " << zmq_strerror(status) << std::endl;
+
+            if (firstError == 0)
+            {
+                firstError = status;
+            }
+        }
+    }
+#endif
+
+    return firstError;
+}
+
+
+String EventBroadcaster::getSharedMemoryName() const
+{
+    return sharedRingName;
+}
+
+
+void EventBroadcaster::setSharedMemoryName(const String& name)
+{
+    sharedRingName = name.trim();
+    updateDiscoveryFile();
+}
+
+
+EventBroadcaster::SocketOptions EventBroadcaster::getSocketOptions() const
+{
+    return socketOptions;
+}
+
+
+int EventBroadcaster::setSocketOptions(const SocketOptions& options)
+{
+    return storeSocketOptions(options) ? setListeningPort(listeningPort, true) : 0;
+}
+
+
+bool EventBroadcaster::storeSocketOptions(const SocketOptions& options)
+{
+    if (options == socketOptions)
+    {
+        return false;
+    }
+
+    socketOptions = options;
+
+    // options are set when the socket is created
+    return getListeningPort() != 0;
+}
+
+
+int64 EventBroadcaster::getNumSendsDropped() const
+{
+    const ScopedLock lock(socketLock);
+
+    ZMQSocket* socket = zmqSocket.get();
+    return socket != nullptr ? socket->getNumDropped() : 0;
+}
+
+
+EventBroadcaster::ContextOptions EventBroadcaster::getContextOptions()
+{
+    return contextOptions;
+}
+
+
+void EventBroadcaster::setContextOptions(const ContextOptions& options)
+{
+    if (storeContextOptions(options))
+    {
+        setListeningPort(listeningPort, true);
+    }
+}
+
+
+bool EventBroadcaster::storeContextOptions(const ContextOptions& options)
+{
+    contextOptions = options;
+    contextOptions.ioThreads = jmax(1, contextOptions.ioThreads);
+
+    const ScopedLock lock(socketLock);
+
+    ZMQSocket* socket = zmqSocket.get();
+    if (socket == nullptr || socket->getContext().getOptions() == contextOptions)
+    {
+        return false; // applied when the context is created
+    }
+
+    if (socket->getNumContextUsers() > 1 || zmqSocket.isReaderOnline())
+    {
+        std::cout << "ZMQ context settings will apply once all Event Broadcasters are removed" << std::endl;
+        return false;
+    }
+
+    // this was the last socket holding on to the old context, and nothing is sending,
+    // so it goes (along with the context) before the new one is made
+    return true;
+}
+
+
+void* EventBroadcaster::getZMQContext()
+{
+    SharedResourcePointer<ZMQContext> context;
+
+    // only this one reference means no broadcaster is keeping the context alive
+    if (context.getReferenceCount() <= 1)
+    {
+        return nullptr;
+    }
+
+    return context->getContext();
+}
+
+
+EventBroadcaster::Format EventBroadcaster::getOutputFormat() const
+{
+    return outputFormat;
+}
+
+
+void EventBroadcaster::setOutputFormat(Format format)
+{
+    outputFormat = format;
+    publishConfig();
+
+    // the catalog says which format is in use
+    catalogRequested = 1;
+}
+
+
+EventBroadcaster::SendMode EventBroadcaster::getSendMode() const
+{
+    return sendMode;
+}
+
+
+void EventBroadcaster::setSendMode(SendMode mode)
+{
+    sendMode = mode;
+}
+
+
+int64 EventBroadcaster::getNumSkipped() const
+{
+    return numSkipped.get();
+}
+
+
+bool EventBroadcaster::getProfilingEnabled() const
+{
+    return profilingEnabled;
+}
+
+
+void EventBroadcaster::setProfilingEnabled(bool enabled)
+{
+    profilingEnabled = enabled;
+}
+
+
+EventBroadcaster::EncodingStats EventBroadcaster::getEncodingStats(bool spikes, Format format) const
+{
+    const EncodingCounters& counters = encodingCounters[spikes ? SPIKE_RECORD : TTL_RECORD][format];
+
+    EncodingStats stats = {};
+    stats.numEncoded = counters.numEncoded.get();
+
+    if (stats.numEncoded > 0)
+    {
+        const double numEncoded = (double) stats.numEncoded;
+        stats.nanosPerEvent = Time::highResolutionTicksToSeconds(counters.ticks.get()) * 1.0e9 / numEncoded;
+        stats.bytesPerEvent = (double) counters.bytes.get() / numEncoded;
+        stats.allocationsPerEvent = (double) counters.allocations.get() / numEncoded;
+    }
+
+    return stats;
+}
+
+
+const EventFilter& EventBroadcaster::getFilter() const
+{
+    return filter;
+}
+
+
+void EventBroadcaster::setFilter(const EventFilter& newFilter)
+{
+    filter = newFilter;
+    publishConfig();
+}
+
+
+StringArray EventBroadcaster::getStreamNames() const
+{
+    StringArray names;
+
+    for (auto encoding : channelEncodings)
+    {
+        const String stream = encoding->baseType == TTL_RECORD
+            ? encoding->eventChannel->getStreamName()
+            : encoding->spikeChannel->getStreamName();
+
+        names.addIfNotAlreadyThere(stream);
+    }
+
+    return names;
+}
+
+
+StringArray EventBroadcaster::getElectrodeNames(const String& stream) const
+{
+    StringArray names;
+
+    for (auto encoding : channelEncodings)
+    {
+        if (encoding->baseType == SPIKE_RECORD && encoding->spikeChannel->getStreamName() == stream)
+        {
+            names.add(encoding->spikeChannel->getName());
+        }
+    }
+
+    return names;
+}
+
+
+void EventBroadcaster::publishConfig()
+{
+    const ScopedLock lock(configLock);
+
+    auto config = new Config();
+    config->format = outputFormat;
+    config->batchEnabled = batchEnabled;
+    config->topicsEnabled = topicsEnabled;
+    config->quantizeWaveforms = quantizeWaveforms;
+    config->neighbourChannels = neighbourChannels;
+    config->filter = filter;
+
+    for (auto encoding : channelEncodings)
+    {
+        config->included.add(encoding->baseType == TTL_RECORD
+            ? filter.includesChannel(encoding->eventChannel->getStreamName(), String())
+            : filter.includesChannel(encoding->spikeChannel->getStreamName(), encoding->spikeChannel->getName()));
+
+        // electrodes that are no larger than the neighbourhood are sent whole
+        config->neighbourhoods.add(neighbourChannels > 0 && neighbourChannels < encoding->numChannels
+            ? buildNeighbourhoods(encoding->numChannels, neighbourChannels)
+            : Array<uint16>());
+    }
+
+    for (auto stream : continuousStreams)
+    {
+        config->continuousIncluded.add(filter.includesStream(stream->name));
+    }
+
+    // batches and topics are subscribed to separately
+    updateWanted(*config);
+
+    // the old one is deleted once the processing and sending threads are done with it
+    liveConfig.publish(config);
+}
+
+
+EventBroadcaster::QueueStats EventBroadcaster::getQueueStats() const
+{
+    QueueStats stats = {};
+
+    if (eventQueue != nullptr)
+    {
+        stats.numRecords = eventQueue->getNumRecords();
+        stats.numBytes = eventQueue->getNumBytes();
+        stats.peakBytes = eventQueue->getPeakBytes();
+        stats.capacity = eventQueue->getCapacity();
+        stats.numPushed = eventQueue->getNumPushed();
+        stats.numDropped = eventQueue->getNumDropped();
+    }
+
+    return stats;
+}
+
+
+void EventBroadcaster::updateSettings()
+{
+    channelEncodings.clear();
+    encodingLookup.clear();
+
+    for (auto channel : eventChannels)
+    {
+        auto encoding = createEncoding(channel, (uint16) channelEncodings.size());
+        encodingLookup[channel] = encoding->index;
+        channelEncodings.add(encoding);
+    }
+
+    for (auto channel : spikeChannels)
+    {
+        auto encoding = createEncoding(channel, (uint16) channelEncodings.size());
+        encodingLookup[channel] = encoding->index;
+        channelEncodings.add(encoding);
+    }
+
+    // continuous data of the selected channels, if it's sent at all
+    continuousStreams.clear();
+
+    BigInteger selectedChannels;
+    const bool allChannels = !EventFilter::parseRanges(continuousChannels, selectedChannels) || continuousChannels.isEmpty();
+    int maxContinuousChannels = 0;
+    int maxContinuousOutputs = 0;
+    size_t maxContinuousSize = 0;
+
+    const Array<const DataStream*> dataStreams = continuousRate > 0 ? getDataStreams() : Array<const DataStream*>();
+
+    for (auto dataStream : dataStreams)
+    {
+        Array<int> channels;
+        StringArray channelNames;
+        Array<float> scales;
+
+        const Array<ContinuousChannel*> streamChannels = dataStream->getContinuousChannels();
+        for (int i = 0; i < streamChannels.size(); i++)
+        {
+            if (allChannels || selectedChannels[i])
+            {
+                auto channel = streamChannels[i];
+                channels.add(channel->getGlobalIndex());
+                channelNames.add(channel->getName());
+                scales.add(channel->getBitVolts() > 0 ? channel->getBitVolts() : 0.195f);
+            }
+        }
+
+        if (channels.isEmpty())
+        {
+            continue;
+        }
+
+        auto stream = new ContinuousStream();
+        stream->index = (uint16) continuousStreams.size();
+        stream->streamId = dataStream->getStreamId();
+        stream->name = dataStream->getName();
+        stream->sampleRate = dataStream->getSampleRate();
+        stream->channels = channels;
+        stream->channelNames = channelNames;
+        stream->scales = scales;
+        stream->sampleFormat = continuousQuantized ? COMPACT_SAMPLES_INT16 : COMPACT_SAMPLES_FLOAT32;
+        stream->decimator.prepare(jmax(1, roundToInt(stream->sampleRate / continuousRate)), channels.size());
+        stream->skipped = false;
+
+        String topic = "continuous/" + stream->name.replaceCharacter('/', '_');
+        stream->topic.replaceWith(topic.toRawUTF8(), jmin(topic.getNumBytesAsUTF8(), (size_t) MAX_TOPIC_SIZE));
+
+        // the largest message one call to the decimator can produce
+        CompactContinuousHeader header = {};
+        header.sampleFormat = stream->sampleFormat;
+        header.numChannels = (uint16) channels.size();
+        header.numSamples = (uint32) ((Decimator::MAX_BLOCK_SIZE - 1) / stream->decimator.getFactor() + 1);
+
+        maxContinuousChannels = jmax(maxContinuousChannels, channels.size());
+        maxContinuousOutputs = jmax(maxContinuousOutputs, (int) header.numSamples);
+        maxContinuousSize = jmax(maxContinuousSize, getCompactContinuousOffsets(header).totalSize);
+
+        continuousStreams.add(stream);
+    }
+
+    continuousInputs.malloc(jmax(1, maxContinuousChannels));
+    decimatedSamples.malloc((size_t) jmax(1, maxContinuousChannels * maxContinuousOutputs));
+
+    // ChannelEncoding indices have changed
+    publishConfig();
+
+    // size the capture buffer for the largest event or spike any channel can produce,
+    // so nothing needs to be allocated on the processing thread. Continuous blocks
+    // can be far larger, and have buffers of their own.
+    size_t maxPayloadSize = 0;
+
+    for (auto encoding : channelEncodings)
+    {
+        maxPayloadSize = jmax(maxPayloadSize, encoding->rawSize, encoding->compactSize);
+    }
+
+    captureBufferSize = (int) (sizeof(EventRecord) + maxPayloadSize);
+    continuousBufferSize = (int) (sizeof(EventRecord) + maxContinuousSize);
+
+    buildCatalog(RAW_BINARY, catalogJson[RAW_BINARY]);
+    buildCatalog(JSON_STRING, catalogJson[JSON_STRING]);
+    buildCatalog(COMPACT_BINARY, catalogJson[COMPACT_BINARY]);
+
+    // nothing else is sending while settings are updated
+    sendCatalog(*liveConfig.get());
+}
+
+
+bool EventBroadcaster::startAcquisition()
+{
+    activeSendMode = sendMode;
+    activeSpikeColumnMode = spikeColumnMode;
+    numSkipped = 0;
+
+    for (auto stream : continuousStreams)
+    {
+        stream->decimator.reset();
+        stream->skipped = false;
+    }
+    activeProfiling = profilingEnabled;
+    resetEncoding(activeProfiling, activeSpikeColumnMode != SPIKE_COLUMNS_OFF);
+
+    for (auto& countersForType : encodingCounters)
+    {
+        for (auto& counters : countersForType)
+        {
+            counters.numEncoded = 0;
+            counters.ticks = 0;
+            counters.bytes = 0;
+            counters.allocations = 0;
+        }
+    }
+
+    SendSettings sendSettings = {};
+    sendSettings.maxBatchEvents = maxBatchEvents;
+    sendSettings.maxBatchMicros = maxBatchMicros;
+    sendSettings.spikeColumns = activeSpikeColumnMode != SPIKE_COLUMNS_OFF;
+    sendSettings.columnWaveforms = activeSpikeColumnMode == SPIKE_COLUMNS_WITH_WAVEFORMS;
+    sendSettings.profiling = activeProfiling;
+
+    for (auto encoding : channelEncodings)
+    {
+        sendSettings.maxValuesPerSpike = jmax(sendSettings.maxValuesPerSpike, encoding->numChannels * encoding->totalSamples);
+        sendSettings.maxChannelsPerSpike = jmax(sendSettings.maxChannelsPerSpike, encoding->numChannels);
+    }
+
+    prepareToSend(sendSettings);
+
+    // in thread mode this is the only buffer the processing thread needs;
+    // when sending inline it gets replaced each time it's handed to ZMQ
+    MessagePool::release(captureBuffer);
+    captureBuffer = messagePool->acquire(captureBufferSize);
+
+    MessagePool::release(continuousBuffer);
+    continuousBuffer = continuousStreams.isEmpty() ? nullptr : messagePool->acquire(continuousBufferSize);
+
+    MessagePool::release(recordBuffer);
+    recordBuffer = nullptr;
+
+    // sent by whichever thread sends events, before the first of them
+    catalogRequested = 1;
+
+    // kept between acquisitions so that readers stay attached, unless records have grown
+    if (sharedRingName.isEmpty())
+    {
+        sharedRing = nullptr;
+    }
+    else if (sharedRing == nullptr || sharedRing->getName() != sharedRingName
+        || sharedRing->getMaxPayloadSize() < captureBufferSize)
+    {
+        sharedRing = std::make_unique<SharedRingWriter>();
+
+        if (!sharedRing->create(sharedRingName, sharedRingSlots, captureBufferSize, sharedRingBytes))
+        {
+            sharedRing = nullptr;
+        }
+    }
+
+    setSharedRing(sharedRing.get());
+
+    // from here on the socket is only replaced once the sending thread lets go of it
+    zmqSocket.setReaderOnline();
+
+    // likewise for settings, which are read once per block
+    liveConfig.setReaderOnline(PROCESSING_READER);
+
+    // nothing else is using the socket yet; after this the subscription thread keeps
+    // track of subscribers. The Config is republished either way, since which
+    // channels are wanted depends on the shared-memory ring and spike columns.
+    pollSubscriptions();
+    updateSubscriptions();
+    publishConfig();
+
+    subscriptionThread = std::make_unique<SubscriptionThread>(*this);
+    subscriptionThread->startThread();
+
+    if (activeSendMode == SEND_THREAD)
+    {
+        // leave room for a reasonable burst even with very large spikes or continuous blocks
+        eventQueue = std::make_unique<EventQueue>(jmax(queueCapacity, 64 * captureBufferSize, 16 * continuousBufferSize));
+
+        liveConfig.setReaderOnline(SENDING_READER);
+
+        senderThread = std::make_unique<SenderThread>(*this);
+        senderThread->startThread();
+    }
+
+    return true;
+}
+
+
+bool EventBroadcaster::stopAcquisition()
+{
+    if (getNumSkipped() > 0)
+    {
+        std::cout << "Event Broadcaster skipped " << getNumSkipped()
+            << " events and spikes with no subscribers" << std::endl;
+    }
+
+    if (getNumSendsDropped() > 0)
+    {
+        std::cout << "Event Broadcaster has had " << getNumSendsDropped()
+            << " messages refused by full subscriber queues" << std::endl;
+    }
+
+    if (senderThread != nullptr)
+    {
+        senderThread->stopThread(2000);
+        senderThread = nullptr;
+
+        QueueStats stats = getQueueStats();
+        std::cout << "Event Broadcaster queued " << stats.numPushed << " messages (peak "
+            << stats.peakBytes << " of " << stats.capacity << " bytes), dropped "
+            << stats.numDropped << std::endl;
+    }
+
+    // nothing polls the socket any more, so subscriptions can wait for the next acquisition
+    subscriptionThread->stopThread(1000);
+    subscriptionThread = nullptr;
+
+    // nothing sends any more, so a socket that's being replaced can go now
+    zmqSocket.setReaderOffline();
+
+    liveConfig.setReaderOffline(PROCESSING_READER);
+    liveConfig.setReaderOffline(SENDING_READER);
+    {
+        const ScopedLock lock(configLock);
+        liveConfig.reclaim();
+    }
+
+    if (socketThread != nullptr)
+    {
+        socketThread->stopThread(-1);
+        socketThread = nullptr;
+    }
+
+    {
+        const ScopedLock lock(socketLock);
+        zmqSocket.reclaim();
+    }
+
+    if (activeProfiling)
+    {
+        logEncodingStats();
+    }
+
+    MessagePool::release(captureBuffer);
+    captureBuffer = nullptr;
+
+    MessagePool::release(continuousBuffer);
+    continuousBuffer = nullptr;
+
+    MessagePool::release(recordBuffer);
+    recordBuffer = nullptr;
+
+    return true;
+}
+
+
+bool EventBroadcaster::getBatchEnabled() const
+{
+    return batchEnabled;
+}
+
+
+EventBroadcaster::SpikeColumnMode EventBroadcaster::getSpikeColumnMode() const
+{
+    return spikeColumnMode;
+}
+
+
+void EventBroadcaster::setSpikeColumnMode(SpikeColumnMode mode)
+{
+    spikeColumnMode = mode;
+}
+
+
+bool EventBroadcaster::getWaveformsQuantized() const
+{
+    return quantizeWaveforms;
+}
+
+
+void EventBroadcaster::setWaveformsQuantized(bool quantized)
+{
+    quantizeWaveforms = quantized;
+    publishConfig();
+}
+
+
+int EventBroadcaster::getNeighbourChannels() const
+{
+    return neighbourChannels;
+}
+
+
+void EventBroadcaster::setNeighbourChannels(int numChannels)
+{
+    neighbourChannels = jmax(0, numChannels);
+    publishConfig();
+}
+
+
+double EventBroadcaster::getContinuousRate() const
+{
+    return continuousRate;
+}
+
+
+void EventBroadcaster::setContinuousRate(double rate)
+{
+    continuousRate = jmax(0.0, rate);
+}
+
+
+const String& EventBroadcaster::getContinuousChannels() const
+{
+    return continuousChannels;
+}
+
+
+bool EventBroadcaster::setContinuousChannels(const String& ranges)
+{
+    BigInteger bits;
+    if (!EventFilter::parseRanges(ranges, bits))
+    {
+        return false;
+    }
+
+    continuousChannels = ranges.trim();
+    return true;
+}
+
+
+bool EventBroadcaster::getContinuousQuantized() const
+{
+    return continuousQuantized;
+}
+
+
+void EventBroadcaster::setContinuousQuantized(bool quantized)
+{
+    continuousQuantized = quantized;
+}
+
+
+void EventBroadcaster::setBatchEnabled(bool enabled)
+{
+    batchEnabled = enabled;
+    publishConfig();
+}
+
+
+bool EventBroadcaster::getTopicsEnabled() const
+{
+    return topicsEnabled;
+}
+
+
+void EventBroadcaster::setTopicsEnabled(bool enabled)
+{
+    topicsEnabled = enabled;
+    publishConfig();
+}
+
+
+void EventBroadcaster::process(AudioSampleBuffer& continuousBuffer)
+{
+    blockNeedsFlush = false;
+
+    // settings changed during the block apply from the next one
+    blockConfig = liveConfig.get();
+
+    if (activeSendMode == SEND_INLINE)
+    {
+        pollSubscriptions();
+        sendRequestedCatalog();
+    }
+
+    checkForEvents(true);
+
+    if (!continuousStreams.isEmpty())
+    {
+        captureContinuous(continuousBuffer, *blockConfig);
+    }
+
+    if (blockNeedsFlush)
+    {
+        // everything received during this block goes out as one message
+        if (activeSendMode == SEND_THREAD)
+        {
+            EventRecord marker = {};
+            marker.baseType = BLOCK_END_RECORD;
+            eventQueue->push(&marker, sizeof(marker));
+        }
+        else
+        {
+            flushBatch();
+        }
+    }
+
+    if (activeSendMode == SEND_THREAD)
+    {
+        senderThread->notify();
+    }
+    else
+    {
+        // done with the socket until the next block
+        zmqSocket.quiescent();
+    }
+
+    blockConfig = nullptr;
+    liveConfig.quiescent(PROCESSING_READER);
+}
+
+const EventBroadcaster::ChannelEncoding* EventBroadcaster::getEncoding(const void* channelInfo) const
+{
+    auto it = encodingLookup.find(channelInfo);
+    return it != encodingLookup.end() ? channelEncodings.getUnchecked(it->second) : nullptr;
+}
+
+void EventBroadcaster::dispatchRecord(MessagePool::Buffer*& buffer, int bufferSize, int numBytes)
+{
+    if (numBytes == 0)
+    {
+        jassertfalse; // record larger than any channel's at updateSettings()
+        return;
+    }
+
+    const char* record = buffer->getData();
+    const EventRecord header = *reinterpret_cast<const EventRecord*>(record);
+
+    if (header.batched)
+    {
+        blockNeedsFlush = true;
+    }
+
+    if (activeSendMode == SEND_THREAD)
+    {
+        // a full queue counts as a drop; never wait on the processing thread
+        eventQueue->push(record, numBytes);
+    }
+    else
+    {
+        const int64 allocationsBefore = activeProfiling ? messagePool->getNumAllocated() : 0;
+
+        sendRecord(buffer);
+
+        if (buffer == nullptr)
+        {
+            buffer = messagePool->acquire(bufferSize);
+        }
+
+        if (activeProfiling)
+        {
+            countAllocations(header, allocationsBefore);
+        }
+    }
+}
+
+void EventBroadcaster::captureContinuous(const AudioSampleBuffer& continuousBuffer, const Config& config)
+{
+    for (auto stream : continuousStreams)
+    {
+        Decimator& decimator = stream->decimator;
+
+        if (!config.continuousIncluded.getUnchecked(stream->index) || !config.continuousWanted.getUnchecked(stream->index))
+        {
+            stream->skipped = true;
+            continue;
+        }
+
+        // don't filter across the gap
+        if (stream->skipped)
+        {
+            decimator.reset();
+            stream->skipped = false;
+        }
+
+        const int numChannels = decimator.getNumChannels();
+        const int numSamples = (int) getNumSamplesInBlock(stream->streamId);
+        const int64 firstSampleNumber = getFirstSampleNumberForBlock(stream->streamId);
+
+        // blocks longer than the decimator takes go out as several messages
+        for (int start = 0; start < numSamples; start += Decimator::MAX_BLOCK_SIZE)
+        {
+            const int blockSize = jmin(numSamples - start, (int) Decimator::MAX_BLOCK_SIZE);
+            const int numOutputs = decimator.getNumOutputs(blockSize);
+
+            for (int c = 0; c < numChannels; c++)
+            {
+                continuousInputs[c] = continuousBuffer.getReadPointer(stream->channels.getUnchecked(c), start);
+            }
+
+            if (numOutputs == 0)
+            {
+                decimator.process(continuousInputs, blockSize, decimatedSamples);
+                continue;
+            }
+
+            CompactContinuousHeader header = {};
+            header.magic = COMPACT_CONTINUOUS_MAGIC;
+            header.version = COMPACT_CONTINUOUS_VERSION;
+            header.sampleFormat = stream->sampleFormat;
+            header.streamIndex = stream->index;
+            header.numChannels = (uint16) numChannels;
+            header.numSamples = (uint32) numOutputs;
+
+            // stamped with the input sample each output is centred on
+            header.sampleNumber = firstSampleNumber + start + decimator.getNextOutputOffset() - decimator.getDelay();
+
+            const CompactContinuousOffsets offsets = getCompactContinuousOffsets(header);
+
+            EventRecord record = {};
+            record.baseType = CONTINUOUS_RECORD;
+            record.format = (uint16) config.format;
+            record.withTopic = config.topicsEnabled;
+            record.captureTicks = activeProfiling ? Time::getHighResolutionTicks() : 0;
+            record.channelIndex = stream->index;
+            record.sampleNumber = header.sampleNumber;
+            record.numChannels = (uint16) numChannels;
+            record.payloadSize = (uint32) offsets.totalSize;
+
+            // sized for the largest block in updateSettings()
+            jassert(sizeof(EventRecord) + offsets.totalSize <= (size_t) continuousBufferSize);
+
+            char* dest = continuousBuffer->getData();
+            char* payload = dest + sizeof(EventRecord);
+
+            // padding is zeroed so that messages don't leak old memory
+            memset(payload, 0, offsets.samples);
+            memcpy(payload, &header, sizeof(header));
+
+            if (header.sampleFormat == COMPACT_SAMPLES_INT16)
+            {
+                decimator.process(continuousInputs, blockSize, decimatedSamples);
+                memcpy(payload + offsets.scales, stream->scales.begin(), numChannels * sizeof(float));
+
+                int16* samples = reinterpret_cast<int16*>(payload + offsets.samples);
+                for (int c = 0; c < numChannels; c++)
+                {
+                    WaveformQuantizer::quantize(decimatedSamples + c * numOutputs, samples + c * numOutputs,
+                        numOutputs, stream->scales.getUnchecked(c));
+                }
+            }
+            else
+            {
+                decimator.process(continuousInputs, blockSize, reinterpret_cast<float*>(payload + offsets.samples));
+            }
+
+            memcpy(dest, &record, sizeof(EventRecord));
+            dispatchRecord(continuousBuffer, continuousBufferSize, (int) (sizeof(EventRecord) + record.payloadSize));
+        }
+    }
+}
+
+void EventBroadcaster::sendContinuous(const EventRecord& record, MessagePool::Buffer*& recordBuffer)
+{
+    const ContinuousStream* stream = continuousStreams.getUnchecked(record.channelIndex);
+    char* payload = recordBuffer->getData() + sizeof(EventRecord);
+
+    const int64 sendTime = getSendTime();
+    memcpy(payload + offsetof(CompactContinuousHeader, sendTime), &sendTime, sizeof(sendTime));
+
+    MsgPart message[3];
+    int numParts = 0;
+
+    if (record.withTopic)
+    {
+        message[numParts++] = { "topic", stream->topic.getData(), stream->topic.getSize(), nullptr };
+    }
+
+    uint16 baseType16 = CONTINUOUS_TYPE;
+    message[numParts++] = { "type", &baseType16, sizeof(baseType16), nullptr };
+
+    // the record may be gone once ZMQ has the message
+    const int64 captureTicks = record.captureTicks;
+
+    message[numParts++] = { "data", payload, record.payloadSize, recordBuffer };
+    recordBuffer = nullptr;
+
+    sendMessage(message, numParts);
+
+    if (activeProfiling)
+    {
+        countLatency(captureTicks);
+    }
+}
+
+void EventBroadcaster::buildCatalog(Format format, MemoryBlock& dest) const
+{
+    MemoryOutputStream stream(dest, false);
+    JsonWriter json(stream);
+
+    json.beginObject();
+    json.key("event_type");     json.value("catalog", 7);
+    json.key("format");
+    switch (format)
+    {
+    case RAW_BINARY:        json.value("raw", 3); break;
+    case COMPACT_BINARY:    json.value("compact", 7); break;
+    default:                json.value("json", 4); break;
+    }
+
+    if (format == COMPACT_BINARY)
+    {
+        json.key("compact_version");    json.value((int) COMPACT_VERSION);
+    }
+
+    json.key("channels");
+    json.beginArray();
+
+    for (auto encoding : channelEncodings)
+    {
+        const MetadataEventObject* metadataInfo;
+
+        json.beginObject();
+        json.key("index");      json.value((int) encoding->index);
+
+        if (encoding->baseType == TTL_RECORD)
+        {
+            auto channel = encoding->eventChannel;
+            metadataInfo = channel;
+
+            json.key("type");           json.value("ttl", 3);
+            json.key("name");           json.value(channel->getName());
+            json.key("stream");         json.value(channel->getStreamName());
+            json.key("stream_id");      json.value((int) channel->getStreamId());
+            json.key("source_node");    json.value((int) channel->getNodeId());
+            json.key("sample_rate");    json.value(channel->getSampleRate());
+        }
+        else
+        {
+            auto channel = encoding->spikeChannel;
+            metadataInfo = channel;
+
+            json.key("type");               json.value("spike", 5);
+            json.key("name");               json.value(channel->getName());
+            json.key("stream");             json.value(channel->getStreamName());
+            json.key("stream_id");          json.value((int) channel->getStreamId());
+            json.key("source_node");        json.value((int) channel->getNodeId());
+            json.key("sample_rate");        json.value(channel->getSampleRate());
+            json.key("num_channels");       json.value(encoding->numChannels);
+            json.key("pre_peak_samples");   json.value(encoding->prePeakSamples);
+            json.key("total_samples");      json.value(encoding->totalSamples);
+            json.key("waveform_scale");     json.value(encoding->waveformScale);
+            json.key("amplitude");          json.value("peak_to_trough", 14);
+        }
+
+        json.key("metadata");
+        json.beginArray();
+        for (int i = 0; i < (int) metadataInfo->getEventMetadataCount(); i++)
+        {
+            const MetadataDescriptor* descriptor = metadataInfo->getEventMetadataDescriptor(i);
+
+            json.beginObject();
+            json.key("name");       json.value(descriptor->getName());
+            json.key("type");       json.value(String(getTypeName(descriptor->getType())));
+            json.key("length");     json.value((int) descriptor->getLength());
+            json.endObject();
         }
-        
-        String jsonString = JSON::toString(var(jsonObj));
-        message.add({ "json", { jsonString.toRawUTF8(), jsonString.getNumBytesAsUTF8() } });
+        json.endArray();
 
+        json.endObject();
     }
 
-    sendMessage(message);
+    json.endArray();
 
-#endif
+    json.key("continuous");
+    json.beginArray();
+
+    for (auto continuous : continuousStreams)
+    {
+        const int factor = continuous->decimator.getFactor();
+
+        json.beginObject();
+        json.key("index");          json.value((int) continuous->index);
+        json.key("stream");         json.value(continuous->name);
+        json.key("stream_id");      json.value((int) continuous->streamId);
+        json.key("input_rate");     json.value(continuous->sampleRate);
+        json.key("factor");         json.value(factor);
+        json.key("sample_rate");    json.value(continuous->sampleRate / factor);
+
+        json.key("channels");
+        json.beginArray();
+        for (auto& name : continuous->channelNames)
+        {
+            json.value(name);
+        }
+        json.endArray();
+
+        json.endObject();
+    }
 
+    json.endArray();
+    json.endObject();
+    stream.flush();
 }
 
-int EventBroadcaster::sendMessage(const Array<MsgPart>& parts) const
+void EventBroadcaster::sendCatalog(const Config& config)
 {
-#ifdef ZEROMQ
-    int numParts = parts.size();
-    for (int i = 0; i < numParts; ++i)
+    uint16 baseType16 = CATALOG_TYPE;
+    const MemoryBlock& catalog = catalogJson[config.format];
+
+    MsgPart message[3];
+    int numParts = 0;
+
+    if (config.topicsEnabled)
     {
-        const MsgPart& part = parts.getUnchecked(i);
-        int flags = (i < numParts - 1) ? ZMQ_SNDMORE : 0;
-        if (-1 == zmqSocket->send(part.data.getData(), part.data.getSize(), flags))
-        {
-            std::cout << "Error sending " << part.name << ": " << zmq_strerror(zmq_errno()) << std::endl;
-            return -1;
-        }
+        message[numParts++] = { "topic", "catalog", 7, nullptr };
     }
-#endif
-    return 0;
+
+    // copied by ZMQ; this is only sent occasionally
+    message[numParts++] = { "type", &baseType16, sizeof(baseType16), nullptr };
+    message[numParts++] = { "json", catalog.getData(), catalog.getSize(), nullptr };
+
+    sendMessage(message, numParts);
 }
 
-void EventBroadcaster::populateMetadata(const MetadataEventObject* channel,
-    const EventBasePtr event, DynamicObject::Ptr dest)
+void EventBroadcaster::sendRequestedCatalog()
 {
-    //Iterate through all event data and add to metadata object
-    int numMetaData = event->getMetadataValueCount();
-    for (int i = 0; i < numMetaData; i++)
+    if (catalogRequested.compareAndSetBool(0, 1))
     {
-        //Get metadata name
-        const MetadataDescriptor* metaDescPtr = channel->getEventMetadataDescriptor(i);
-        const String& metaDataName = metaDescPtr->getName();
+        // read after the request, so a new format is in the catalog it triggered
+        sendCatalog(*liveConfig.get());
+    }
+}
+
+EventBroadcaster::LatencyStats EventBroadcaster::getLatencyStats() const
+{
+    LatencyStats stats = {};
+    stats.numSent = sendLatency.getCount();
 
-        //Get metadata value
-        const MetadataValue* valuePtr = event->getMetadataValue(i);
-        const void* rawPtr = valuePtr->getRawValuePointer();
-        unsigned int length = valuePtr->getDataLength();
+    if (stats.numSent > 0)
+    {
+        stats.p50Micros = sendLatency.getPercentile(0.5) * 1.0e-3;
+        stats.p99Micros = sendLatency.getPercentile(0.99) * 1.0e-3;
+        stats.p999Micros = sendLatency.getPercentile(0.999) * 1.0e-3;
+        stats.maxMicros = sendLatency.getMax() * 1.0e-3;
 
-        auto dataReader = getDataReader(valuePtr->getDataType());
-        dest->setProperty(metaDataName, dataReader(rawPtr, length));
+        const double elapsed = Time::highResolutionTicksToSeconds(lastSendTicks - firstSendTicks);
+        stats.eventsPerSecond = elapsed > 0 ? stats.numSent / elapsed : 0;
     }
+
+    return stats;
 }
 
+void EventBroadcaster::countEncoding(uint16 baseType, uint16 format, int64 startTicks, int64 numBytes, int numEvents)
+{
+    EncodingCounters& counters = encodingCounters[baseType][format];
 
-void EventBroadcaster::handleTTLEvent(TTLEventPtr event)
+    counters.ticks += Time::getHighResolutionTicks() - startTicks;
+    counters.bytes += numBytes;
+    counters.numEncoded += numEvents;
+}
+
+void EventBroadcaster::countAllocations(const EventRecord& record, int64 allocationsBefore)
 {
-    sendEvent(event);
+    // continuous blocks and block ends aren't events
+    if (record.baseType <= SPIKE_RECORD)
+    {
+        encodingCounters[record.baseType][record.format].allocations += messagePool->getNumAllocated() - allocationsBefore;
+    }
 }
 
-void EventBroadcaster::handleSpike(SpikePtr spike)
+void EventBroadcaster::logEncodingStats() const
+{
+    const Format formats[] = { RAW_BINARY, JSON_STRING, COMPACT_BINARY };
+    const char* formatNames[] = { "", "raw", "json", "compact" };
+
+    for (int spikes = 0; spikes <= 1; ++spikes)
+    {
+        for (Format format : formats)
+        {
+            EncodingStats stats = getEncodingStats(spikes != 0, format);
+
+            if (stats.numEncoded > 0)
+            {
+                std::cout << "Event Broadcaster encoded " << stats.numEncoded
+                    << (spikes ? " spikes" : " TTL events") << " as " << formatNames[format] << ": "
+                    << stats.nanosPerEvent << " ns, " << stats.bytesPerEvent << " bytes, "
+                    << stats.allocationsPerEvent << " allocations each" << std::endl;
+            }
+        }
+    }
+
+    LatencyStats latency = getLatencyStats();
+
+    if (latency.numSent > 0)
+    {
+        std::cout << "Event Broadcaster sent " << latency.numSent << " events and spikes ("
+            << latency.eventsPerSecond << "/s); latency p50 " << latency.p50Micros
+            << " us, p99 " << latency.p99Micros << " us, p99.9 " << latency.p999Micros
+            << " us, max " << latency.maxMicros << " us" << std::endl;
+    }
+}
+
+void EventBroadcaster::pollSubscriptions()
 {
-    sendSpike(spike);
+    ZMQSocket* socket = zmqSocket.get();
+    const uint32 serial = socket != nullptr ? socket->getSerial() : 0;
+
+    // only copied here; the subscription set is rebuilt on the subscription
+    // thread, since that allocates
+    char message[sizeof(uint32) + MAX_SUBSCRIPTION_SIZE];
+    memcpy(message, &serial, sizeof(serial));
+    bool queued = false;
+
+    if (serial != polledSocket)
+    {
+        queued |= subscriptionMessages.push(message, sizeof(serial));
+        polledSocket = serial;
+    }
+
+    if (socket != nullptr)
+    {
+        int size;
+        while ((size = socket->receive(message + sizeof(serial), MAX_SUBSCRIPTION_SIZE)) >= 0)
+        {
+            // longer prefixes are cut short the same way when subscribing and unsubscribing
+            queued |= subscriptionMessages.push(message, (int) sizeof(serial) + jmin(size, MAX_SUBSCRIPTION_SIZE));
+        }
+    }
+
+    if (queued && subscriptionThread != nullptr)
+    {
+        subscriptionThread->notify();
+    }
 }
 
-void EventBroadcaster::saveCustomParametersToXml(XmlElement* parentElement)
+void EventBroadcaster::updateSubscriptions()
 {
-    XmlElement* mainNode = parentElement->createNewChildElement("EVENTBROADCASTER");
-    mainNode->setAttribute("port", listeningPort);
-    mainNode->setAttribute("format", (int) outputFormat);
+    const ScopedLock lock(configLock);
+
+    char message[sizeof(uint32) + MAX_SUBSCRIPTION_SIZE];
+    bool changed = false;
+    int size;
+
+    while ((size = subscriptionMessages.pop(message, sizeof(message))) > 0)
+    {
+        uint32 serial;
+        memcpy(&serial, message, sizeof(serial));
+
+        // subscribers have to subscribe again on a new socket
+        if (serial != subscribedSocket)
+        {
+            subscriptions.clear();
+            subscribedSocket = serial;
+            changed = true;
+        }
+
+        // new subscribers haven't seen the catalog yet
+        if (subscriptions.apply(message + sizeof(serial), (size_t) size - sizeof(serial), changed))
+        {
+            catalogRequested = 1;
+        }
+    }
+
+    if (changed)
+    {
+        // the rest stays as the message thread last published it
+        auto config = new Config(*liveConfig.get());
+        updateWanted(*config);
+        liveConfig.publish(config);
+    }
 }
 
+void EventBroadcaster::updateWanted(Config& config) const
+{
+    config.wanted.clearQuick();
+    for (auto encoding : channelEncodings)
+    {
+        config.wanted.add(hasSubscriber(config, *encoding));
+    }
 
-void EventBroadcaster::loadCustomParametersFromXml(XmlElement* parametersXml)
+    // continuous data is never batched or written to the shared-memory ring
+    uint16 baseType16 = CONTINUOUS_TYPE;
+    config.continuousWanted.clearQuick();
+    for (auto stream : continuousStreams)
+    {
+        config.continuousWanted.add(config.topicsEnabled
+            ? subscriptions.hasSubscriber(stream->topic.getData(), stream->topic.getSize())
+            : subscriptions.hasSubscriber(&baseType16, sizeof(baseType16)));
+    }
+}
+
+bool EventBroadcaster::hasSubscriber(const Config& config, const ChannelEncoding& encoding) const
 {
+    // the shared-memory ring takes everything
+    if (sharedRing != nullptr)
+    {
+        return true;
+    }
 
-    forEachXmlChildElement(*parametersXml, mainNode)
+    if (config.batchEnabled)
     {
-        if (mainNode->hasTagName("EVENTBROADCASTER"))
+        if (config.topicsEnabled)
         {
-            // overrides an existing async call to setListeningPort, if any
-            setListeningPort(mainNode->getIntAttribute("port", listeningPort), false, false, false);
+            return subscriptions.hasSubscriber("batch", 5);
+        }
 
-            outputFormat = (Format) mainNode->getIntAttribute("format", outputFormat);
-            auto ed = static_cast<EventBroadcasterEditor*>(getEditor());
-            if (ed)
+        // batched Compact spikes go out as columns, which have a type of their own
+        uint16 baseType16 = (encoding.baseType == SPIKE_RECORD && config.format == COMPACT_BINARY
+            && activeSpikeColumnMode != SPIKE_COLUMNS_OFF) ? SPIKE_COLUMNS_TYPE : BATCH_TYPE;
+        return subscriptions.hasSubscriber(&baseType16, sizeof(baseType16));
+    }
+
+    if (config.topicsEnabled)
+    {
+        // TTL topics end with the line number, so a subscription to any one line counts
+        if (encoding.baseType == TTL_RECORD)
+        {
+            return subscriptions.hasSubscriberUnder(encoding.topic.getData(), encoding.topic.getSize());
+        }
+
+        return subscriptions.hasSubscriber(encoding.topic.getData(), encoding.topic.getSize());
+    }
+
+    uint16 baseType16 = encoding.baseType;
+    return subscriptions.hasSubscriber(&baseType16, sizeof(baseType16));
+}
+
+void EventBroadcaster::drainQueue()
+{
+    pollSubscriptions();
+    sendRequestedCatalog();
+
+    while (true)
+    {
+        const int recordSize = eventQueue->getNextSize();
+
+        if (recordSize == 0)
+        {
+            break;
+        }
+
+        // continuous blocks get a buffer of their own size, so that events don't need one as large
+        const int bufferSize = recordSize > captureBufferSize ? continuousBufferSize : captureBufferSize;
+
+        if (recordBuffer != nullptr && recordBuffer->getCapacity() < (size_t) recordSize)
+        {
+            MessagePool::release(recordBuffer);
+            recordBuffer = nullptr;
+        }
+
+        if (recordBuffer == nullptr)
+        {
+            recordBuffer = messagePool->acquire(bufferSize);
+        }
+
+        eventQueue->pop(recordBuffer->getData(), (int) recordBuffer->getCapacity());
+
+        const EventRecord header = *reinterpret_cast<const EventRecord*>(recordBuffer->getData());
+        const int64 allocationsBefore = activeProfiling ? messagePool->getNumAllocated() : 0;
+
+        sendRecord(recordBuffer);
+
+        if (activeProfiling)
+        {
+            // counting the buffer that replaces one handed to ZMQ
+            if (recordBuffer == nullptr)
             {
-                ed->setDisplayedFormat(outputFormat);
+                recordBuffer = messagePool->acquire(captureBufferSize);
             }
+            countAllocations(header, allocationsBefore);
         }
     }
- 
 }
 
-template <typename T>
-var EventBroadcaster::binaryValueToVar(const void* value, unsigned int dataLength)
+void EventBroadcaster::writeJSON(const EventRecord& record, const char* payload, OutputStream& dest)
 {
-    auto typedValue = reinterpret_cast<const T*>(value);
+    const int64 startTicks = activeProfiling ? Time::getHighResolutionTicks() : 0;
+    const int64 startPosition = activeProfiling ? dest.getPosition() : 0;
 
-    if (dataLength == 1)
+    EventEncoder::writeJSON(*channelEncodings.getUnchecked(record.channelIndex), record, payload, dest);
+
+    // the event itself was counted when it was captured
+    if (activeProfiling)
     {
-        return String(*typedValue);
+        countEncoding(record.baseType, JSON_STRING, startTicks, dest.getPosition() - startPosition, 0);
     }
-    else
+}
+
+const EventBroadcaster::ChannelEncoding& EventBroadcaster::getSendEncoding(uint16 channelIndex) const
+{
+    return *channelEncodings.getUnchecked(channelIndex);
+}
+
+int EventBroadcaster::sendMessage(const MsgPart* parts, int numParts)
+{
+#ifdef ZEROMQ
+    // read once, so every part goes out on the same socket even if it's being replaced
+    ZMQSocket* socket = zmqSocket.get();
+    if (socket == nullptr) // no socket bound yet
+    {
+        for (int i = 0; i < numParts; ++i)
+        {
+            MessagePool::release(parts[i].buffer);
+        }
+        return -1;
+    }
+
+    for (int i = 0; i < numParts; ++i)
     {
-        Array<var> metaDataArray;
-        for (unsigned int i = 0; i < dataLength; ++i)
+        const MsgPart& part = parts[i];
+        int flags = (i < numParts - 1) ? ZMQ_SNDMORE : 0;
+
+        int status = (part.buffer != nullptr)
+            ? socket->send(part.buffer, part.data, part.size, flags)
+            : socket->send(part.data, part.size, flags);
+
+        if (-1 == status)
         {
-            metaDataArray.add(String(typedValue[i]));
+            // full queues are counted by the socket rather than logged for every message
+            if (zmq_errno() != EAGAIN)
+            {
+                std::cout << "Error sending " << part.name << ": " << zmq_strerror(zmq_errno()) << std::endl;
+            }
+
+            // the remaining buffers never made it to ZMQ
+            for (int j = i + 1; j < numParts; ++j)
+            {
+                MessagePool::release(parts[j].buffer);
+            }
+            return -1;
         }
-        return metaDataArray;
     }
+#else
+    for (int i = 0; i < numParts; ++i)
+    {
+        MessagePool::release(parts[i].buffer);
+    }
+#endif
+    return 0;
+}
+
+void EventBroadcaster::handleTTLEvent(TTLEventPtr event)
+{
+    const ChannelEncoding* encoding = getEncoding(event->getChannelInfo());
+
+    if (encoding == nullptr)
+    {
+        jassertfalse; // channel wasn't known at updateSettings()
+        return;
+    }
+
+    const Config& config = *blockConfig;
+
+    if (!config.included.getUnchecked(encoding->index) || !config.filter.includesLine(event->getLine()))
+    {
+        return;
+    }
+
+    if (!config.wanted.getUnchecked(encoding->index))
+    {
+        ++numSkipped;
+        return;
+    }
+
+    const int64 startTicks = activeProfiling ? Time::getHighResolutionTicks() : 0;
+
+    int numBytes = captureEvent(*event, *encoding, config, captureBuffer->getData(), captureBufferSize);
+
+    if (activeProfiling && numBytes > 0)
+    {
+        // JSON bytes are counted when the text is written
+        const EventRecord* record = reinterpret_cast<const EventRecord*>(captureBuffer->getData());
+        countEncoding(TTL_RECORD, record->format, startTicks,
+            record->format == JSON_STRING ? 0 : record->payloadSize, 1);
+    }
+
+    dispatchRecord(captureBuffer, captureBufferSize, numBytes);
 }
 
-var EventBroadcaster::stringValueToVar(const void* value, unsigned int dataLength)
+void EventBroadcaster::handleSpike(SpikePtr spike)
 {
-    return String::createStringFromData(value, dataLength);
+    const ChannelEncoding* encoding = getEncoding(spike->getChannelInfo());
+
+    if (encoding == nullptr)
+    {
+        jassertfalse; // channel wasn't known at updateSettings()
+        return;
+    }
+
+    const Config& config = *blockConfig;
+
+    if (!config.included.getUnchecked(encoding->index) || !config.filter.includesUnit(spike->getSortedId()))
+    {
+        return;
+    }
+
+    if (!config.wanted.getUnchecked(encoding->index))
+    {
+        ++numSkipped;
+        return;
+    }
+
+    const int64 startTicks = activeProfiling ? Time::getHighResolutionTicks() : 0;
+
+    int numBytes = captureSpike(*spike, *encoding, config, captureBuffer->getData(), captureBufferSize);
+
+    if (activeProfiling && numBytes > 0)
+    {
+        // JSON bytes are counted when the text is written
+        const EventRecord* record = reinterpret_cast<const EventRecord*>(captureBuffer->getData());
+        countEncoding(SPIKE_RECORD, record->format, startTicks,
+            record->format == JSON_STRING ? 0 : record->payloadSize, 1);
+    }
+
+    dispatchRecord(captureBuffer, captureBufferSize, numBytes);
 }
 
-EventBroadcaster::DataToVarFcn EventBroadcaster::getDataReader(BaseType dataType)
+void EventBroadcaster::saveCustomParametersToXml(XmlElement* parentElement)
 {
-    switch (dataType)
+    XmlElement* mainNode = parentElement->createNewChildElement("EVENTBROADCASTER");
+    mainNode->setAttribute("port", listeningPort);
+    mainNode->setAttribute("format", (int) outputFormat);
+    mainNode->setAttribute("send_mode", (int) sendMode);
+    mainNode->setAttribute("queue_size", queueCapacity);
+    mainNode->setAttribute("batch", batchEnabled);
+    mainNode->setAttribute("batch_max_events", maxBatchEvents);
+    mainNode->setAttribute("batch_max_us", maxBatchMicros);
+    mainNode->setAttribute("topics", topicsEnabled);
+    mainNode->setAttribute("spike_columns", (int) spikeColumnMode);
+    mainNode->setAttribute("int16_waveforms", quantizeWaveforms);
+    mainNode->setAttribute("neighbour_channels", neighbourChannels);
+    mainNode->setAttribute("continuous_rate", continuousRate);
+    mainNode->setAttribute("continuous_channels", continuousChannels);
+    mainNode->setAttribute("continuous_int16", continuousQuantized);
+
+    mainNode->setAttribute("profile", profilingEnabled);
+    mainNode->setAttribute("shm_name", sharedRingName);
+    mainNode->setAttribute("shm_slots", sharedRingSlots);
+    mainNode->setAttribute("shm_bytes", sharedRingBytes);
+
+    mainNode->setAttribute("sndhwm", socketOptions.sendHighWaterMark);
+    mainNode->setAttribute("sndbuf", socketOptions.sendBufferSize);
+    mainNode->setAttribute("linger", socketOptions.lingerMillis);
+    mainNode->setAttribute("immediate", socketOptions.immediate);
+    mainNode->setAttribute("xpub_nodrop", socketOptions.noDrop);
+    mainNode->setAttribute("tcp_keepalive", socketOptions.tcpKeepalive);
+    mainNode->setAttribute("tcp_keepalive_idle", socketOptions.tcpKeepaliveIdle);
+    mainNode->setAttribute("tcp_keepalive_intvl", socketOptions.tcpKeepaliveInterval);
+    mainNode->setAttribute("tcp_keepalive_cnt", socketOptions.tcpKeepaliveCount);
+
+    StringArray cpus;
+    for (int cpu : contextOptions.affinityCpus)
     {
-    case BaseType::CHAR:
-        return &stringValueToVar;
+        cpus.add(String(cpu));
+    }
 
-    case BaseType::INT8:
-        return &binaryValueToVar<int8>;
+    mainNode->setAttribute("io_threads", contextOptions.ioThreads);
+    mainNode->setAttribute("io_affinity", cpus.joinIntoString(","));
+    mainNode->setAttribute("io_priority", contextOptions.threadPriority);
+    mainNode->setAttribute("io_sched_policy", contextOptions.schedPolicy);
+
+    for (auto& endpoint : extraEndpoints)
+    {
+        mainNode->createNewChildElement("ENDPOINT")->setAttribute("address", endpoint);
+    }
 
-    case BaseType::UINT8:
-        return &binaryValueToVar<uint8>;
+    filter.saveToXml(mainNode);
+}
 
-    case BaseType::INT16:
-        return &binaryValueToVar<int16>;
 
-    case BaseType::UINT16:
-        return &binaryValueToVar<uint16>;
+void EventBroadcaster::loadCustomParametersFromXml(XmlElement* parametersXml)
+{
 
-    case BaseType::INT32:
-        return &binaryValueToVar<int32>;
+    forEachXmlChildElement(*parametersXml, mainNode)
+    {
+        if (mainNode->hasTagName("EVENTBROADCASTER"))
+        {
+            outputFormat = (Format) mainNode->getIntAttribute("format", outputFormat);
+            sendMode = (SendMode) mainNode->getIntAttribute("send_mode", sendMode);
+            queueCapacity = mainNode->getIntAttribute("queue_size", queueCapacity);
+            batchEnabled = mainNode->getBoolAttribute("batch", batchEnabled);
+            maxBatchEvents = jmax(1, mainNode->getIntAttribute("batch_max_events", maxBatchEvents));
+            maxBatchMicros = mainNode->getIntAttribute("batch_max_us", maxBatchMicros);
+            topicsEnabled = mainNode->getBoolAttribute("topics", topicsEnabled);
+            spikeColumnMode = (SpikeColumnMode) jlimit(0, 2, mainNode->getIntAttribute("spike_columns", spikeColumnMode));
+            quantizeWaveforms = mainNode->getBoolAttribute("int16_waveforms", quantizeWaveforms);
+            neighbourChannels = jmax(0, mainNode->getIntAttribute("neighbour_channels", neighbourChannels));
+            setContinuousRate(mainNode->getDoubleAttribute("continuous_rate", continuousRate));
+            setContinuousChannels(mainNode->getStringAttribute("continuous_channels", continuousChannels));
+            continuousQuantized = mainNode->getBoolAttribute("continuous_int16", continuousQuantized);
+
+            profilingEnabled = mainNode->getBoolAttribute("profile", profilingEnabled);
+            setSharedMemoryName(mainNode->getStringAttribute("shm_name", sharedRingName));
+            sharedRingSlots = jmax(16, mainNode->getIntAttribute("shm_slots", sharedRingSlots));
+            sharedRingBytes = jmax(65536, mainNode->getIntAttribute("shm_bytes", sharedRingBytes));
+
+            SocketOptions socket = socketOptions;
+            socket.sendHighWaterMark = mainNode->getIntAttribute("sndhwm", socket.sendHighWaterMark);
+            socket.sendBufferSize = mainNode->getIntAttribute("sndbuf", socket.sendBufferSize);
+            socket.lingerMillis = mainNode->getIntAttribute("linger", socket.lingerMillis);
+            socket.immediate = mainNode->getBoolAttribute("immediate", socket.immediate);
+            socket.noDrop = mainNode->getBoolAttribute("xpub_nodrop", socket.noDrop);
+            socket.tcpKeepalive = mainNode->getIntAttribute("tcp_keepalive", socket.tcpKeepalive);
+            socket.tcpKeepaliveIdle = mainNode->getIntAttribute("tcp_keepalive_idle", socket.tcpKeepaliveIdle);
+            socket.tcpKeepaliveInterval = mainNode->getIntAttribute("tcp_keepalive_intvl", socket.tcpKeepaliveInterval);
+            socket.tcpKeepaliveCount = mainNode->getIntAttribute("tcp_keepalive_cnt", socket.tcpKeepaliveCount);
+
+            bool restart = storeSocketOptions(socket);
+
+            ContextOptions options = contextOptions;
+            options.ioThreads = mainNode->getIntAttribute("io_threads", options.ioThreads);
+            options.threadPriority = mainNode->getIntAttribute("io_priority", options.threadPriority);
+            options.schedPolicy = mainNode->getIntAttribute("io_sched_policy", options.schedPolicy);
+
+            if (mainNode->hasAttribute("io_affinity"))
+            {
+                StringArray cpus;
+                cpus.addTokens(mainNode->getStringAttribute("io_affinity"), ",", "");
+                cpus.trim();
+                cpus.removeEmptyStrings();
 
-    case BaseType::UINT32:
-        return &binaryValueToVar<uint32>;
+                options.affinityCpus.clear();
+                for (auto& cpu : cpus)
+                {
+                    options.affinityCpus.add(cpu.getIntValue());
+                }
+            }
+            restart = storeContextOptions(options) || restart;
 
-    case BaseType::INT64:
-        return &binaryValueToVar<int64>;
+            StringArray endpoints;
+            forEachXmlChildElementWithTagName(*mainNode, endpointNode, "ENDPOINT")
+            {
+                endpoints.add(endpointNode->getStringAttribute("address"));
+            }
+            restart = storeExtraEndpoints(endpoints) || restart;
 
-    case BaseType::UINT64:
-        return &binaryValueToVar<uint64>;
+            // the socket is only replaced once, with everything above applied.
+            // This overrides an existing async call to setListeningPort, if any
+            setListeningPort(mainNode->getIntAttribute("port", listeningPort), restart, false, false);
 
-    case BaseType::FLOAT:
-        return &binaryValueToVar<float>;
+            filter.loadFromXml(mainNode);
+            publishConfig();
 
-    case BaseType::DOUBLE:
-        return &binaryValueToVar<double>;
+            auto ed = static_cast<EventBroadcasterEditor*>(getEditor());
+            if (ed)
+            {
+                ed->setDisplayedFormat(outputFormat);
+                ed->setDisplayedSendMode(sendMode);
+                ed->setDisplayedBatchEnabled(batchEnabled);
+                ed->setDisplayedTopicsEnabled(topicsEnabled);
+                ed->setDisplayedFilter(filter);
+            }
+        }
     }
-    jassertfalse;
-    return nullptr;
+ 
 }
 
 void EventBroadcaster::handleAsyncUpdate()
@@ -512,5 +2418,28 @@ void EventBroadcaster::handleAsyncUpdate()
     // should already be in the message thread, but just in case:
     const MessageManagerLock mmlock;
 
-    setListeningPort(asyncPort, asyncForceRestart, asyncSearchForPort);
+    if (asyncSocketReplaced.compareAndSetBool(0, 1))
+    {
+#ifdef ZEROMQ
+        const int status = asyncSocketStatus.get();
+        if (status != 0)
+        {
+            CoreServices::sendStatusMessage("Event Broadcaster: " + String(zmq_strerror(status)));
+        }
+#endif
+
+        listeningPort = getListeningPort();
+        updateDiscoveryFile();
+
+        auto editor = static_cast<EventBroadcasterEditor*>(getEditor());
+        if (editor != nullptr)
+        {
+            editor->setDisplayedPort(listeningPort);
+        }
+    }
+
+    if (asyncPortPending.compareAndSetBool(0, 1))
+    {
+        setListeningPort(asyncPort, asyncForceRestart, asyncSearchForPort);
+    }
 }
@@ -26,22 +26,109 @@
 
 #include <ProcessorHeaders.h>
 
+#include "CompactFormat.h"
+#include "Decimator.h"
+#include "EventEncoder.h"
+#include "EventFilter.h"
+#include "EventQueue.h"
+#include "EventSender.h"
+#include "JsonWriter.h"
+#include "LatencyHistogram.h"
+#include "SharedRingWriter.h"
+#include "WaveformQuantizer.h"
+#include "MessagePool.h"
+#include "RcuPointer.h"
+
+#include <unordered_map>
+
 #ifdef ZEROMQ
         #include <zmq.h>
 #endif
 
 class EventBroadcaster : public GenericProcessor
                        , private AsyncUpdater
+                       , private EventEncoder
+                       , private EventSender
 {
 public:
     /** ids for format combobox */
-    enum Format { RAW_BINARY = 1, JSON_STRING = 2};
+    using EventEncoder::Format;
+    using EventEncoder::RAW_BINARY;
+    using EventEncoder::JSON_STRING;
+    using EventEncoder::COMPACT_BINARY;
+
+    /** ids for send mode combobox */
+    enum SendMode { SEND_INLINE = 1, SEND_THREAD = 2 };
+
+    /** Whether batched Compact spikes are sent as columns, and whether with waveforms */
+    enum SpikeColumnMode { SPIKE_COLUMNS_OFF = 0, SPIKE_COLUMNS = 1, SPIKE_COLUMNS_WITH_WAVEFORMS = 2 };
+
+    /** Counters for the queue between the processing thread and the sender thread */
+    struct QueueStats
+    {
+        int numRecords;
+        int numBytes;
+        int peakBytes;
+        int capacity;
+        int64 numPushed;
+        int64 numDropped;
+    };
+
+    /** Cost of encoding events or spikes in one format, measured while profiling */
+    struct EncodingStats
+    {
+        int64 numEncoded;
+        double nanosPerEvent;
+        double bytesPerEvent;
+        double allocationsPerEvent;     // pool allocations while sending each one, including its share of batches
+    };
+
+    /** Time from an event or spike reaching the handler to its message being handed to ZMQ, measured while profiling */
+    struct LatencyStats
+    {
+        int64 numSent;
+        double p50Micros;
+        double p99Micros;
+        double p999Micros;
+        double maxMicros;
+        double eventsPerSecond;     // from the first event sent to the last
+    };
+
+    /** Settings for the ZMQ context shared by every broadcaster. They are
+        applied when the context is created, along with its I/O threads. */
+    struct ContextOptions
+    {
+        int ioThreads;              // ZMQ_IO_THREADS
+        Array<int> affinityCpus;    // ZMQ_THREAD_AFFINITY_CPU_ADD for each; empty for any CPU
+        int threadPriority;         // ZMQ_THREAD_PRIORITY, or -1 for the default
+        int schedPolicy;            // ZMQ_THREAD_SCHED_POLICY (e.g. SCHED_FIFO), or -1 for the default
+
+        bool operator==(const ContextOptions& other) const;
+        bool operator!=(const ContextOptions& other) const { return !(*this == other); }
+    };
+
+    /** Options for the publishing socket; -1 leaves ZMQ's default */
+    struct SocketOptions
+    {
+        int sendHighWaterMark;      // ZMQ_SNDHWM, in messages
+        int sendBufferSize;         // ZMQ_SNDBUF, in bytes
+        int lingerMillis;           // ZMQ_LINGER
+        bool immediate;             // ZMQ_IMMEDIATE: only queue messages for completed connections
+        bool noDrop;                // ZMQ_XPUB_NODROP: report a full queue as a failed send rather than dropping silently
+        int tcpKeepalive;           // ZMQ_TCP_KEEPALIVE: 1 to enable, 0 to disable
+        int tcpKeepaliveIdle;       // ZMQ_TCP_KEEPALIVE_IDLE, in seconds
+        int tcpKeepaliveInterval;   // ZMQ_TCP_KEEPALIVE_INTVL, in seconds
+        int tcpKeepaliveCount;      // ZMQ_TCP_KEEPALIVE_CNT
+
+        bool operator==(const SocketOptions& other) const;
+        bool operator!=(const SocketOptions& other) const { return !(*this == other); }
+    };
 
     /** Constructor */
     EventBroadcaster();
 
     /** Destructor */
-    ~EventBroadcaster() { }
+    ~EventBroadcaster();
 
     /** Create custom editor*/
     AudioProcessorEditor* createEditor() override;
@@ -49,15 +136,152 @@ public:
     /** Returns the current listening port number */
     int getListeningPort() const;
     
-    /**Returns 0 on success, else the errno value for the error that occurred. */
+    /** Returns 0 on success, else the errno value for the error that occurred. A port of 0 binds
+        to any free port; with searchForPort, any free port is used if the given one is taken. */
     int setListeningPort(int port, bool forceRestart = false, bool searchForPort = false, bool synchronous = true);
 
-    /** Returns the output format (RAW_BINARY, HEADER_ONLY, HEADER_AND_JSON) */
+    /** Returns the file that describes how to reach this broadcaster, for consumers on the same machine */
+    File getDiscoveryFile() const;
+
+    /** Returns the endpoints bound in addition to the TCP port */
+    StringArray getExtraEndpoints() const;
+
+    /** Sets endpoints to bind in addition to the TCP port, such as "ipc:///tmp/events" or
+        "inproc://events", recreating the socket if they changed. Returns 0 on success, else the
+        errno value for the first that failed. */
+    int setExtraEndpoints(const StringArray& endpoints);
+
+    /** Returns the name of the shared-memory ring events are also written to, or an empty string if none */
+    String getSharedMemoryName() const;
+
+    /** Sets the name of a shared-memory ring (e.g. "/open-ephys-events") to also write events and
+        spikes to, or an empty string for none; takes effect at the start of the next acquisition */
+    void setSharedMemoryName(const String& name);
+
+    /** Returns the options for the publishing socket */
+    SocketOptions getSocketOptions() const;
+
+    /** Sets the options for the publishing socket, recreating it if they changed */
+    int setSocketOptions(const SocketOptions& options);
+
+    /** Returns the number of messages the socket refused because a subscriber's queue was full
+        (only counted with noDrop set; otherwise ZMQ drops them silently) */
+    int64 getNumSendsDropped() const;
+
+    /** Returns the options for the shared ZMQ context */
+    static ContextOptions getContextOptions();
+
+    /** Sets the options for the shared ZMQ context. If this is the only broadcaster, the context is
+        recreated straight away (but not during acquisition); otherwise they apply once every
+        broadcaster has been removed. */
+    void setContextOptions(const ContextOptions& options);
+
+    /** Returns the ZMQ context the broadcaster's sockets belong to, for connecting to
+        "inproc://" endpoints from the same process, or nullptr if no broadcaster exists.
+        Only valid while a broadcaster exists. */
+    static void* getZMQContext();
+
+    /** Returns the output format (RAW_BINARY, JSON_STRING, COMPACT_BINARY) */
     Format getOutputFormat() const;
 
     /** Sets the output format*/
     void setOutputFormat(Format format);
 
+    /** Returns whether events are sent from the processing thread or a background thread */
+    SendMode getSendMode() const;
+
+    /** Sets the send mode; takes effect at the start of the next acquisition */
+    void setSendMode(SendMode mode);
+
+    /** Returns whether events are grouped into one message per processing block */
+    bool getBatchEnabled() const;
+
+    /** Enables or disables sending one message per processing block */
+    void setBatchEnabled(bool enabled);
+
+    /** Returns how batched spikes are sent when the format is Compact */
+    SpikeColumnMode getSpikeColumnMode() const;
+
+    /** Sets how batched spikes are sent when the format is Compact; takes effect at the start of the next acquisition */
+    void setSpikeColumnMode(SpikeColumnMode mode);
+
+    /** Returns whether Compact spike waveforms are sent as int16 rather than float32 */
+    bool getWaveformsQuantized() const;
+
+    /** Sends Compact spike waveforms as int16, scaled by the resolution of each electrode */
+    void setWaveformsQuantized(bool quantized);
+
+    /** Returns how many channels around the peak channel of a spike are sent, or 0 for all of them */
+    int getNeighbourChannels() const;
+
+    /** Trims the waveforms and amplitudes of spikes on larger electrodes to the given number of
+        channels nearest the one with the deepest trough; 0 sends every channel */
+    void setNeighbourChannels(int numChannels);
+
+    /** Returns the rate continuous data is decimated to and broadcast at, or 0 if it isn't sent */
+    double getContinuousRate() const;
+
+    /** Sets the rate to decimate continuous data to, or 0 to not send it; applies from the next settings update */
+    void setContinuousRate(double rate);
+
+    /** Returns the continuous channels of each stream that are sent, e.g. "0-31", or an empty string for all */
+    const String& getContinuousChannels() const;
+
+    /** Sets the continuous channels to send, by index within each stream. Returns false, leaving them
+        unchanged, if the text isn't valid. Applies from the next settings update. */
+    bool setContinuousChannels(const String& ranges);
+
+    /** Returns whether continuous data is sent as int16 rather than float32 */
+    bool getContinuousQuantized() const;
+
+    /** Sends continuous data as int16, scaled by the resolution of each channel; applies from the next settings update */
+    void setContinuousQuantized(bool quantized);
+
+    /** Returns whether each message starts with a topic frame such as "spike/<stream>/<electrode>" */
+    bool getTopicsEnabled() const;
+
+    /** Enables or disables topic frames */
+    void setTopicsEnabled(bool enabled);
+
+    /** Returns the selection of streams, electrodes, TTL lines and sorted units to broadcast */
+    const EventFilter& getFilter() const;
+
+    /** Replaces the selection of what to broadcast; takes effect from the next processing block */
+    void setFilter(const EventFilter& newFilter);
+
+    /** Returns the names of the streams that have event or spike channels */
+    StringArray getStreamNames() const;
+
+    /** Returns the names of the electrodes in a stream */
+    StringArray getElectrodeNames(const String& stream) const;
+
+    /** Returns the current state of the send queue (all zero when sending inline) */
+    QueueStats getQueueStats() const;
+
+    /** Returns the number of events and spikes that weren't encoded because nobody was subscribed to them */
+    int64 getNumSkipped() const;
+
+    /** Returns whether encoding costs are measured (and logged at the end of acquisition) */
+    bool getProfilingEnabled() const;
+
+    /** Enables or disables measuring encoding costs; takes effect at the start of the next acquisition */
+    void setProfilingEnabled(bool enabled);
+
+    /** Returns the encoding costs measured during the current or last acquisition */
+    EncodingStats getEncodingStats(bool spikes, Format format) const;
+
+    /** Returns the send latency measured during the last acquisition */
+    LatencyStats getLatencyStats() const;
+
+    /** Builds the per-channel encoding cache and sizes the capture buffers */
+    void updateSettings() override;
+
+    /** Starts the sender thread, if needed */
+    bool startAcquisition() override;
+
+    /** Flushes the send queue and stops the sender thread */
+    bool stopAcquisition() override;
+
     /** Streams events via ZMQ */
     void process(AudioBuffer<float>& continuousBuffer) override;
 
@@ -74,55 +298,179 @@ public:
     void loadCustomParametersFromXml(XmlElement* parameters) override;
 
 private:
-    struct MsgPart
-    {
-        String name;
-        MemoryBlock data;
-    };
-
     class ZMQContext : public ReferenceCountedObject
     {
     public:
         ZMQContext();
         ~ZMQContext();
         void* createZMQSocket();
+        void* getContext() const;
+        const ContextOptions& getOptions() const;
     private:
         void* context;
+        ContextOptions options;     // as applied at creation
     };
 
     class ZMQSocket
     {
     public:
-        ZMQSocket();
+        ZMQSocket(const SocketOptions& options);
         ~ZMQSocket();
 
         bool isValid() const;
         int getBoundPort() const;
 
+        /** Returns the context this socket belongs to */
+        const ZMQContext& getContext() const;
+
+        /** Returns the number of sockets sharing the context */
+        int getNumContextUsers() const;
+
+        /** Returns the number of sends that failed because a queue was full */
+        int64 getNumDropped() const;
+
         int send(const void* buf, size_t len, int flags);
+        int send(MessagePool::Buffer* buffer, const void* buf, size_t len, int flags);
         int bind(int port);
         int unbind();
+
+        /** Binds to a port chosen by the system (tcp://*:*) and records which one it was */
+        int bindAnyPort();
+
+        /** Binds an endpoint such as "ipc:///tmp/events" in addition to the port */
+        int bindEndpoint(const String& endpoint);
+
+        /** Unbinds everything bound with bindEndpoint() */
+        void unbindEndpoints();
+
+        /** Returns true if any of these endpoints were bound with bindEndpoint() */
+        bool isBoundToAny(const StringArray& endpoints) const;
+
+        /** Reads an (un)subscription that has arrived into buffer, without blocking. Returns
+            its full size, which may be more than was copied, or -1 if there was none. */
+        int receive(void* buffer, size_t size);
+
+        /** Returns a number that no other socket created by this process has */
+        uint32 getSerial() const;
     private:
+        /** Sets an integer socket option, logging failures */
+        void setOption(int option, int value, const char* name);
+
         int boundPort;
         void* socket;
+        String boundEndpoint;       // as reported by ZMQ, for unbinding
+        StringArray boundEndpoints;
+        Atomic<int64> numDropped;
+        const uint32 serial;
 
         // see here for why the context can't just be static:
         // https://github.com/zeromq/libzmq/issues/1708
         SharedResourcePointer<ZMQContext> context;
     };
 
-    /** Sends an event over ZMQ */
-    void sendEvent(TTLEventPtr event) const;
+    /** Value of the "type" frame for the channel catalog */
+    static const uint16 CATALOG_TYPE = 3;
 
-    /** Sends a spike over ZMQ */
-    void sendSpike(SpikePtr spike) const;
+    /** Longest subscription message kept, i.e. a subscribe or unsubscribe byte and a topic */
+    static const int MAX_SUBSCRIPTION_SIZE = MAX_TOPIC_SIZE + 1;
 
-    /** Sends a multi-part ZMQ message */
-    int sendMessage(const Array<MsgPart>& parts) const;
+    /** The settings that the processing and sending threads use. They never change once
+        published; changing a setting publishes a new Config, so settings can change
+        during acquisition without the real-time path locking. */
+    struct Config : public Settings
+    {
+        EventFilter filter;
+        Array<bool> included;   // per ChannelEncoding, selected by the filter
+        Array<bool> continuousIncluded;     // per ContinuousStream, selected by the filter
+        Array<bool> wanted;     // per ChannelEncoding, set if any subscriber would receive its messages
+        Array<bool> continuousWanted;       // per ContinuousStream, likewise
+    };
 
-    // add metadata from an event to a DynamicObject
-    static void populateMetadata(const MetadataEventObject* channel,
-                                 const EventBasePtr event, DynamicObject::Ptr dest);
+    /** Threads that read liveConfig */
+    enum ConfigReader
+    {
+        PROCESSING_READER = 0,
+        SENDING_READER          // only in thread mode; otherwise the processing thread sends
+    };
+
+    /** Drains the queue from the processing thread to the socket */
+    class SenderThread : public Thread
+    {
+    public:
+        SenderThread(EventBroadcaster& owner);
+        void run() override;
+    private:
+        EventBroadcaster& owner;
+    };
+
+    /** Keeps track of subscriptions during acquisition, so that the sending thread doesn't have to */
+    class SubscriptionThread : public Thread
+    {
+    public:
+        SubscriptionThread(EventBroadcaster& owner);
+        void run() override;
+    private:
+        EventBroadcaster& owner;
+    };
+
+    /** Replaces the socket in the background while acquisition is running */
+    class SocketThread : public Thread
+    {
+    public:
+        SocketThread(EventBroadcaster& owner, int port, bool searchForPort,
+                     const SocketOptions& options, const StringArray& endpoints);
+        void run() override;
+    private:
+        EventBroadcaster& owner;
+        const int port;
+        const bool searchForPort;
+        const SocketOptions options;
+        const StringArray endpoints;
+    };
+
+    /** Returns the cached encoding for a channel, or nullptr if it wasn't known at updateSettings() */
+    const ChannelEncoding* getEncoding(const void* channelInfo) const;
+
+    /** Sends the record in a processing-thread buffer, or queues it for the sender thread.
+        If the buffer is passed on to ZMQ, another one of bufferSize bytes replaces it. */
+    void dispatchRecord(MessagePool::Buffer*& buffer, int bufferSize, int numBytes);
+
+    /** Encodes the catalog of event and spike channels for the current settings */
+    void buildCatalog(Format format, MemoryBlock& dest) const;
+
+    /** Sends the channel catalog; only call from the thread that is currently sending */
+    void sendCatalog(const Config& config);
+
+    /** Sends the catalog if one was requested since it was last sent */
+    void sendRequestedCatalog();
+
+    /** Publishes a Config made from the current settings and filter */
+    void publishConfig();
+
+    /** Passes (un)subscriptions that have arrived on the socket to updateSubscriptions(); sending thread only */
+    void pollSubscriptions();
+
+    /** Applies the (un)subscriptions that pollSubscriptions() passed on, and publishes a Config with the channels
+        anyone wants if that changed; subscription thread only, or the message thread while it isn't running */
+    void updateSubscriptions();
+
+    /** Works out which channels and streams anyone wants, from the current subscriptions; call with configLock held */
+    void updateWanted(Config& config) const;
+
+    /** Returns true if anyone is subscribed to the messages that a channel's events or spikes end up in */
+    bool hasSubscriber(const Config& config, const ChannelEncoding& encoding) const;
+
+    /** Sends everything in the queue; called from the sender thread */
+    void drainQueue();
+
+    /** Writes a captured event or spike as a JSON object, counting the cost if profiling */
+    void writeJSON(const EventRecord& record, const char* payload, OutputStream& dest) override;
+
+    /** Sends a multi-part message over ZMQ */
+    int sendMessage(const MsgPart* parts, int numParts) override;
+
+    /** Returns the encoding for a record being sent */
+    const ChannelEncoding& getSendEncoding(uint16 channelIndex) const override;
 
     void handleAsyncUpdate() override; // to change port asynchronously
 
@@ -131,32 +479,204 @@ private:
     // called from setListeningPort() depending on success/failure of ZMQ operations
     void reportActualListeningPort(int port);
 
+    // writes or removes the discovery file for the bound port
+    void updateDiscoveryFile();
+
+    // the setters for socket settings without replacing the socket; each
+    // returns true if the socket has to be replaced for the new settings to apply
+    bool storeExtraEndpoints(const StringArray& endpoints);
+    bool storeSocketOptions(const SocketOptions& options);
+    bool storeContextOptions(const ContextOptions& options);
+
+    // binds extra endpoints on a socket; returns the errno value for the first that failed
+    int bindExtraEndpoints(ZMQSocket& socket, const StringArray& endpoints);
+
+    // binds a new socket and swaps it in for the current one; returns the errno value on
+    // failure, in which case the old socket stays unless it had to go to free its port or
+    // endpoints. Blocks until the sending thread has let go of the old socket, however long
+    // that takes, so that a replacement never ends with no socket published. Only uses
+    // the settings it's given, so that it can run while they change on the message thread.
+    int replaceSocket(int port, bool searchForPort, const SocketOptions& options, const StringArray& endpoints);
+
+    // swaps in a new socket (or none) for the sending thread to pick up
+    void publishSocket(ZMQSocket* socket);
+
+    // deletes retired sockets once the sending thread is done with them; false on timeout, or if
+    // the calling thread is asked to exit first. A negative timeout waits for as long as it takes.
+    bool waitForRetiredSockets(int timeoutMs);
+
     // share a "dumb" pointer that doesn't take part in reference counting.
     // want the context to be terminated by the time the static members are
     // destroyed (see: https://github.com/zeromq/libzmq/issues/1708)
     static ZMQContext* sharedContext;
     static CriticalSection sharedContextLock;
-    ScopedPointer<ZMQSocket> zmqSocket;
-    int listeningPort;
+
+    // used by ZMQContext when it's created; message thread only
+    static ContextOptions contextOptions;
+
+    // read by the sending thread without locking; see RcuPointer
+    RcuPointer<ZMQSocket> zmqSocket;
+    CriticalSection socketLock;         // for publishing and reclaiming, and reads from other threads
+    CriticalSection socketReplaceLock;  // one replacement at a time
+    std::unique_ptr<SocketThread> socketThread;
+
+    SocketOptions socketOptions;
+    int listeningPort;          // bound port, or 0; message thread only
+    File discoveryFile;         // written for the current port
+    StringArray extraEndpoints;
+
+    // ---- settings; message thread only, and published as a Config ----
 
     Format outputFormat;
+    bool batchEnabled;
+    bool topicsEnabled;
+    bool quantizeWaveforms;
+    int neighbourChannels;
+    EventFilter filter;
+
+    RcuPointer<Config, SENDING_READER + 1> liveConfig;
+    CriticalSection configLock; // for publishing to liveConfig, which the message and subscription threads both do
+    const Config* blockConfig;  // liveConfig for the current block; processing thread only
+
+    // ---- sending from a background thread ----
+
+    SendMode sendMode;
+    SendMode activeSendMode;    // mode of the current acquisition
+    int queueCapacity;          // in bytes
+
+    std::unique_ptr<EventQueue> eventQueue;
+    std::unique_ptr<SenderThread> senderThread;
+
+    // ---- shared-memory output, written by whichever thread sends ----
+
+    String sharedRingName;
+    int sharedRingSlots;
+    int sharedRingBytes;        // room for payloads, which can be much less than slots x largest record
+    std::unique_ptr<SharedRingWriter> sharedRing;
+
+    // ---- continuous data, rebuilt in updateSettings() ----
+
+    /** A stream whose continuous data is decimated and broadcast */
+    struct ContinuousStream
+    {
+        uint16 index;           // position in continuousStreams, and in the catalog's "continuous" list
+        uint16 streamId;
+        String name;
+        float sampleRate;       // of the input
+        Array<int> channels;    // selected channels, as indices into the continuous buffer
+        StringArray channelNames;
+        Array<float> scales;    // step of int16 samples: the resolution of each channel
+        uint8 sampleFormat;     // COMPACT_SAMPLES_FLOAT32 or COMPACT_SAMPLES_INT16
+        Decimator decimator;    // processing thread only
+        bool skipped;           // the decimator missed blocks nobody wanted; processing thread only
+        MemoryBlock topic;      // "continuous/<stream>"
+    };
+
+    /** Decimates the selected channels of each stream and dispatches a record per block */
+    void captureContinuous(const AudioSampleBuffer& continuousBuffer, const Config& config);
+
+    /** Sends a captured block of continuous data */
+    void sendContinuous(const EventRecord& record, MessagePool::Buffer*& recordBuffer) override;
+
+    double continuousRate;      // settings; message thread only
+    String continuousChannels;
+    bool continuousQuantized;
+
+    OwnedArray<ContinuousStream> continuousStreams;
+    HeapBlock<const float*> continuousInputs;   // channel pointers for Decimator::process()
+    HeapBlock<float> decimatedSamples;          // int16 blocks are decimated here first
+
+    // ---- per-channel encodings, rebuilt in updateSettings() ----
+
+    OwnedArray<ChannelEncoding> channelEncodings;
+    std::unordered_map<const void*, int> encodingLookup;
+
+    MemoryBlock catalogJson[COMPACT_BINARY + 1];   // indexed by Format, so the format can change while sending
+    Atomic<int> catalogRequested;   // set to have the sending thread (re)send the catalog
 
-    // ---- utilities for formatting binary data and metadata ----
+    // ---- subscriptions ----
 
-    // a fuction to convert metadata or binary data to a form we can add to the JSON object
-    typedef var(*DataToVarFcn)(const void* value, unsigned int dataLength);
+    /** The distinct prefixes subscribed to on one socket. XPUB only reports
+        the first subscription and last unsubscription for each one. */
+    class SubscriptionSet
+    {
+    public:
+        /** Applies a message from XPUB: 1 to subscribe or 0 to unsubscribe, followed by the prefix.
+            Returns true if it was a new prefix; sets changed if the set changed at all. */
+        bool apply(const char* message, size_t size, bool& changed);
+
+        void clear();
+
+        /** Returns true if some subscriber would receive a message with this first frame */
+        bool hasSubscriber(const void* firstFrame, size_t size) const;
+
+        /** Returns true if some subscriber would receive a message whose first frame starts with this prefix */
+        bool hasSubscriberUnder(const void* prefix, size_t size) const;
+    private:
+        Array<MemoryBlock> prefixes;
+    };
+
+    // each message is the serial of the socket it arrived on, then what XPUB received;
+    // a message with only a serial means the sending thread has moved to that socket
+    EventQueue subscriptionMessages;
+    uint32 polledSocket;        // serial of the socket last polled; sending thread only
+    SubscriptionSet subscriptions;  // guarded by configLock
+    uint32 subscribedSocket;    // serial of the socket they're for; guarded by configLock
+    std::unique_ptr<SubscriptionThread> subscriptionThread;
+    Atomic<int64> numSkipped;
 
-    template <typename T>
-    static var binaryValueToVar(const void* value, unsigned int dataLength);
+    // ---- profiling ----
 
-    static var stringValueToVar(const void* value, unsigned int dataLength);
+    /** Totals for one record type and format. JSON is encoded on the sending thread,
+        the other formats on the processing thread. */
+    struct EncodingCounters
+    {
+        Atomic<int64> numEncoded;
+        Atomic<int64> ticks;
+        Atomic<int64> bytes;
+        Atomic<int64> allocations;  // from the message pool, while sending
+    };
 
-    static DataToVarFcn getDataReader(BaseType dataType);
+    /** Adds the time since startTicks and the bytes encoded to the counters */
+    void countEncoding(uint16 baseType, uint16 format, int64 startTicks, int64 numBytes, int numEvents);
+
+    /** Adds the pool allocations since allocationsBefore, made while sending a record, to the counters
+        for its type and format. Only one thread acquires buffers at a time, so they're all the record's. */
+    void countAllocations(const EventRecord& record, int64 allocationsBefore);
+
+    /** Prints the encoding costs for each record type and format, and the send latency */
+    void logEncodingStats() const;
+
+    bool profilingEnabled;
+    bool activeProfiling;       // profilingEnabled for the current acquisition
+    EncodingCounters encodingCounters[SPIKE_RECORD + 1][COMPACT_BINARY + 1];
+
+    // ---- message buffers, from EventSender's pool ----
+
+    MessagePool::Buffer* captureBuffer;     // for events and spikes on the processing thread
+    MessagePool::Buffer* continuousBuffer;  // for continuous blocks on the processing thread
+    MessagePool::Buffer* recordBuffer;      // for use on the sender thread
+    int captureBufferSize;                  // largest event or spike record, also the ring's largest payload
+    int continuousBufferSize;               // largest continuous record
+
+    // ---- batching, done by EventSender on whichever thread sends ----
+
+    bool blockNeedsFlush;       // a batch was started during this block
+    int maxBatchEvents;
+    int maxBatchMicros;
+
+    SpikeColumnMode spikeColumnMode;
+    SpikeColumnMode activeSpikeColumnMode;  // mode of the current acquisition
 
     // for setting port asynchronously
     int asyncPort;
     bool asyncForceRestart;
     bool asyncSearchForPort;
+    Atomic<int> asyncPortPending;
+
+    // set by the socket thread when it's done
+    Atomic<int> asyncSocketReplaced;
+    Atomic<int> asyncSocketStatus;
 };
 
 
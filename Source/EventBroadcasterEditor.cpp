@@ -29,7 +29,7 @@ EventBroadcasterEditor::EventBroadcasterEditor(GenericProcessor* parentNode)
     : GenericEditor(parentNode)
 
 {
-    desiredWidth = 180;
+    desiredWidth = 400;
 
     EventBroadcaster* p = (EventBroadcaster*)getProcessor();
 
@@ -48,6 +48,7 @@ EventBroadcasterEditor::EventBroadcasterEditor(GenericProcessor* parentNode)
     portLabel->setColour(Label::textColourId, Colours::white);
     portLabel->setColour(Label::backgroundColourId, Colours::grey);
     portLabel->setEditable(true);
+    portLabel->setTooltip("Port to listen on; * for any free port");
     portLabel->addListener(this);
     addAndMakeVisible(portLabel);
 
@@ -59,11 +60,76 @@ EventBroadcasterEditor::EventBroadcasterEditor(GenericProcessor* parentNode)
     formatBox->setBounds(67, 100, 100, 20);
     formatBox->addItem("JSON", EventBroadcaster::Format::JSON_STRING);
     formatBox->addItem("Raw Binary", EventBroadcaster::Format::RAW_BINARY);
+    formatBox->addItem("Compact", EventBroadcaster::Format::COMPACT_BINARY);
 
     formatBox->setSelectedId(p->getOutputFormat());
     formatBox->addListener(this);
     addAndMakeVisible(formatBox);
 
+    sendModeLabel = new Label("Send", "Send:");
+    sendModeLabel->setBounds(180, 29, 60, 25);
+    addAndMakeVisible(sendModeLabel);
+
+    sendModeBox = new ComboBox("SendModeBox");
+    sendModeBox->setBounds(180, 54, 100, 20);
+    sendModeBox->addItem("Inline", EventBroadcaster::SendMode::SEND_INLINE);
+    sendModeBox->addItem("Thread", EventBroadcaster::SendMode::SEND_THREAD);
+    sendModeBox->setTooltip("Inline sends from the processing thread; Thread queues events for a background sender");
+
+    sendModeBox->setSelectedId(p->getSendMode());
+    sendModeBox->addListener(this);
+    addAndMakeVisible(sendModeBox);
+
+    batchButton = new ToggleButton("Batch per block");
+    batchButton->setBounds(180, 82, 110, 20);
+    batchButton->setColour(ToggleButton::textColourId, Colours::black);
+    batchButton->setTooltip("Send all events and spikes from one processing block as a single message");
+    batchButton->setToggleState(p->getBatchEnabled(), dontSendNotification);
+    batchButton->addListener(this);
+    addAndMakeVisible(batchButton);
+
+    topicsButton = new ToggleButton("Topic frames");
+    topicsButton->setBounds(180, 104, 110, 20);
+    topicsButton->setColour(ToggleButton::textColourId, Colours::black);
+    topicsButton->setTooltip("Start each message with a topic such as spike/<stream>/<electrode>, so subscribers can filter per channel");
+    topicsButton->setToggleState(p->getTopicsEnabled(), dontSendNotification);
+    topicsButton->addListener(this);
+    addAndMakeVisible(topicsButton);
+
+    channelsButton = new UtilityButton("Channels", Font("Default", 15, Font::plain));
+    channelsButton->setBounds(300, 32, 90, 22);
+    channelsButton->setTooltip("Choose which streams and electrodes to broadcast");
+    channelsButton->addListener(this);
+    addAndMakeVisible(channelsButton);
+
+    linesLabel = new Label("Lines", "Lines:");
+    linesLabel->setBounds(295, 66, 50, 20);
+    addAndMakeVisible(linesLabel);
+
+    linesEditor = new Label("LinesEditor", p->getFilter().getLines());
+    linesEditor->setBounds(345, 66, 45, 20);
+    linesEditor->setFont(Font("Default", 15, Font::plain));
+    linesEditor->setColour(Label::textColourId, Colours::white);
+    linesEditor->setColour(Label::backgroundColourId, Colours::grey);
+    linesEditor->setTooltip("TTL lines to broadcast, e.g. 0-3, 8; empty for all");
+    linesEditor->setEditable(true);
+    linesEditor->addListener(this);
+    addAndMakeVisible(linesEditor);
+
+    unitsLabel = new Label("Units", "Units:");
+    unitsLabel->setBounds(295, 97, 50, 20);
+    addAndMakeVisible(unitsLabel);
+
+    unitsEditor = new Label("UnitsEditor", p->getFilter().getUnits());
+    unitsEditor->setBounds(345, 97, 45, 20);
+    unitsEditor->setFont(Font("Default", 15, Font::plain));
+    unitsEditor->setColour(Label::textColourId, Colours::white);
+    unitsEditor->setColour(Label::backgroundColourId, Colours::grey);
+    unitsEditor->setTooltip("Sorted unit IDs to broadcast, e.g. 1-4; empty for all");
+    unitsEditor->setEditable(true);
+    unitsEditor->addListener(this);
+    addAndMakeVisible(unitsEditor);
+
 }
 
 
@@ -81,6 +147,20 @@ void EventBroadcasterEditor::buttonClicked(Button* button)
         }
 #endif
     }
+    else if (button == batchButton)
+    {
+        auto p = static_cast<EventBroadcaster*>(getProcessor());
+        p->setBatchEnabled(button->getToggleState());
+    }
+    else if (button == topicsButton)
+    {
+        auto p = static_cast<EventBroadcaster*>(getProcessor());
+        p->setTopicsEnabled(button->getToggleState());
+    }
+    else if (button == channelsButton)
+    {
+        showChannelMenu();
+    }
 }
 
 
@@ -88,10 +168,19 @@ void EventBroadcasterEditor::labelTextChanged(juce::Label* label)
 {
     if (label == portLabel)
     {
-        Value val = label->getTextValue();
-
         EventBroadcaster* p = (EventBroadcaster*)getProcessor();
-        int status = p->setListeningPort(val.getValue());
+        const String text = label->getText().trim();
+
+        // "*" (or 0) lets the system pick a free port
+        if (text != "*" && (text.isEmpty() || !text.containsOnly("0123456789") || text.getLargeIntValue() > 65535))
+        {
+            CoreServices::sendStatusMessage("Invalid port: " + label->getText());
+            setDisplayedPort(p->getListeningPort());
+            return;
+        }
+
+        int port = text == "*" ? 0 : text.getIntValue();
+        int status = p->setListeningPort(port);
 
 #ifdef ZEROMQ
         if (status != 0)
@@ -100,6 +189,26 @@ void EventBroadcasterEditor::labelTextChanged(juce::Label* label)
         }
 #endif
     }
+    else if (label == linesEditor || label == unitsEditor)
+    {
+        auto p = static_cast<EventBroadcaster*>(getProcessor());
+        EventFilter filter = p->getFilter();
+
+        bool valid = label == linesEditor
+            ? filter.setLines(label->getText())
+            : filter.setUnits(label->getText());
+
+        if (valid)
+        {
+            p->setFilter(filter);
+        }
+        else
+        {
+            CoreServices::sendStatusMessage("Invalid range: " + label->getText());
+        }
+
+        setDisplayedFilter(p->getFilter());
+    }
 }
 
 
@@ -110,6 +219,11 @@ void EventBroadcasterEditor::comboBoxChanged(ComboBox* comboBoxThatHasChanged)
         auto p = static_cast<EventBroadcaster*>(getProcessor());
         p->setOutputFormat((EventBroadcaster::Format) comboBoxThatHasChanged->getSelectedId());
     }
+    else if (comboBoxThatHasChanged == sendModeBox)
+    {
+        auto p = static_cast<EventBroadcaster*>(getProcessor());
+        p->setSendMode((EventBroadcaster::SendMode) comboBoxThatHasChanged->getSelectedId());
+    }
 }
 
 
@@ -122,4 +236,103 @@ void EventBroadcasterEditor::setDisplayedPort(int port)
 void EventBroadcasterEditor::setDisplayedFormat(EventBroadcaster::Format format)
 {
     formatBox->setSelectedId((int) format, dontSendNotification);
-}
\ No newline at end of file
+}
+
+
+void EventBroadcasterEditor::setDisplayedSendMode(EventBroadcaster::SendMode mode)
+{
+    sendModeBox->setSelectedId((int) mode, dontSendNotification);
+}
+
+
+void EventBroadcasterEditor::setDisplayedBatchEnabled(bool enabled)
+{
+    batchButton->setToggleState(enabled, dontSendNotification);
+}
+
+
+void EventBroadcasterEditor::setDisplayedTopicsEnabled(bool enabled)
+{
+    topicsButton->setToggleState(enabled, dontSendNotification);
+}
+
+
+void EventBroadcasterEditor::setDisplayedFilter(const EventFilter& filter)
+{
+    linesEditor->setText(filter.getLines(), dontSendNotification);
+    unitsEditor->setText(filter.getUnits(), dontSendNotification);
+}
+
+
+void EventBroadcasterEditor::showChannelMenu()
+{
+    auto p = static_cast<EventBroadcaster*>(getProcessor());
+    const EventFilter& filter = p->getFilter();
+
+    // item IDs index into this list; an empty electrode stands for the whole stream
+    Array<std::pair<String, String>> items;
+    PopupMenu menu;
+
+    for (auto& stream : p->getStreamNames())
+    {
+        const bool streamIncluded = filter.includesStream(stream);
+
+        items.add({ stream, String() });
+        menu.addItem(items.size(), stream, true, streamIncluded);
+
+        for (auto& electrode : p->getElectrodeNames(stream))
+        {
+            items.add({ stream, electrode });
+            menu.addItem(items.size(), "    " + electrode, streamIncluded,
+                filter.includesElectrode(stream, electrode));
+        }
+    }
+
+    if (items.isEmpty())
+    {
+        menu.addItem(1, "No event or spike channels", false);
+    }
+
+    Component::SafePointer<EventBroadcasterEditor> safeThis(this);
+
+    menu.showMenuAsync(PopupMenu::Options().withTargetComponent(channelsButton),
+        [safeThis, items](int result)
+    {
+        if (safeThis == nullptr || result <= 0 || result > items.size())
+        {
+            return;
+        }
+
+        auto p = static_cast<EventBroadcaster*>(safeThis->getProcessor());
+        EventFilter filter = p->getFilter();
+
+        const auto& item = items.getReference(result - 1);
+
+        if (item.second.isEmpty())
+        {
+            filter.setStreamIncluded(item.first, !filter.includesStream(item.first));
+        }
+        else
+        {
+            filter.setElectrodeIncluded(item.first, item.second,
+                !filter.includesElectrode(item.first, item.second));
+        }
+
+        p->setFilter(filter);
+
+        // keep the menu open for choosing several channels
+        safeThis->showChannelMenu();
+    });
+}
+
+
+void EventBroadcasterEditor::startAcquisition()
+{
+    sendModeBox->setEnabled(false);
+}
+
+
+void EventBroadcasterEditor::stopAcquisition()
+{
+    sendModeBox->setEnabled(true);
+}
@@ -65,12 +65,42 @@ public:
     /** Sets the output format */
     void setDisplayedFormat(EventBroadcaster::Format format);
 
+    /** Sets the send mode */
+    void setDisplayedSendMode(EventBroadcaster::SendMode mode);
+
+    /** Sets whether events are batched per block */
+    void setDisplayedBatchEnabled(bool enabled);
+
+    /** Sets whether messages start with a topic frame */
+    void setDisplayedTopicsEnabled(bool enabled);
+
+    /** Shows the TTL line and sorted unit filters */
+    void setDisplayedFilter(const EventFilter& filter);
+
+    /** Disables settings that can't change during acquisition */
+    void startAcquisition() override;
+
+    /** Re-enables settings that can't change during acquisition */
+    void stopAcquisition() override;
+
 private:
+    /** Shows a menu for including or excluding streams and electrodes */
+    void showChannelMenu();
+
     ScopedPointer<UtilityButton> restartConnection;
     ScopedPointer<Label> urlLabel;
     ScopedPointer<Label> portLabel;
     ScopedPointer<Label> formatLabel;
     ScopedPointer<ComboBox> formatBox;
+    ScopedPointer<Label> sendModeLabel;
+    ScopedPointer<ComboBox> sendModeBox;
+    ScopedPointer<ToggleButton> batchButton;
+    ScopedPointer<ToggleButton> topicsButton;
+    ScopedPointer<UtilityButton> channelsButton;
+    ScopedPointer<Label> linesLabel;
+    ScopedPointer<Label> linesEditor;
+    ScopedPointer<Label> unitsLabel;
+    ScopedPointer<Label> unitsEditor;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EventBroadcasterEditor);
 
@@ -0,0 +1,547 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "EventEncoder.h"
+#include "SpikeFeatures.h"
+#include "WaveformQuantizer.h"
+
+#define SPIKE_BASE_SIZE 26
+#define EVENT_BASE_SIZE 24
+
+EventEncoder::EventEncoder()
+    : compactSequence   (0)
+    , stampCaptures     (false)
+    , columnarSpikes    (false)
+{ }
+
+EventEncoder::ChannelEncoding* EventEncoder::createEncoding(const EventChannel* channel, uint16 index)
+{
+    auto encoding = new ChannelEncoding();
+    encoding->index = index;
+    encoding->baseType = TTL_RECORD;
+    encoding->eventChannel = channel;
+    encoding->spikeChannel = nullptr;
+    encoding->numChannels = 0;
+    encoding->prePeakSamples = 0;
+    encoding->totalSamples = 0;
+    encoding->waveformScale = 1.0f;
+    encoding->rawSize = EVENT_BASE_SIZE
+        + channel->getDataSize()
+        + channel->getTotalEventMetadataSize();
+    encoding->compactSize = COMPACT_TTL_SIZE;
+    buildMetadataEncoders(channel, *encoding);
+
+    // everything up to "sample_number"
+    MemoryOutputStream prefix(encoding->jsonPrefix, false);
+    JsonWriter json(prefix);
+    json.beginObject();
+    json.key("event_type");     json.value("ttl", 3);
+    json.key("stream");         json.value(channel->getStreamName());
+    json.key("source_node");    json.value((int) channel->getNodeId());
+    json.key("sample_rate");    json.value(channel->getSampleRate());
+    json.key("channel_name");   json.value(channel->getName());
+    prefix.flush();
+
+    // the line number is added for each event
+    String topic = "ttl/" + channel->getStreamName().replaceCharacter('/', '_') + "/";
+    encoding->topic.replaceWith(topic.toRawUTF8(), jmin(topic.getNumBytesAsUTF8(), (size_t) MAX_TOPIC_SIZE - 4));
+
+    return encoding;
+}
+
+EventEncoder::ChannelEncoding* EventEncoder::createEncoding(const SpikeChannel* channel, uint16 index)
+{
+    auto encoding = new ChannelEncoding();
+    encoding->index = index;
+    encoding->baseType = SPIKE_RECORD;
+    encoding->eventChannel = nullptr;
+    encoding->spikeChannel = channel;
+    encoding->numChannels = (int) channel->getNumChannels();
+    encoding->prePeakSamples = (int) channel->getPrePeakSamples();
+    encoding->totalSamples = (int) (channel->getPrePeakSamples() + channel->getPostPeakSamples());
+
+    // int16 steps no finer than the data the electrode was recorded at
+    encoding->waveformScale = 0;
+    for (auto source : channel->getSourceChannels())
+    {
+        encoding->waveformScale = jmax(encoding->waveformScale, source->getBitVolts());
+    }
+    if (encoding->waveformScale <= 0)
+    {
+        encoding->waveformScale = 0.195f; // Intan headstages
+    }
+    encoding->rawSize = SPIKE_BASE_SIZE
+        + channel->getDataSize()
+        + channel->getTotalEventMetadataSize()
+        + channel->getNumChannels() * sizeof(float);
+    encoding->compactSize = COMPACT_WAVEFORM_OFFSET
+        + (size_t) encoding->numChannels * encoding->totalSamples * sizeof(float)
+        + (size_t) encoding->numChannels * sizeof(uint16); // bound for a trimmed spike's channel list
+    buildMetadataEncoders(channel, *encoding);
+
+    // everything up to "sample_number"
+    MemoryOutputStream prefix(encoding->jsonPrefix, false);
+    JsonWriter json(prefix);
+    json.beginObject();
+    json.key("event_type");     json.value("spike", 5);
+    json.key("stream");         json.value(channel->getStreamName());
+    json.key("source_node");    json.value((int) channel->getNodeId());
+    json.key("electrode");      json.value(channel->getName());
+    json.key("num_channels");   json.value(encoding->numChannels);
+    json.key("sample_rate");    json.value(channel->getSampleRate());
+    prefix.flush();
+
+    String topic = "spike/" + channel->getStreamName().replaceCharacter('/', '_')
+        + "/" + channel->getName().replaceCharacter('/', '_');
+    encoding->topic.replaceWith(topic.toRawUTF8(), jmin(topic.getNumBytesAsUTF8(), (size_t) MAX_TOPIC_SIZE));
+
+    return encoding;
+}
+
+void EventEncoder::resetEncoding(bool timeCaptures, bool spikeColumns)
+{
+    compactSequence = 0;
+    stampCaptures = timeCaptures;
+    columnarSpikes = spikeColumns;
+}
+
+int EventEncoder::captureEvent(const TTLEvent& event, const ChannelEncoding& encoding, const Settings& settings, char* dest, int destSize)
+{
+    EventRecord record = {};
+    record.baseType = TTL_RECORD;
+    record.format = (uint16) settings.format;
+    record.batched = settings.batchEnabled;
+    record.withTopic = settings.topicsEnabled;
+    record.captureTicks = stampCaptures ? Time::getHighResolutionTicks() : 0;
+    record.channelIndex = encoding.index;
+    record.sampleNumber = event.getSampleNumber();
+    record.line = event.getLine();
+    record.state = event.getState();
+
+    char* payload = dest + sizeof(EventRecord);
+
+    if (settings.format == RAW_BINARY) // serialize the event
+    {
+        record.payloadSize = (uint32) encoding.rawSize;
+
+        if (sizeof(EventRecord) + record.payloadSize > (size_t) destSize)
+        {
+            return 0;
+        }
+
+        event.serialize(payload, record.payloadSize);
+    }
+    else if (settings.format == COMPACT_BINARY)
+    {
+        record.payloadSize = (uint32) encoding.compactSize;
+
+        if (sizeof(EventRecord) + record.payloadSize > (size_t) destSize)
+        {
+            return 0;
+        }
+
+        writeCompactHeader(record, payload);
+
+        CompactTtl ttl = {};
+        ttl.line = (uint32) record.line;
+        ttl.state = record.state ? 1 : 0;
+        memcpy(payload + sizeof(CompactHeader), &ttl, sizeof(ttl));
+    }
+    else // keep only the metadata
+    {
+        record.payloadSize = (uint32) encoding.metadataSize;
+
+        if (sizeof(EventRecord) + record.payloadSize > (size_t) destSize)
+        {
+            return 0;
+        }
+
+        captureMetadata(event, encoding, payload);
+    }
+
+    memcpy(dest, &record, sizeof(EventRecord));
+    return (int) (sizeof(EventRecord) + record.payloadSize);
+}
+
+int EventEncoder::captureSpike(const Spike& spike, const ChannelEncoding& encoding, const Settings& settings, char* dest, int destSize)
+{
+    EventRecord record = {};
+    record.baseType = SPIKE_RECORD;
+    record.format = (uint16) settings.format;
+    record.batched = settings.batchEnabled;
+    record.withTopic = settings.topicsEnabled;
+    record.captureTicks = stampCaptures ? Time::getHighResolutionTicks() : 0;
+    record.channelIndex = encoding.index;
+    record.sampleNumber = spike.getSampleNumber();
+    record.sortedId = spike.getSortedId();
+    record.numChannels = (uint16) encoding.numChannels;
+
+    // on large electrodes, only the channels around the deepest trough
+    const uint16* channels = nullptr;
+    const Array<uint16>& neighbourhoods = settings.neighbourhoods.getReference(encoding.index);
+
+    if (settings.format != RAW_BINARY && !neighbourhoods.isEmpty())
+    {
+        const int peakChannel = SpikeFeatures::findPeakChannel(spike, encoding.numChannels, encoding.totalSamples);
+        channels = neighbourhoods.begin() + peakChannel * settings.neighbourChannels;
+        record.numChannels = (uint16) settings.neighbourChannels;
+    }
+
+    const int numChannels = record.numChannels;
+
+    char* payload = dest + sizeof(EventRecord);
+
+    if (settings.format == RAW_BINARY) // serialize the spike
+    {
+        record.payloadSize = (uint32) encoding.rawSize;
+
+        if (sizeof(EventRecord) + record.payloadSize > (size_t) destSize)
+        {
+            return 0;
+        }
+
+        spike.serialize(payload, record.payloadSize);
+    }
+    else if (settings.format == COMPACT_BINARY) // index and waveform only
+    {
+        record.columnar = record.batched && columnarSpikes;
+
+        CompactSpike body = {};
+        body.sortedId = (uint16) record.sortedId;
+        body.numChannels = (uint16) numChannels;
+        body.numSamples = (uint32) encoding.totalSamples;
+        body.sampleFormat = settings.quantizeWaveforms ? COMPACT_SAMPLES_INT16 : COMPACT_SAMPLES_FLOAT32;
+        body.channelSubset = channels != nullptr ? 1 : 0;
+        body.scale = settings.quantizeWaveforms ? encoding.waveformScale : 1.0f;
+
+        const size_t waveformSize = (size_t) numChannels * encoding.totalSamples * getCompactSampleSize(body.sampleFormat);
+        record.payloadSize = (uint32) (COMPACT_WAVEFORM_OFFSET + waveformSize
+            + (channels != nullptr ? numChannels * sizeof(uint16) : 0));
+
+        if (sizeof(EventRecord) + record.payloadSize > (size_t) destSize)
+        {
+            return 0;
+        }
+
+        writeCompactHeader(record, payload);
+        memcpy(payload + sizeof(CompactHeader), &body, sizeof(body));
+
+        if (settings.quantizeWaveforms)
+        {
+            int16* waveform = reinterpret_cast<int16*>(payload + COMPACT_WAVEFORM_OFFSET);
+            for (int i = 0; i < numChannels; i++)
+            {
+                const int ch = channels != nullptr ? channels[i] : i;
+                WaveformQuantizer::quantize(spike.getDataPointer(ch), waveform + i * encoding.totalSamples,
+                    encoding.totalSamples, encoding.waveformScale);
+            }
+        }
+        else
+        {
+            float* waveform = reinterpret_cast<float*>(payload + COMPACT_WAVEFORM_OFFSET);
+            for (int i = 0; i < numChannels; i++)
+            {
+                const int ch = channels != nullptr ? channels[i] : i;
+                memcpy(waveform + i * encoding.totalSamples, spike.getDataPointer(ch),
+                    encoding.totalSamples * sizeof(float));
+            }
+        }
+
+        if (channels != nullptr)
+        {
+            memcpy(payload + COMPACT_WAVEFORM_OFFSET + waveformSize, channels, numChannels * sizeof(uint16));
+        }
+    }
+    else // keep only the amplitudes (and which channels, if trimmed) and metadata
+    {
+        const size_t amplitudesSize = (2 + numChannels) * sizeof(float);
+        const size_t channelsSize = channels != nullptr ? numChannels * sizeof(uint16) : 0;
+        record.payloadSize = (uint32) (amplitudesSize + channelsSize + encoding.metadataSize);
+
+        if (sizeof(EventRecord) + record.payloadSize > (size_t) destSize)
+        {
+            return 0;
+        }
+
+        // the spike's trough and peak, then the peak-to-trough amplitude of each channel
+        float* amplitudes = reinterpret_cast<float*>(payload);
+        float trough = 0, peak = 0;
+
+        for (int i = 0; i < numChannels; i++)
+        {
+            const float* data = spike.getDataPointer(channels != nullptr ? channels[i] : i);
+
+            float minimum, maximum;
+            SpikeFeatures::findExtremes(data, encoding.totalSamples, minimum, maximum);
+
+            amplitudes[2 + i] = maximum - minimum;
+            trough = i == 0 ? minimum : jmin(trough, minimum);
+            peak = i == 0 ? maximum : jmax(peak, maximum);
+        }
+
+        amplitudes[0] = trough;
+        amplitudes[1] = peak;
+
+        if (channels != nullptr)
+        {
+            memcpy(payload + amplitudesSize, channels, channelsSize);
+        }
+
+        captureMetadata(spike, encoding, payload + amplitudesSize + channelsSize);
+    }
+
+    memcpy(dest, &record, sizeof(EventRecord));
+    return (int) (sizeof(EventRecord) + record.payloadSize);
+}
+
+void EventEncoder::writeCompactHeader(const EventRecord& record, char* dest)
+{
+    CompactHeader header = {};
+    header.magic = COMPACT_MAGIC;
+    header.version = COMPACT_VERSION;
+    header.type = (uint8) record.baseType;
+    header.channelIndex = record.channelIndex;
+    header.sequence = compactSequence++;
+    header.sampleNumber = record.sampleNumber;
+
+    memcpy(dest, &header, sizeof(header));
+}
+
+void EventEncoder::writeJSON(const ChannelEncoding& encoding, const EventRecord& record, const char* payload, OutputStream& dest)
+{
+    // the fields that don't change between events were encoded in createEncoding()
+    JsonWriter json(dest);
+    json.resumeObject(encoding.jsonPrefix.getData(), encoding.jsonPrefix.getSize());
+
+    if (record.baseType == TTL_RECORD)
+    {
+        json.key("sample_number");  json.value(record.sampleNumber);
+        json.key("line");           json.value(record.line);
+        json.key("state");          json.value(record.state);
+
+        writeMetadata(encoding, payload, json);
+    }
+    else
+    {
+        json.key("sample_number");  json.value(record.sampleNumber);
+        json.key("sorted_id");      json.value(record.sortedId);
+
+        // amplitudes were captured on the processing thread, followed by
+        // the channel numbers if the spike was trimmed to a neighbourhood
+        const int numChannels = record.numChannels;
+        const size_t amplitudesSize = (2 + numChannels) * sizeof(float);
+        const float* amplitudes = reinterpret_cast<const float*>(payload);
+        const uint16* channels = numChannels < encoding.numChannels
+            ? reinterpret_cast<const uint16*>(payload + amplitudesSize)
+            : nullptr;
+
+        json.key("trough");         json.value(amplitudes[0]);
+        json.key("peak");           json.value(amplitudes[1]);
+
+        for (int i = 0; i < numChannels; i++)
+        {
+            json.key("amp", (channels != nullptr ? channels[i] : i) + 1);
+            json.value(amplitudes[2 + i]);
+        }
+
+        const size_t channelsSize = channels != nullptr ? numChannels * sizeof(uint16) : 0;
+        writeMetadata(encoding, payload + amplitudesSize + channelsSize, json);
+    }
+
+    json.endObject();
+}
+
+void EventEncoder::buildMetadataEncoders(const MetadataEventObject* channel, ChannelEncoding& encoding)
+{
+    encoding.metadata.clear();
+    encoding.metadataSize = 0;
+
+    for (int i = 0; i < (int) channel->getEventMetadataCount(); i++)
+    {
+        const MetadataDescriptor* descriptor = channel->getEventMetadataDescriptor(i);
+
+        MetadataEncoder field;
+        field.offset = encoding.metadataSize;
+        field.size = descriptor->getDataSize();
+        field.length = descriptor->getLength();
+        field.write = getDataReader(descriptor->getType());
+
+        MemoryOutputStream key(field.key, false);
+        JsonWriter::writeString(key, descriptor->getName().toRawUTF8(), descriptor->getName().getNumBytesAsUTF8());
+        key.write(":", 1);
+        key.flush();
+
+        encoding.metadata.add(field);
+        encoding.metadataSize += field.size;
+    }
+}
+
+Array<uint16> EventEncoder::buildNeighbourhoods(int numChannels, int numNeighbours)
+{
+    jassert(numNeighbours > 0 && numNeighbours <= numChannels);
+
+    // the plugin API doesn't give electrode geometry, so channels are taken to be
+    // laid out in order along the shank: the nearest ones are a window around the
+    // peak channel, shifted inwards at either end
+    Array<uint16> neighbourhoods;
+    neighbourhoods.ensureStorageAllocated(numChannels * numNeighbours);
+
+    for (int peakChannel = 0; peakChannel < numChannels; peakChannel++)
+    {
+        const int first = jlimit(0, numChannels - numNeighbours, peakChannel - (numNeighbours - 1) / 2);
+
+        for (int ch = first; ch < first + numNeighbours; ch++)
+        {
+            neighbourhoods.add((uint16) ch);
+        }
+    }
+
+    return neighbourhoods;
+}
+
+void EventEncoder::captureMetadata(const EventBase& event, const ChannelEncoding& encoding, char* dest)
+{
+    const int numValues = jmin((int) event.getMetadataValueCount(), encoding.metadata.size());
+
+    for (int i = 0; i < numValues; i++)
+    {
+        const MetadataEncoder& field = encoding.metadata.getReference(i);
+        memcpy(dest + field.offset, event.getMetadataValue(i)->getRawValuePointer(), field.size);
+    }
+
+    // values the event doesn't have are sent as zeros, not whatever the buffer held before
+    if (numValues < encoding.metadata.size())
+    {
+        const size_t offset = encoding.metadata.getReference(numValues).offset;
+        memset(dest + offset, 0, encoding.metadataSize - offset);
+    }
+}
+
+void EventEncoder::writeMetadata(const ChannelEncoding& encoding, const char* metadata, JsonWriter& json)
+{
+    if (encoding.metadata.isEmpty())
+    {
+        return;
+    }
+
+    json.key("metadata");
+    json.beginObject();
+    for (auto& field : encoding.metadata)
+    {
+        json.rawKey(field.key.getData(), field.key.getSize());
+        field.write(json, metadata + field.offset, field.length);
+    }
+    json.endObject();
+}
+
+template <typename T, typename JsonType>
+void EventEncoder::writeNumberValues(JsonWriter& json, const void* value, unsigned int length)
+{
+    // captured values aren't necessarily aligned
+    const char* bytes = static_cast<const char*>(value);
+    T number;
+
+    if (length == 1)
+    {
+        memcpy(&number, bytes, sizeof(T));
+        json.value((JsonType) number);
+        return;
+    }
+
+    json.beginArray();
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        memcpy(&number, bytes + i * sizeof(T), sizeof(T));
+        json.value((JsonType) number);
+    }
+    json.endArray();
+}
+
+void EventEncoder::writeStringValue(JsonWriter& json, const void* value, unsigned int length)
+{
+    // fixed-length field; the text may end early
+    const char* text = static_cast<const char*>(value);
+    const void* end = memchr(text, 0, length);
+
+    json.value(text, end != nullptr ? (size_t) (static_cast<const char*>(end) - text) : length);
+}
+
+EventEncoder::MetadataWriterFcn EventEncoder::getDataReader(BaseType dataType)
+{
+    switch (dataType)
+    {
+    case BaseType::CHAR:
+        return &writeStringValue;
+
+    case BaseType::INT8:
+        return &writeNumberValues<int8, int>;
+
+    case BaseType::UINT8:
+        return &writeNumberValues<uint8, int>;
+
+    case BaseType::INT16:
+        return &writeNumberValues<int16, int>;
+
+    case BaseType::UINT16:
+        return &writeNumberValues<uint16, int>;
+
+    case BaseType::INT32:
+        return &writeNumberValues<int32, int>;
+
+    case BaseType::UINT32:
+        return &writeNumberValues<uint32, int64>;
+
+    case BaseType::INT64:
+        return &writeNumberValues<int64, int64>;
+
+    case BaseType::UINT64:
+        return &writeNumberValues<uint64, uint64>;
+
+    case BaseType::FLOAT:
+        return &writeNumberValues<float, float>;
+
+    case BaseType::DOUBLE:
+        return &writeNumberValues<double, double>;
+    }
+    jassertfalse;
+    return nullptr;
+}
+
+const char* EventEncoder::getTypeName(BaseType dataType)
+{
+    switch (dataType)
+    {
+    case BaseType::CHAR:    return "char";
+    case BaseType::INT8:    return "int8";
+    case BaseType::UINT8:   return "uint8";
+    case BaseType::INT16:   return "int16";
+    case BaseType::UINT16:  return "uint16";
+    case BaseType::INT32:   return "int32";
+    case BaseType::UINT32:  return "uint32";
+    case BaseType::INT64:   return "int64";
+    case BaseType::UINT64:  return "uint64";
+    case BaseType::FLOAT:   return "float32";
+    case BaseType::DOUBLE:  return "float64";
+    }
+    return "unknown";
+}
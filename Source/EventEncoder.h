@@ -0,0 +1,180 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef EVENTENCODER_H_INCLUDED
+#define EVENTENCODER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "CompactFormat.h"
+#include "JsonWriter.h"
+
+/**
+
+ Captures TTL events and spikes into records and encodes them in each of the
+ output formats, without sending anything.
+
+ Everything about a channel that doesn't change between events is worked out
+ once, as a ChannelEncoding. Capturing an event copies what its message needs
+ into a fixed-size EventRecord and a payload: the finished Raw Binary or
+ Compact message, or the values that go into its JSON, which is written later
+ by writeJSON() on the sending thread. Nothing is allocated while capturing or
+ writing JSON into a pooled stream.
+
+ Only one thread may capture at a time.
+
+ */
+
+class EventEncoder
+{
+public:
+    /** ids for format combobox */
+    enum Format { RAW_BINARY = 1, JSON_STRING = 2, COMPACT_BINARY = 3 };
+
+    /** Types of captured records */
+    enum RecordType { TTL_RECORD = 0, SPIKE_RECORD = 1, CONTINUOUS_RECORD = 2, BLOCK_END_RECORD = 0xFFFF };
+
+    /** Longest topic frame, including a TTL line number */
+    static const int MAX_TOPIC_SIZE = 256;
+
+    /** Writes a metadata value (one or more numbers, or a string) as JSON */
+    typedef void(*MetadataWriterFcn)(JsonWriter& json, const void* value, unsigned int length);
+
+    /** How one metadata field of a channel is written, chosen once in createEncoding() */
+    struct MetadataEncoder
+    {
+        MemoryBlock key;            // quoted and escaped name, followed by a colon
+        size_t offset;              // position in the captured metadata
+        size_t size;                // in bytes
+        unsigned int length;        // number of values
+        MetadataWriterFcn write;
+    };
+
+    /** Everything about an event or spike channel that doesn't change between
+        events, worked out once in createEncoding() rather than for every event */
+    struct ChannelEncoding
+    {
+        uint16 index;           // position in the list of encodings, and in the catalog
+        uint16 baseType;        // TTL_RECORD or SPIKE_RECORD
+        const EventChannel* eventChannel;
+        const SpikeChannel* spikeChannel;
+        int numChannels;        // electrode channels, for spikes
+        int prePeakSamples;
+        int totalSamples;       // per electrode channel
+        float waveformScale;    // step of int16 waveforms: the coarsest resolution of the electrode's channels
+        size_t rawSize;         // size of the serialized event or spike
+        size_t compactSize;     // size of the compact event or spike
+        MemoryBlock jsonPrefix; // start of the JSON object, up to the first field that varies
+        MemoryBlock topic;      // topic frame; TTL topics are completed with the line number
+        Array<MetadataEncoder> metadata;
+        size_t metadataSize;    // bytes of metadata captured for JSON
+    };
+
+    /** The settings that decide how an event or spike is captured */
+    struct Settings
+    {
+        Format format;
+        bool batchEnabled;
+        bool topicsEnabled;
+        bool quantizeWaveforms;
+        int neighbourChannels;  // 0 to send all electrode channels
+        Array<Array<uint16>> neighbourhoods; // per ChannelEncoding, see buildNeighbourhoods(); empty to send all
+    };
+
+    /** Fixed-size part of a captured event or spike, followed by payloadSize bytes.
+        Only holds what is needed to build the message later on another thread. */
+    struct EventRecord
+    {
+        uint16 baseType;        // one of RecordType
+        uint16 format;          // output format the payload was captured for
+        uint32 payloadSize;
+        uint16 channelIndex;    // ChannelEncoding::index
+        bool state;
+        bool batched;           // add to the current batch rather than sending on its own
+        int32 line;
+        int64 sampleNumber;
+        int32 sortedId;
+        uint16 numChannels;     // electrode channels in a spike's payload
+        bool withTopic;         // start the message with a topic frame
+        bool columnar;          // add to the spike columns rather than the batch
+        int64 captureTicks;     // when it reached the handler, if profiling
+    };
+
+    /** Constructor */
+    EventEncoder();
+
+    /** Works out the encoding of a TTL channel */
+    static ChannelEncoding* createEncoding(const EventChannel* channel, uint16 index);
+
+    /** Works out the encoding of a spike channel */
+    static ChannelEncoding* createEncoding(const SpikeChannel* channel, uint16 index);
+
+    /** Lists, for each channel of an electrode, the numNeighbours channels nearest to it in
+        ascending order, one list after another; spikes peaking on that channel send these */
+    static Array<uint16> buildNeighbourhoods(int numChannels, int numNeighbours);
+
+    /** Numbers Compact messages from 0 again, for a new acquisition. With timeCaptures set, records
+        say when they were captured; with spikeColumns set, batched Compact spikes are marked columnar. */
+    void resetEncoding(bool timeCaptures, bool spikeColumns);
+
+    /** Copies the fields of an event needed to send it into dest; returns the number of bytes used, or 0 if it doesn't fit */
+    int captureEvent(const TTLEvent& event, const ChannelEncoding& encoding, const Settings& settings, char* dest, int destSize);
+
+    /** Copies the fields of a spike needed to send it into dest; returns the number of bytes used, or 0 if it doesn't fit */
+    int captureSpike(const Spike& spike, const ChannelEncoding& encoding, const Settings& settings, char* dest, int destSize);
+
+    /** Writes a captured event or spike as a JSON object */
+    static void writeJSON(const ChannelEncoding& encoding, const EventRecord& record, const char* payload, OutputStream& dest);
+
+    /** Returns the name of a metadata type, as used in the catalog */
+    static const char* getTypeName(BaseType dataType);
+
+private:
+    /** Fills in the CompactHeader at the start of a Compact payload, except for the send time */
+    void writeCompactHeader(const EventRecord& record, char* dest);
+
+    /** Copies the metadata values of an event or spike into dest, laid out as in ChannelEncoding::metadata;
+        fields the event has no value for are zeroed */
+    static void captureMetadata(const EventBase& event, const ChannelEncoding& encoding, char* dest);
+
+    /** Writes captured metadata as a "metadata" object, if the channel has any */
+    static void writeMetadata(const ChannelEncoding& encoding, const char* metadata, JsonWriter& json);
+
+    /** Works out ChannelEncoding::metadata for a channel */
+    static void buildMetadataEncoders(const MetadataEventObject* channel, ChannelEncoding& encoding);
+
+    // write metadata values straight to JSON; numbers are written as JsonType
+    template <typename T, typename JsonType>
+    static void writeNumberValues(JsonWriter& json, const void* value, unsigned int length);
+
+    static void writeStringValue(JsonWriter& json, const void* value, unsigned int length);
+
+    static MetadataWriterFcn getDataReader(BaseType dataType);
+
+    uint64 compactSequence;     // next CompactHeader::sequence
+    bool stampCaptures;         // set EventRecord::captureTicks
+    bool columnarSpikes;        // mark batched Compact spikes for the spike columns
+};
+
+
+#endif  // EVENTENCODER_H_INCLUDED
@@ -0,0 +1,197 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "EventFilter.h"
+
+EventFilter::EventFilter()
+    : allLines      (true)
+    , allUnits      (true)
+{}
+
+bool EventFilter::includesStream(const String& stream) const
+{
+    return !excludedStreams.contains(stream);
+}
+
+void EventFilter::setStreamIncluded(const String& stream, bool included)
+{
+    if (included)
+    {
+        excludedStreams.removeString(stream);
+    }
+    else
+    {
+        excludedStreams.addIfNotAlreadyThere(stream);
+    }
+}
+
+bool EventFilter::includesElectrode(const String& stream, const String& electrode) const
+{
+    return !excludedElectrodes.contains(getElectrodeKey(stream, electrode));
+}
+
+void EventFilter::setElectrodeIncluded(const String& stream, const String& electrode, bool included)
+{
+    const String key = getElectrodeKey(stream, electrode);
+
+    if (included)
+    {
+        excludedElectrodes.removeString(key);
+    }
+    else
+    {
+        excludedElectrodes.addIfNotAlreadyThere(key);
+    }
+}
+
+bool EventFilter::includesChannel(const String& stream, const String& electrode) const
+{
+    if (!includesStream(stream))
+    {
+        return false;
+    }
+
+    return electrode.isEmpty() || includesElectrode(stream, electrode);
+}
+
+bool EventFilter::setLines(const String& ranges)
+{
+    BigInteger bits;
+    if (!parseRanges(ranges, bits))
+    {
+        return false;
+    }
+
+    lineText = ranges.trim();
+    lineMask = bits;
+    allLines = lineText.isEmpty();
+    return true;
+}
+
+bool EventFilter::setUnits(const String& ranges)
+{
+    BigInteger bits;
+    if (!parseRanges(ranges, bits))
+    {
+        return false;
+    }
+
+    unitText = ranges.trim();
+    unitMask = bits;
+    allUnits = unitText.isEmpty();
+    return true;
+}
+
+void EventFilter::saveToXml(XmlElement* parentElement) const
+{
+    XmlElement* filterNode = parentElement->createNewChildElement("FILTER");
+    filterNode->setAttribute("lines", lineText);
+    filterNode->setAttribute("units", unitText);
+
+    for (auto& stream : excludedStreams)
+    {
+        filterNode->createNewChildElement("EXCLUDE_STREAM")->setAttribute("name", stream);
+    }
+
+    for (auto& electrode : excludedElectrodes)
+    {
+        filterNode->createNewChildElement("EXCLUDE_ELECTRODE")->setAttribute("name", electrode);
+    }
+}
+
+void EventFilter::loadFromXml(const XmlElement* parentElement)
+{
+    const XmlElement* filterNode = parentElement->getChildByName("FILTER");
+
+    if (filterNode == nullptr)
+    {
+        return;
+    }
+
+    excludedStreams.clear();
+    excludedElectrodes.clear();
+
+    if (!setLines(filterNode->getStringAttribute("lines")))
+    {
+        std::cout << "Ignoring invalid TTL line filter" << std::endl;
+    }
+
+    if (!setUnits(filterNode->getStringAttribute("units")))
+    {
+        std::cout << "Ignoring invalid sorted unit filter" << std::endl;
+    }
+
+    forEachXmlChildElement(*filterNode, node)
+    {
+        if (node->hasTagName("EXCLUDE_STREAM"))
+        {
+            excludedStreams.addIfNotAlreadyThere(node->getStringAttribute("name"));
+        }
+        else if (node->hasTagName("EXCLUDE_ELECTRODE"))
+        {
+            excludedElectrodes.addIfNotAlreadyThere(node->getStringAttribute("name"));
+        }
+    }
+}
+
+bool EventFilter::parseRanges(const String& ranges, BigInteger& bits)
+{
+    // keeps the bitmaps a reasonable size; sorted IDs are 16 bits
+    static const int maxValue = 65535;
+
+    bits.clear();
+
+    StringArray items;
+    items.addTokens(ranges, ",", "");
+    items.trim();
+    items.removeEmptyStrings();
+
+    for (auto& item : items)
+    {
+        String first = item.upToFirstOccurrenceOf("-", false, false).trim();
+        String last = item.contains("-") ? item.fromFirstOccurrenceOf("-", false, false).trim() : first;
+
+        if (!first.containsOnly("0123456789") || !last.containsOnly("0123456789")
+            || first.isEmpty() || last.isEmpty() || first.length() > 5 || last.length() > 5)
+        {
+            return false;
+        }
+
+        const int start = first.getIntValue();
+        const int end = last.getIntValue();
+
+        if (start > end || end > maxValue)
+        {
+            return false;
+        }
+
+        bits.setRange(start, end - start + 1, true);
+    }
+
+    return true;
+}
+
+String EventFilter::getElectrodeKey(const String& stream, const String& electrode)
+{
+    return stream + "/" + electrode;
+}
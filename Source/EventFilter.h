@@ -0,0 +1,105 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef EVENTFILTER_H_INCLUDED
+#define EVENTFILTER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Selects which events and spikes get broadcast.
+
+ Streams and electrodes are excluded by name, so that channels added later
+ are broadcast by default. TTL lines and sorted units are included by
+ ranges such as "0-3, 8"; an empty range includes everything. The ranges are
+ turned into bitmaps when they are set, so that checking an event is a
+ single bit lookup.
+
+ */
+
+class EventFilter
+{
+public:
+    /** Constructor; includes everything */
+    EventFilter();
+
+    /** Returns true if events and spikes from this stream are broadcast */
+    bool includesStream(const String& stream) const;
+
+    /** Includes or excludes a stream */
+    void setStreamIncluded(const String& stream, bool included);
+
+    /** Returns true if spikes from this electrode are broadcast (ignoring its stream) */
+    bool includesElectrode(const String& stream, const String& electrode) const;
+
+    /** Includes or excludes an electrode */
+    void setElectrodeIncluded(const String& stream, const String& electrode, bool included);
+
+    /** Returns true if a channel is broadcast; pass an empty electrode for event channels */
+    bool includesChannel(const String& stream, const String& electrode) const;
+
+    /** Returns the included TTL lines as entered, or an empty string for all */
+    const String& getLines() const      { return lineText; }
+
+    /** Sets the included TTL lines. Returns false, leaving them unchanged, if the text isn't valid. */
+    bool setLines(const String& ranges);
+
+    /** Returns the included sorted unit IDs as entered, or an empty string for all */
+    const String& getUnits() const      { return unitText; }
+
+    /** Sets the included sorted unit IDs. Returns false, leaving them unchanged, if the text isn't valid. */
+    bool setUnits(const String& ranges);
+
+    /** Returns true if events on this TTL line are broadcast */
+    bool includesLine(int line) const       { return allLines || lineMask[line]; }
+
+    /** Returns true if spikes with this sorted unit ID are broadcast */
+    bool includesUnit(int sortedId) const   { return allUnits || unitMask[sortedId]; }
+
+    /** Adds the filter as a child of the given element */
+    void saveToXml(XmlElement* parentElement) const;
+
+    /** Loads the filter from a child of the given element, if there is one */
+    void loadFromXml(const XmlElement* parentElement);
+
+    /** Parses a list of numbers and ranges such as "0-3, 8" into a bitmap. Returns false if the text isn't valid. */
+    static bool parseRanges(const String& ranges, BigInteger& bits);
+
+private:
+    static String getElectrodeKey(const String& stream, const String& electrode);
+
+    StringArray excludedStreams;
+    StringArray excludedElectrodes;     // "stream/electrode"
+
+    String lineText;
+    BigInteger lineMask;
+    bool allLines;
+
+    String unitText;
+    BigInteger unitMask;
+    bool allUnits;
+};
+
+
+#endif  // EVENTFILTER_H_INCLUDED
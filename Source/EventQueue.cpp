@@ -0,0 +1,156 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "EventQueue.h"
+
+// AbstractFifo always keeps one slot empty to tell "full" from "empty"
+EventQueue::EventQueue(int capacityBytes)
+    : fifo          (capacityBytes + 1)
+    , buffer        (capacityBytes + 1)
+    , bufferSize    (capacityBytes + 1)
+    , numRecords    (0)
+    , peakBytes     (0)
+    , numDropped    (0)
+    , numPushed     (0)
+{}
+
+bool EventQueue::push(const void* data, int numBytes)
+{
+    const uint32 recordSize = (uint32) numBytes;
+    const int totalSize = numBytes + (int) sizeof(recordSize);
+
+    if (fifo.getFreeSpace() < totalSize)
+    {
+        ++numDropped;
+        return false;
+    }
+
+    // reserve the whole record at once so the consumer never sees a partial one
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(totalSize, start1, size1, start2, size2);
+    jassert(size1 + size2 == totalSize);
+
+    writeAt(start1, &recordSize, sizeof(recordSize));
+    writeAt((start1 + (int) sizeof(recordSize)) % bufferSize, data, numBytes);
+
+    // count the record before publishing it, otherwise a consumer that pops
+    // it straight away would decrement numRecords below zero
+    ++numRecords;
+    ++numPushed;
+
+    fifo.finishedWrite(totalSize);
+
+    const int queued = fifo.getNumReady();
+    if (queued > peakBytes.get())
+    {
+        peakBytes = queued;
+    }
+
+    return true;
+}
+
+int EventQueue::pop(void* dest, int maxBytes)
+{
+    uint32 recordSize;
+
+    if (fifo.getNumReady() < (int) sizeof(recordSize))
+    {
+        return 0;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(sizeof(recordSize), start1, size1, start2, size2);
+
+    readAt(start1, &recordSize, sizeof(recordSize));
+
+    // the producer never pushes records larger than the consumer's buffer
+    jassert((int) recordSize <= maxBytes);
+    readAt((start1 + (int) sizeof(recordSize)) % bufferSize, dest, jmin((int) recordSize, maxBytes));
+
+    fifo.finishedRead((int) (recordSize + sizeof(recordSize)));
+    --numRecords;
+
+    return (int) recordSize;
+}
+
+int EventQueue::getNextSize() const
+{
+    uint32 recordSize;
+
+    if (fifo.getNumReady() < (int) sizeof(recordSize))
+    {
+        return 0;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(sizeof(recordSize), start1, size1, start2, size2);
+
+    readAt(start1, &recordSize, sizeof(recordSize));
+    return (int) recordSize;
+}
+
+int EventQueue::getNumRecords() const
+{
+    return numRecords.get();
+}
+
+int EventQueue::getNumBytes() const
+{
+    return fifo.getNumReady();
+}
+
+int EventQueue::getCapacity() const
+{
+    return bufferSize - 1;
+}
+
+int EventQueue::getPeakBytes() const
+{
+    return peakBytes.get();
+}
+
+int64 EventQueue::getNumDropped() const
+{
+    return numDropped.get();
+}
+
+int64 EventQueue::getNumPushed() const
+{
+    return numPushed.get();
+}
+
+void EventQueue::writeAt(int index, const void* src, int numBytes)
+{
+    const int firstPart = jmin(numBytes, bufferSize - index);
+
+    memcpy(buffer + index, src, (size_t) firstPart);
+    memcpy(buffer, static_cast<const char*>(src) + firstPart, (size_t) (numBytes - firstPart));
+}
+
+void EventQueue::readAt(int index, void* dest, int numBytes) const
+{
+    const int firstPart = jmin(numBytes, bufferSize - index);
+
+    memcpy(dest, buffer + index, (size_t) firstPart);
+    memcpy(static_cast<char*>(dest) + firstPart, buffer, (size_t) (numBytes - firstPart));
+}
@@ -0,0 +1,92 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef EVENTQUEUE_H_INCLUDED
+#define EVENTQUEUE_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Lock-free single-producer, single-consumer queue of variable-length records.
+
+ All storage is allocated up front, so push() never allocates or blocks and
+ can be called from the processing thread. Records that don't fit are dropped
+ and counted rather than waited on.
+
+ */
+
+class EventQueue
+{
+public:
+    /** Creates a queue holding up to capacityBytes of records (including a 4-byte size per record) */
+    EventQueue(int capacityBytes);
+
+    /** Destructor */
+    ~EventQueue() { }
+
+    /** Appends a record. Returns false if there isn't enough free space. Producer thread only. */
+    bool push(const void* data, int numBytes);
+
+    /** Returns the size of the next record, or 0 if empty. Consumer thread only. */
+    int getNextSize() const;
+
+    /** Moves the next record into dest. Returns the record size, or 0 if empty. Consumer thread only. */
+    int pop(void* dest, int maxBytes);
+
+    /** Returns the number of records waiting to be popped */
+    int getNumRecords() const;
+
+    /** Returns the number of bytes waiting to be popped */
+    int getNumBytes() const;
+
+    /** Returns the usable capacity in bytes */
+    int getCapacity() const;
+
+    /** Returns the largest number of bytes that were queued at once */
+    int getPeakBytes() const;
+
+    /** Returns the number of records that were dropped because the queue was full */
+    int64 getNumDropped() const;
+
+    /** Returns the total number of records that were pushed successfully */
+    int64 getNumPushed() const;
+
+private:
+    void writeAt(int index, const void* src, int numBytes);
+    void readAt(int index, void* dest, int numBytes) const;
+
+    AbstractFifo fifo;
+    HeapBlock<char> buffer;
+    int bufferSize;
+
+    Atomic<int> numRecords;
+    Atomic<int> peakBytes;
+    Atomic<int64> numDropped;
+    Atomic<int64> numPushed;
+
+    JUCE_DECLARE_NON_COPYABLE(EventQueue);
+};
+
+
+#endif  // EVENTQUEUE_H_INCLUDED
@@ -0,0 +1,473 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "EventSender.h"
+#include "SpikeFeatures.h"
+
+#include <charconv>
+#include <chrono>
+
+typedef EventEncoder::EventRecord EventRecord;
+typedef EventEncoder::ChannelEncoding ChannelEncoding;
+
+EventSender::EventSender()
+    : messagePool       (new MessagePool())
+    , firstSendTicks    (0)
+    , lastSendTicks     (0)
+    , settings          ({ 1000, 0, false, false, 0, 0, false })
+    , sharedRing        (nullptr)
+    , jsonData          (messagePool.get())
+    , batchCount        (0)
+    , batchFormat       (0)
+    , batchTopic        (false)
+    , batchStartTicks   (0)
+    , batchData         (messagePool.get())
+    , batchCaptureCapacity (0)
+    , columnsTopic      (false)
+    , columnsStartTicks (0)
+{ }
+
+EventSender::~EventSender()
+{ }
+
+void EventSender::prepareToSend(const SendSettings& newSettings)
+{
+    settings = newSettings;
+
+    sendLatency.reset();
+    firstSendTicks = 0;
+    lastSendTicks = 0;
+
+    if (settings.profiling && batchCaptureCapacity < settings.maxBatchEvents)
+    {
+        batchCaptureTicks.malloc(settings.maxBatchEvents);
+        batchCaptureCapacity = settings.maxBatchEvents;
+    }
+
+    if (settings.spikeColumns)
+    {
+        // room for the largest spike shape, so that nothing is allocated while sending
+        spikeColumns.allocate(settings.maxBatchEvents, settings.maxValuesPerSpike, settings.maxChannelsPerSpike);
+
+        if (settings.profiling)
+        {
+            columnCaptureTicks.malloc(settings.maxBatchEvents);
+        }
+    }
+}
+
+void EventSender::setSharedRing(SharedRingWriter* ring)
+{
+    sharedRing = ring;
+}
+
+int64 EventSender::getSendTime()
+{
+    return (int64) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void EventSender::stampSendTime(char* compact)
+{
+    const int64 now = getSendTime();
+    memcpy(compact + offsetof(CompactHeader, sendTime), &now, sizeof(now));
+}
+
+void EventSender::stampBatchSendTimes(char* entries, size_t size)
+{
+    // each entry is a uint16 type, a uint16 reserved field and a uint32 size, then the payload,
+    // padded so that the next entry starts on an 8-byte boundary
+    size_t offset = 0;
+    while (offset + 8 <= size)
+    {
+        uint32 entrySize;
+        memcpy(&entrySize, entries + offset + 4, sizeof(entrySize));
+
+        stampSendTime(entries + offset + 8);
+        offset += 8 + getPaddedEntrySize(entrySize);
+    }
+}
+
+void EventSender::sendRecord(MessagePool::Buffer*& recordBuffer)
+{
+    const char* record = recordBuffer->getData();
+    const EventRecord& header = *reinterpret_cast<const EventRecord*>(record);
+    const char* payload = record + sizeof(EventRecord);
+
+    if (header.baseType == EventEncoder::BLOCK_END_RECORD)
+    {
+        flushBatch();
+        return;
+    }
+
+    if (header.baseType == EventEncoder::CONTINUOUS_RECORD)
+    {
+        sendContinuous(header, recordBuffer);
+        return;
+    }
+
+    if (header.format == EventEncoder::COMPACT_BINARY)
+    {
+        // batches are stamped again when they're sent
+        stampSendTime(recordBuffer->getData() + sizeof(EventRecord));
+    }
+
+    if (sharedRing != nullptr)
+    {
+        writeToSharedRing(header, payload);
+    }
+
+    if (header.batched)
+    {
+        appendToBatch(header, payload);
+        return;
+    }
+
+    MsgPart message[3];
+    int numParts = 0;
+
+    char topic[EventEncoder::MAX_TOPIC_SIZE];
+    if (header.withTopic)
+    {
+        message[numParts++] = { "topic", topic, writeTopic(header, topic), nullptr };
+    }
+
+    uint16 baseType16 = header.baseType; // 0 for TTL events, 1 for spikes
+    message[numParts++] = { "type", &baseType16, sizeof(baseType16), nullptr };
+
+    if (header.format != EventEncoder::JSON_STRING)
+    {
+        // already serialized on the processing thread; send it straight from the record
+        message[numParts++] = { "data", payload, header.payloadSize, recordBuffer };
+        recordBuffer = nullptr;
+    }
+    else
+    {
+        writeJSON(header, payload, jsonData);
+
+        size_t jsonSize = jsonData.getDataSize();
+        MessagePool::Buffer* jsonBuffer = jsonData.release();
+
+        message[numParts++] = { "json", jsonBuffer->getData(), jsonSize, jsonBuffer };
+    }
+
+    // the record may be gone once ZMQ has the message
+    const int64 captureTicks = header.captureTicks;
+
+    sendMessage(message, numParts);
+
+    if (settings.profiling)
+    {
+        countLatency(captureTicks);
+    }
+}
+
+void EventSender::appendToBatch(const EventRecord& record, const char* payload)
+{
+    if (record.columnar)
+    {
+        appendToColumns(record, payload);
+        return;
+    }
+
+    // a batch only ever holds one format
+    if (batchCount > 0 && (record.format != batchFormat || record.withTopic != batchTopic))
+    {
+        flushBatch();
+    }
+
+    if (batchCount == 0)
+    {
+        batchFormat = record.format;
+        batchTopic = record.withTopic;
+        batchStartTicks = Time::getHighResolutionTicks();
+    }
+
+    if (record.format != EventEncoder::JSON_STRING)
+    {
+        // each entry is prefixed by its type and size, and padded to keep the
+        // next one (and so its waveform) on an 8-byte boundary
+        static const char padding[8] = {};
+        uint16 entryType = record.baseType;
+        uint16 reserved = 0;
+        uint32 entrySize = record.payloadSize;
+
+        batchData.write(&entryType, sizeof(entryType));
+        batchData.write(&reserved, sizeof(reserved));
+        batchData.write(&entrySize, sizeof(entrySize));
+        batchData.write(payload, record.payloadSize);
+        batchData.write(padding, getPaddedEntrySize(entrySize) - entrySize);
+    }
+    else // JSON array
+    {
+        batchData.write(batchCount == 0 ? "[" : ",", 1);
+        writeJSON(record, payload, batchData);
+    }
+
+    if (settings.profiling && batchCount < batchCaptureCapacity)
+    {
+        batchCaptureTicks[batchCount] = record.captureTicks;
+    }
+
+    ++batchCount;
+
+    if (batchCount >= settings.maxBatchEvents)
+    {
+        flushBatch();
+    }
+    else if (settings.maxBatchMicros > 0)
+    {
+        double elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - batchStartTicks);
+        if (elapsed * 1.0e6 >= settings.maxBatchMicros)
+        {
+            flushBatch();
+        }
+    }
+}
+
+void EventSender::flushBatch()
+{
+    flushColumns();
+
+    if (batchCount == 0)
+    {
+        return;
+    }
+
+    if (batchFormat == EventEncoder::JSON_STRING)
+    {
+        batchData.write("]", 1);
+    }
+
+    uint16 baseType16 = BATCH_TYPE;
+    uint32 count32 = (uint32) batchCount;
+
+    size_t batchSize = batchData.getDataSize();
+    MessagePool::Buffer* batchBuffer = batchData.release();
+
+    if (batchFormat == EventEncoder::COMPACT_BINARY)
+    {
+        stampBatchSendTimes(batchBuffer->getData(), batchSize);
+    }
+
+    MsgPart message[4];
+    int numParts = 0;
+
+    // a batch mixes channels, so it has a topic of its own
+    if (batchTopic)
+    {
+        message[numParts++] = { "topic", "batch", 5, nullptr };
+    }
+
+    message[numParts++] = { "type", &baseType16, sizeof(baseType16), nullptr };
+    message[numParts++] = { "count", &count32, sizeof(count32), nullptr };
+    message[numParts++] = { batchFormat == EventEncoder::JSON_STRING ? "json" : "data", batchBuffer->getData(), batchSize, batchBuffer };
+
+    sendMessage(message, numParts);
+
+    if (settings.profiling)
+    {
+        for (int i = 0; i < jmin(batchCount, batchCaptureCapacity); ++i)
+        {
+            countLatency(batchCaptureTicks[i]);
+        }
+    }
+
+    batchCount = 0;
+}
+
+void EventSender::appendToColumns(const EventRecord& record, const char* payload)
+{
+    const ChannelEncoding* encoding = &getSendEncoding(record.channelIndex);
+
+    CompactSpike body;
+    memcpy(&body, payload + sizeof(CompactHeader), sizeof(body));
+
+    const uint8 sampleFormat = settings.columnWaveforms
+        ? body.sampleFormat : (uint8) COMPACT_SAMPLES_NONE;
+
+    const int numChannels = body.numChannels;
+    const bool channelSubset = body.channelSubset != 0;
+
+    // a message only ever holds one spike shape and sample format
+    if (spikeColumns.getNumSpikes() > 0
+        && (!spikeColumns.hasShape(numChannels, encoding->totalSamples, sampleFormat, channelSubset)
+            || record.withTopic != columnsTopic))
+    {
+        flushColumns();
+    }
+
+    if (spikeColumns.getNumSpikes() == 0)
+    {
+        spikeColumns.start(numChannels, encoding->totalSamples, sampleFormat, channelSubset);
+        columnsTopic = record.withTopic;
+        columnsStartTicks = Time::getHighResolutionTicks();
+    }
+
+    const char* waveform = payload + COMPACT_WAVEFORM_OFFSET;
+    const uint16* channels = channelSubset
+        ? reinterpret_cast<const uint16*>(waveform
+            + (size_t) numChannels * encoding->totalSamples * getCompactSampleSize(body.sampleFormat))
+        : nullptr;
+
+    // the largest of the peak-to-trough channel amplitudes that JSON messages carry
+    float peakAmplitude = 0;
+    for (int ch = 0; ch < numChannels; ch++)
+    {
+        const int offset = ch * encoding->totalSamples;
+        float amplitude;
+
+        if (body.sampleFormat == COMPACT_SAMPLES_INT16)
+        {
+            int16 minimum, maximum;
+            SpikeFeatures::findExtremes(reinterpret_cast<const int16*>(waveform) + offset, encoding->totalSamples,
+                minimum, maximum);
+            amplitude = ((int) maximum - (int) minimum) * body.scale;
+        }
+        else
+        {
+            float minimum, maximum;
+            SpikeFeatures::findExtremes(reinterpret_cast<const float*>(waveform) + offset, encoding->totalSamples,
+                minimum, maximum);
+            amplitude = maximum - minimum;
+        }
+
+        peakAmplitude = ch == 0 ? amplitude : jmax(peakAmplitude, amplitude);
+    }
+
+    if (settings.profiling)
+    {
+        columnCaptureTicks[spikeColumns.getNumSpikes()] = record.captureTicks;
+    }
+
+    spikeColumns.add(record.sampleNumber, record.channelIndex, (uint16) record.sortedId, peakAmplitude,
+        waveform, body.scale, channels);
+
+    if (spikeColumns.getNumSpikes() >= spikeColumns.getCapacity())
+    {
+        flushColumns();
+    }
+    else if (settings.maxBatchMicros > 0)
+    {
+        double elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - columnsStartTicks);
+        if (elapsed * 1.0e6 >= settings.maxBatchMicros)
+        {
+            flushColumns();
+        }
+    }
+}
+
+void EventSender::flushColumns()
+{
+    const int numSpikes = spikeColumns.getNumSpikes();
+    if (numSpikes == 0)
+    {
+        return;
+    }
+
+    const size_t columnsSize = spikeColumns.getMessageSize();
+    MessagePool::Buffer* columnsBuffer = messagePool->acquire(columnsSize);
+
+    spikeColumns.write(columnsBuffer->getData(), getSendTime());
+    spikeColumns.clear();
+
+    uint16 baseType16 = SPIKE_COLUMNS_TYPE;
+
+    MsgPart message[3];
+    int numParts = 0;
+
+    if (columnsTopic)
+    {
+        message[numParts++] = { "topic", "batch", 5, nullptr };
+    }
+
+    message[numParts++] = { "type", &baseType16, sizeof(baseType16), nullptr };
+    message[numParts++] = { "columns", columnsBuffer->getData(), columnsSize, columnsBuffer };
+
+    sendMessage(message, numParts);
+
+    if (settings.profiling)
+    {
+        for (int i = 0; i < numSpikes; ++i)
+        {
+            countLatency(columnCaptureTicks[i]);
+        }
+    }
+}
+
+void EventSender::countLatency(int64 captureTicks)
+{
+    const int64 now = Time::getHighResolutionTicks();
+
+    if (firstSendTicks == 0)
+    {
+        firstSendTicks = now;
+    }
+    lastSendTicks = now;
+
+    sendLatency.add((int64) (Time::highResolutionTicksToSeconds(now - captureTicks) * 1.0e9));
+}
+
+void EventSender::writeToSharedRing(const EventRecord& record, const char* payload)
+{
+    SharedRingRecord ringRecord = {};
+    ringRecord.sampleNumber = record.sampleNumber;
+    ringRecord.type = record.baseType;
+    ringRecord.format = record.format;
+    ringRecord.channelIndex = record.channelIndex;
+    ringRecord.sortedId = (uint16) record.sortedId;
+    ringRecord.line = record.line;
+    ringRecord.state = record.state ? 1 : 0;
+    ringRecord.numChannels = record.numChannels;
+    ringRecord.payloadSize = record.payloadSize;
+
+    sharedRing->write(ringRecord, payload);
+}
+
+size_t EventSender::writeTopic(const EventRecord& record, char* dest) const
+{
+    const ChannelEncoding* encoding = &getSendEncoding(record.channelIndex);
+
+    size_t size = encoding->topic.getSize();
+    memcpy(dest, encoding->topic.getData(), size);
+
+    if (record.baseType == EventEncoder::TTL_RECORD)
+    {
+        auto result = std::to_chars(dest + size, dest + EventEncoder::MAX_TOPIC_SIZE, record.line);
+        size = (size_t) (result.ptr - dest);
+    }
+
+    return size;
+}
+
+void EventSender::sendContinuous(const EventRecord& record, MessagePool::Buffer*& recordBuffer)
+{
+    ignoreUnused(record);
+    MessagePool::release(recordBuffer);
+    recordBuffer = nullptr;
+}
+
+void EventSender::writeJSON(const EventRecord& record, const char* payload, OutputStream& dest)
+{
+    EventEncoder::writeJSON(getSendEncoding(record.channelIndex), record, payload, dest);
+}
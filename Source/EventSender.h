@@ -0,0 +1,174 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef EVENTSENDER_H_INCLUDED
+#define EVENTSENDER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "EventEncoder.h"
+#include "LatencyHistogram.h"
+#include "MessagePool.h"
+#include "SharedRingWriter.h"
+#include "SpikeColumns.h"
+
+/**
+
+ Sends events and spikes captured by EventEncoder as multi-part messages:
+ each on its own, or collected into one batch per processing block, with
+ batched Compact spikes optionally sent as columns instead. Raw Binary and
+ Compact payloads go out straight from the record's pooled buffer, which the
+ message takes over; JSON is written into a pooled stream first. Records can
+ also be copied into a shared-memory ring as they are sent.
+
+ How a finished message leaves is up to sendMessage(), so that the same path
+ can run without the GUI, e.g. in the loopback benchmark.
+
+ Only one thread may send at a time. Once prepareToSend() has been called and
+ the message pool has warmed up, sending doesn't allocate.
+
+ */
+
+class EventSender
+{
+public:
+    /** One frame of a multi-part message. If buffer is set, sendMessage() takes
+        ownership of it and sends data from it without copying. */
+    struct MsgPart
+    {
+        const char* name;
+        const void* data;
+        size_t size;
+        MessagePool::Buffer* buffer;
+    };
+
+    /** Value of the "type" frame for a batch of events and spikes */
+    static const uint16 BATCH_TYPE = 2;
+
+    /** Value of the "type" frame for a batch of spikes sent as columns */
+    static const uint16 SPIKE_COLUMNS_TYPE = 4;
+
+    /** Value of the "type" frame for a block of decimated continuous data */
+    static const uint16 CONTINUOUS_TYPE = 5;
+
+    /** How batches are put together, fixed for an acquisition */
+    struct SendSettings
+    {
+        int maxBatchEvents;         // a batch (or spike columns) is sent once it holds this many
+        int maxBatchMicros;         // or once this long has passed since it was started, if not 0
+        bool spikeColumns;          // batched Compact spikes may be captured for columns
+        bool columnWaveforms;       // columns include the waveforms
+        int maxValuesPerSpike;      // largest spike, as channels x samples, and its number of
+        int maxChannelsPerSpike;    // channels, so that the columns never have to grow
+        bool profiling;             // record the time from capture to send in sendLatency
+    };
+
+    /** Constructor */
+    EventSender();
+
+    /** Destructor */
+    virtual ~EventSender();
+
+    /** Makes room for batches and spike columns with these settings, and resets sendLatency */
+    void prepareToSend(const SendSettings& settings);
+
+    /** Sets a ring that events and spikes are also written into as they're sent, or nullptr for none */
+    void setSharedRing(SharedRingWriter* ring);
+
+    /** Sends a captured event or spike, or adds it to the current batch; a block end record sends
+        the batch. May pass the buffer on with the message, in which case it is set to nullptr. */
+    void sendRecord(MessagePool::Buffer*& recordBuffer);
+
+    /** Sends the current batch and spike columns, if there are any */
+    void flushBatch();
+
+    /** Returns the current time in nanoseconds since the Unix epoch, for send times in the Compact format */
+    static int64 getSendTime();
+
+    /** Sets the send time of a Compact payload to now */
+    static void stampSendTime(char* compact);
+
+    /** Sets the send time of each entry of a Compact batch to now */
+    static void stampBatchSendTimes(char* entries, size_t size);
+
+protected:
+    /** Sends a multi-part message, taking over the buffers of its parts whether or not it
+        gets sent. Returns 0 on success, or -1 if it wasn't sent. */
+    virtual int sendMessage(const MsgPart* parts, int numParts) = 0;
+
+    /** Returns the encoding of the channel a record was captured from */
+    virtual const EventEncoder::ChannelEncoding& getSendEncoding(uint16 channelIndex) const = 0;
+
+    /** Sends a captured block of continuous data; drops it unless overridden */
+    virtual void sendContinuous(const EventEncoder::EventRecord& record, MessagePool::Buffer*& recordBuffer);
+
+    /** Writes a captured event or spike as a JSON object */
+    virtual void writeJSON(const EventEncoder::EventRecord& record, const char* payload, OutputStream& dest);
+
+    /** Adds the time since captureTicks to sendLatency, if profiling */
+    void countLatency(int64 captureTicks);
+
+    MessagePool::Ptr messagePool;   // for records as well as messages, so that they can be sent without copying
+
+    LatencyHistogram sendLatency;
+    int64 firstSendTicks;
+    int64 lastSendTicks;
+
+private:
+    /** Adds a captured event or spike to the current batch */
+    void appendToBatch(const EventEncoder::EventRecord& record, const char* payload);
+
+    /** Adds a captured Compact spike to the spike columns */
+    void appendToColumns(const EventEncoder::EventRecord& record, const char* payload);
+
+    /** Sends the spike columns as one message, if there are any */
+    void flushColumns();
+
+    /** Writes the topic frame for a captured event or spike; returns its size */
+    size_t writeTopic(const EventEncoder::EventRecord& record, char* dest) const;
+
+    /** Copies a captured event or spike into the shared-memory ring */
+    void writeToSharedRing(const EventEncoder::EventRecord& record, const char* payload);
+
+    SendSettings settings;
+    SharedRingWriter* sharedRing;
+    MessageStream jsonData;
+
+    int batchCount;
+    uint16 batchFormat;
+    bool batchTopic;
+    int64 batchStartTicks;
+    MessageStream batchData;
+    HeapBlock<int64> batchCaptureTicks;     // captureTicks of each event in the current batch, if profiling
+    int batchCaptureCapacity;
+
+    SpikeColumns spikeColumns;
+    bool columnsTopic;
+    int64 columnsStartTicks;
+    HeapBlock<int64> columnCaptureTicks;    // captureTicks of each spike in the columns, if profiling
+
+    JUCE_DECLARE_NON_COPYABLE(EventSender);
+};
+
+
+#endif  // EVENTSENDER_H_INCLUDED
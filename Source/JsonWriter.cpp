@@ -0,0 +1,286 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "JsonWriter.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+// floating-point std::to_chars isn't available in every standard library we build with
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    #define HAS_FLOAT_TO_CHARS 1
+#else
+    #define HAS_FLOAT_TO_CHARS 0
+#endif
+
+JsonWriter::JsonWriter(OutputStream& dest_)
+    : dest          (dest_)
+    , commaStack    (0)
+    , depth         (0)
+    , needsComma    (false)
+    , afterKey      (false)
+{}
+
+void JsonWriter::beginObject()
+{
+    push('{');
+}
+
+void JsonWriter::endObject()
+{
+    pop('}');
+}
+
+void JsonWriter::beginArray()
+{
+    push('[');
+}
+
+void JsonWriter::endArray()
+{
+    pop(']');
+}
+
+void JsonWriter::key(const char* name)
+{
+    separate();
+    dest.write("\"", 1);
+    dest.write(name, strlen(name));
+    dest.write("\":", 2);
+    afterKey = true;
+}
+
+void JsonWriter::key(const char* prefix, int64 index)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), index);
+
+    separate();
+    dest.write("\"", 1);
+    dest.write(prefix, strlen(prefix));
+    dest.write(digits, (size_t) (result.ptr - digits));
+    dest.write("\":", 2);
+    afterKey = true;
+}
+
+void JsonWriter::key(const String& name)
+{
+    separate();
+    writeString(dest, name.toRawUTF8(), name.getNumBytesAsUTF8());
+    dest.write(":", 1);
+    afterKey = true;
+}
+
+void JsonWriter::rawKey(const void* json, size_t numBytes)
+{
+    separate();
+    dest.write(json, numBytes);
+    afterKey = true;
+}
+
+void JsonWriter::value(const char* utf8, size_t numBytes)
+{
+    separate();
+    writeString(dest, utf8, numBytes);
+}
+
+void JsonWriter::value(const String& text)
+{
+    value(text.toRawUTF8(), text.getNumBytesAsUTF8());
+}
+
+void JsonWriter::value(int64 number)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
+
+    separate();
+    dest.write(digits, (size_t) (result.ptr - digits));
+}
+
+void JsonWriter::value(uint64 number)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
+
+    separate();
+    dest.write(digits, (size_t) (result.ptr - digits));
+}
+
+void JsonWriter::value(double number)
+{
+    // JSON has no representation for these
+    if (!std::isfinite(number))
+    {
+        null();
+        return;
+    }
+
+    char digits[32];
+#if HAS_FLOAT_TO_CHARS
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
+    size_t length = (size_t) (result.ptr - digits);
+#else
+    size_t length = (size_t) std::snprintf(digits, sizeof(digits), "%.17g", number);
+#endif
+
+    separate();
+    dest.write(digits, length);
+}
+
+void JsonWriter::value(float number)
+{
+    if (!std::isfinite(number))
+    {
+        null();
+        return;
+    }
+
+    char digits[32];
+#if HAS_FLOAT_TO_CHARS
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
+    size_t length = (size_t) (result.ptr - digits);
+#else
+    size_t length = (size_t) std::snprintf(digits, sizeof(digits), "%.9g", (double) number);
+#endif
+
+    separate();
+    dest.write(digits, length);
+}
+
+void JsonWriter::value(bool state)
+{
+    separate();
+
+    if (state)
+    {
+        dest.write("true", 4);
+    }
+    else
+    {
+        dest.write("false", 5);
+    }
+}
+
+void JsonWriter::null()
+{
+    separate();
+    dest.write("null", 4);
+}
+
+void JsonWriter::raw(const void* json, size_t numBytes)
+{
+    separate();
+    dest.write(json, numBytes);
+}
+
+void JsonWriter::resumeObject(const void* json, size_t numBytes)
+{
+    separate();
+    dest.write(json, numBytes);
+
+    jassert(depth < 64);
+    commaStack = (commaStack << 1) | 1;
+    ++depth;
+
+    // the prefix ends with a member, so the next one needs a comma
+    needsComma = true;
+}
+
+void JsonWriter::writeString(OutputStream& dest, const char* utf8, size_t numBytes)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    dest.write("\"", 1);
+
+    // copy runs of characters that don't need escaping in one go
+    size_t runStart = 0;
+
+    for (size_t i = 0; i < numBytes; ++i)
+    {
+        const unsigned char c = (unsigned char) utf8[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        dest.write(utf8 + runStart, i - runStart);
+        runStart = i + 1;
+
+        switch (c)
+        {
+        case '"':   dest.write("\\\"", 2); break;
+        case '\\':  dest.write("\\\\", 2); break;
+        case '\n':  dest.write("\\n", 2); break;
+        case '\r':  dest.write("\\r", 2); break;
+        case '\t':  dest.write("\\t", 2); break;
+        default:
+        {
+            const char escaped[] = { '\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xF] };
+            dest.write(escaped, sizeof(escaped));
+            break;
+        }
+        }
+    }
+
+    dest.write(utf8 + runStart, numBytes - runStart);
+    dest.write("\"", 1);
+}
+
+void JsonWriter::separate()
+{
+    if (afterKey)
+    {
+        afterKey = false;
+    }
+    else if (needsComma)
+    {
+        dest.write(",", 1);
+    }
+
+    needsComma = true;
+}
+
+void JsonWriter::push(char bracket)
+{
+    separate();
+    dest.write(&bracket, 1);
+
+    jassert(depth < 64);
+    commaStack = (commaStack << 1) | (needsComma ? 1 : 0);
+    ++depth;
+
+    needsComma = false;
+}
+
+void JsonWriter::pop(char bracket)
+{
+    jassert(depth > 0);
+    dest.write(&bracket, 1);
+
+    needsComma = (commaStack & 1) != 0;
+    commaStack >>= 1;
+    --depth;
+}
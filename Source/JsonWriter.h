@@ -0,0 +1,100 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef JSONWRITER_H_INCLUDED
+#define JSONWRITER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Writes compact JSON straight into an OutputStream.
+
+ Unlike building a DynamicObject and calling JSON::toString, nothing is
+ allocated along the way: keys are written in the order they are given,
+ and numbers are formatted with std::to_chars into a local buffer.
+ Commas between members and array elements are added automatically.
+
+ */
+
+class JsonWriter
+{
+public:
+    /** Constructor */
+    JsonWriter(OutputStream& dest);
+
+    void beginObject();
+    void endObject();
+
+    void beginArray();
+    void endArray();
+
+    /** Writes a member name that doesn't need escaping */
+    void key(const char* name);
+
+    /** Writes a member name made of a prefix and a number, e.g. "amp12" */
+    void key(const char* prefix, int64 index);
+
+    /** Writes a member name, escaping it as needed */
+    void key(const String& name);
+
+    /** Writes a member name that was quoted, escaped and followed by a colon elsewhere */
+    void rawKey(const void* json, size_t numBytes);
+
+    void value(const char* utf8, size_t numBytes);
+    void value(const String& text);
+    void value(int64 number);
+    void value(uint64 number);
+    void value(int number)      { value((int64) number); }
+    void value(double number);
+    void value(float number);
+    void value(bool state);
+    void null();
+
+    /** Writes JSON that was encoded elsewhere as the next value */
+    void raw(const void* json, size_t numBytes);
+
+    /** Writes the start of an object encoded elsewhere (its opening brace and
+        first members, but no closing brace), so that more members can follow */
+    void resumeObject(const void* json, size_t numBytes);
+
+    /** Writes text as a quoted and escaped JSON string */
+    static void writeString(OutputStream& dest, const char* utf8, size_t numBytes);
+
+private:
+    void separate();
+    void push(char bracket);
+    void pop(char bracket);
+
+    OutputStream& dest;
+
+    uint64 commaStack;  // one bit per nesting level
+    int depth;
+    bool needsComma;
+    bool afterKey;
+
+    JUCE_DECLARE_NON_COPYABLE(JsonWriter);
+};
+
+
+#endif  // JSONWRITER_H_INCLUDED
@@ -0,0 +1,103 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LatencyHistogram.h"
+
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    zeromem(counts, sizeof(counts));
+    count = 0;
+    maxValue = 0;
+}
+
+void LatencyHistogram::add(int64 nanos)
+{
+    nanos = jmax((int64) 0, nanos);
+
+    ++counts[getBucket((uint64) nanos)];
+    ++count;
+    maxValue = jmax(maxValue, nanos);
+}
+
+int64 LatencyHistogram::getPercentile(double fraction) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    const int64 target = jmax((int64) 1, (int64) std::ceil(fraction * (double) count));
+    int64 seen = 0;
+
+    for (int bucket = 0; bucket < numBuckets; ++bucket)
+    {
+        seen += counts[bucket];
+
+        if (seen >= target)
+        {
+            return jmin(getBucketLimit(bucket), maxValue);
+        }
+    }
+
+    return maxValue;
+}
+
+int LatencyHistogram::getBucket(uint64 value)
+{
+    // values below numSubBuckets get a bucket each
+    if (value < (uint64) numSubBuckets)
+    {
+        return (int) value;
+    }
+
+    int exponent = 0;
+    while ((value >> exponent) >= (uint64) (numSubBuckets * 2))
+    {
+        ++exponent;
+    }
+
+    // the top subBucketBits + 1 bits, less the leading one, pick the sub-bucket
+    const int subBucket = (int) (value >> exponent) - numSubBuckets;
+    return (exponent + 1) * numSubBuckets + subBucket;
+}
+
+int64 LatencyHistogram::getBucketLimit(int bucket)
+{
+    if (bucket < numSubBuckets)
+    {
+        return bucket;
+    }
+
+    const int exponent = bucket / numSubBuckets - 1;
+    const int subBucket = bucket % numSubBuckets;
+
+    // largest value that lands in this bucket
+    return (int64) ((((uint64) (numSubBuckets + subBucket + 1)) << exponent) - 1);
+}
@@ -0,0 +1,76 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LATENCYHISTOGRAM_H_INCLUDED
+#define LATENCYHISTOGRAM_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Fixed-size histogram of latencies, for reporting percentiles.
+
+ Buckets are spaced logarithmically, with 16 buckets between each power of
+ two, so every value is placed to within about 6%. Nothing is allocated after
+ construction, so values can be added from a real-time thread. Only one
+ thread may add values, and the percentiles should be read once it has
+ stopped.
+
+ */
+
+class LatencyHistogram
+{
+public:
+    /** Constructor */
+    LatencyHistogram();
+
+    /** Removes all values */
+    void reset();
+
+    /** Adds a latency in nanoseconds */
+    void add(int64 nanos);
+
+    /** Returns the number of values added */
+    int64 getCount() const      { return count; }
+
+    /** Returns the largest value added, in nanoseconds */
+    int64 getMax() const        { return maxValue; }
+
+    /** Returns the value below which the given fraction of values lie (e.g. 0.99), in nanoseconds */
+    int64 getPercentile(double fraction) const;
+
+private:
+    static const int subBucketBits = 4;
+    static const int numSubBuckets = 1 << subBucketBits;
+    static const int numBuckets = (64 - subBucketBits) * numSubBuckets;
+
+    static int getBucket(uint64 value);
+    static int64 getBucketLimit(int bucket);
+
+    int64 counts[numBuckets];
+    int64 count;
+    int64 maxValue;
+};
+
+
+#endif  // LATENCYHISTOGRAM_H_INCLUDED
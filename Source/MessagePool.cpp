@@ -0,0 +1,227 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MessagePool.h"
+
+MessagePool::MessagePool()
+    : numAllocated (0)
+{
+#if JUCE_DEBUG
+    numAcquiring.store(0);
+#endif
+
+    for (auto& list : freeLists)
+    {
+        list.store(nullptr);
+    }
+}
+
+// only runs once every outstanding buffer has been released
+MessagePool::~MessagePool()
+{
+    for (auto& list : freeLists)
+    {
+        Buffer* buffer = list.load();
+        while (buffer != nullptr)
+        {
+            Buffer* next = buffer->next;
+            std::free(buffer);
+            buffer = next;
+        }
+    }
+}
+
+MessagePool::Buffer* MessagePool::acquire(size_t minSize)
+{
+#if JUCE_DEBUG
+    const int otherAcquirers = numAcquiring.fetch_add(1);
+    jassert(otherAcquirers == 0); // only one thread may acquire at a time
+#endif
+
+    int sizeClass = 0;
+    size_t capacity = smallestBufferSize;
+
+    while (capacity < minSize && sizeClass < numSizeClasses)
+    {
+        capacity <<= 1;
+        ++sizeClass;
+    }
+
+    Buffer* buffer = nullptr;
+
+    if (sizeClass < numSizeClasses)
+    {
+        // with a single consumer, the head can't be popped and pushed back
+        // behind our back, so the usual ABA problem doesn't apply
+        buffer = freeLists[sizeClass].load(std::memory_order_acquire);
+        while (buffer != nullptr
+            && !freeLists[sizeClass].compare_exchange_weak(buffer, buffer->next,
+                std::memory_order_acquire, std::memory_order_acquire))
+        {
+        }
+    }
+    else
+    {
+        sizeClass = -1;
+        capacity = minSize;
+    }
+
+    if (buffer == nullptr)
+    {
+        buffer = static_cast<Buffer*>(std::malloc(sizeof(Buffer) + capacity));
+        buffer->pool = this;
+        buffer->sizeClass = sizeClass;
+        buffer->capacity = capacity;
+        ++numAllocated;
+    }
+
+    buffer->next = nullptr;
+    incReferenceCount();
+
+#if JUCE_DEBUG
+    numAcquiring.fetch_sub(1);
+#endif
+
+    return buffer;
+}
+
+void MessagePool::release(Buffer* buffer)
+{
+    if (buffer == nullptr)
+    {
+        return;
+    }
+
+    MessagePool* pool = buffer->pool;
+
+    if (buffer->sizeClass < 0)
+    {
+        std::free(buffer);
+    }
+    else
+    {
+        auto& list = pool->freeLists[buffer->sizeClass];
+        buffer->next = list.load(std::memory_order_relaxed);
+        while (!list.compare_exchange_weak(buffer->next, buffer,
+            std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // may delete the pool if its owner is already gone
+    pool->decReferenceCount();
+}
+
+void MessagePool::releaseFromZMQ(void* data, void* hint)
+{
+    release(static_cast<Buffer*>(hint));
+}
+
+int64 MessagePool::getNumAllocated() const
+{
+    return numAllocated.get();
+}
+
+
+MessageStream::MessageStream(MessagePool* pool_)
+    : pool      (pool_)
+    , buffer    (nullptr)
+    , size      (0)
+{}
+
+MessageStream::~MessageStream()
+{
+    MessagePool::release(buffer);
+}
+
+char* MessageStream::reserve(size_t numBytes)
+{
+    ensureSpace(numBytes);
+
+    char* dest = buffer->getData() + size;
+    size += numBytes;
+    return dest;
+}
+
+const char* MessageStream::getData() const
+{
+    return buffer != nullptr ? buffer->getData() : nullptr;
+}
+
+size_t MessageStream::getDataSize() const
+{
+    return size;
+}
+
+MessagePool::Buffer* MessageStream::release()
+{
+    MessagePool::Buffer* released = buffer;
+    buffer = nullptr;
+    size = 0;
+    return released;
+}
+
+void MessageStream::reset()
+{
+    size = 0;
+}
+
+bool MessageStream::setPosition(int64 newPosition)
+{
+    if (newPosition < 0 || (size_t) newPosition > size)
+    {
+        return false;
+    }
+
+    size = (size_t) newPosition;
+    return true;
+}
+
+int64 MessageStream::getPosition()
+{
+    return (int64) size;
+}
+
+bool MessageStream::write(const void* dataToWrite, size_t numberOfBytes)
+{
+    memcpy(reserve(numberOfBytes), dataToWrite, numberOfBytes);
+    return true;
+}
+
+void MessageStream::ensureSpace(size_t numBytes)
+{
+    if (buffer != nullptr && size + numBytes <= buffer->getCapacity())
+    {
+        return;
+    }
+
+    MessagePool::Buffer* larger = pool->acquire(jmax((size_t) 4096, 2 * (size + numBytes)));
+
+    if (buffer != nullptr)
+    {
+        memcpy(larger->getData(), buffer->getData(), size);
+        MessagePool::release(buffer);
+    }
+
+    buffer = larger;
+}
@@ -0,0 +1,149 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MESSAGEPOOL_H_INCLUDED
+#define MESSAGEPOOL_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include <atomic>
+
+/**
+
+ Pool of message buffers that can be handed to ZMQ without copying.
+
+ Buffers come in power-of-two size classes and are recycled through lock-free
+ free lists, so once the pool has warmed up, acquiring a buffer never touches
+ the heap. Only one thread may acquire buffers at a time (debug builds assert
+ this), but buffers can be released from any thread (ZMQ releases them from its
+ I/O thread once sent).
+
+ Each outstanding buffer holds a reference to the pool, so the pool stays
+ alive until ZMQ has let go of every message, even after its owner is gone.
+
+ */
+
+class MessagePool : public ReferenceCountedObject
+{
+public:
+    class Buffer
+    {
+    public:
+        char* getData() noexcept { return reinterpret_cast<char*>(this + 1); }
+        size_t getCapacity() const noexcept { return capacity; }
+
+    private:
+        friend class MessagePool;
+
+        Buffer* next;
+        MessagePool* pool;
+        int sizeClass;      // -1 for buffers too large to recycle
+        size_t capacity;
+    };
+
+    typedef ReferenceCountedObjectPtr<MessagePool> Ptr;
+
+    /** Constructor */
+    MessagePool();
+
+    /** Destructor */
+    ~MessagePool();
+
+    /** Returns a buffer with room for at least minSize bytes */
+    Buffer* acquire(size_t minSize);
+
+    /** Returns a buffer to its pool */
+    static void release(Buffer* buffer);
+
+    /** Matches zmq_free_fn; pass the Buffer as the hint to zmq_msg_init_data */
+    static void releaseFromZMQ(void* data, void* hint);
+
+    /** Returns the number of buffers that have been allocated from the heap */
+    int64 getNumAllocated() const;
+
+private:
+    static const int numSizeClasses = 17;       // 256 bytes to 16 MB
+    static const size_t smallestBufferSize = 256;
+
+    std::atomic<Buffer*> freeLists[numSizeClasses];
+    Atomic<int64> numAllocated;
+
+#if JUCE_DEBUG
+    // acquire() pops without ABA protection, so a second concurrent caller
+    // could corrupt a free list; debug builds catch that instead
+    std::atomic<int> numAcquiring;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(MessagePool);
+};
+
+
+/**
+
+ OutputStream that writes into a MessagePool buffer, moving to a larger one
+ as needed. The finished buffer can then be handed off with release().
+
+ */
+
+class MessageStream : public OutputStream
+{
+public:
+    /** Constructor */
+    MessageStream(MessagePool* pool);
+
+    /** Destructor */
+    ~MessageStream();
+
+    /** Returns a pointer to numBytes of space at the end of the stream, and moves past it */
+    char* reserve(size_t numBytes);
+
+    /** Returns the data written so far */
+    const char* getData() const;
+
+    /** Returns the number of bytes written so far */
+    size_t getDataSize() const;
+
+    /** Gives up the buffer (which may be nullptr if nothing was written) and empties the stream */
+    MessagePool::Buffer* release();
+
+    /** Empties the stream, keeping the buffer */
+    void reset();
+
+    // OutputStream methods
+    void flush() override { }
+    bool setPosition(int64 newPosition) override;
+    int64 getPosition() override;
+    bool write(const void* dataToWrite, size_t numberOfBytes) override;
+
+private:
+    void ensureSpace(size_t numBytes);
+
+    MessagePool::Ptr pool;
+    MessagePool::Buffer* buffer;
+    size_t size;
+
+    JUCE_DECLARE_NON_COPYABLE(MessageStream);
+};
+
+
+#endif  // MESSAGEPOOL_H_INCLUDED
@@ -0,0 +1,172 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RCUPOINTER_H_INCLUDED
+#define RCUPOINTER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include <atomic>
+#include <vector>
+
+/**
+
+ Owning pointer that a fixed number of reader threads can follow without locks
+ while another thread replaces the object it points to.
+
+ Each reader calls get() as often as it likes and calls quiescent() with its
+ own index whenever it holds no pointer from get(), e.g. once per processing
+ block. A replaced object is retired rather than deleted, and reclaim()
+ deletes it once every reader has passed a quiescent point since the swap, or
+ is offline. So readers never wait, and never see an object being deleted
+ under them.
+
+ publish() and reclaim() must not run on more than one thread at a time.
+ The writer may also call get(), since it's the only thread that deletes.
+
+ */
+
+template <typename T, int numReaders = 1>
+class RcuPointer
+{
+public:
+    /** Constructor; all readers start out offline */
+    RcuPointer()
+        : current       (nullptr)
+        , swapCount     (0)
+    {
+        for (auto& seen : readerSeen)
+        {
+            seen.store(offline);
+        }
+    }
+
+    /** Deletes the current object and any retired ones; all readers must be offline */
+    ~RcuPointer()
+    {
+        for (int reader = 0; reader < numReaders; ++reader)
+        {
+            jassert(!isReaderOnline(reader));
+        }
+
+        delete current.load();
+        for (auto& entry : retired)
+        {
+            delete entry.object;
+        }
+    }
+
+    // ---- reader threads ----
+
+    /** Returns the current object */
+    T* get() const noexcept
+    {
+        return current.load(std::memory_order_acquire);
+    }
+
+    /** Announces that a reader holds no pointer it got from get() */
+    void quiescent(int reader = 0) noexcept
+    {
+        readerSeen[reader].store(swapCount.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // ---- writer thread ----
+
+    /** Marks a reader as running; call before the reader thread first uses the pointer */
+    void setReaderOnline(int reader = 0) noexcept
+    {
+        quiescent(reader);
+    }
+
+    /** Marks a reader as stopped, so that retired objects can be deleted without waiting for it */
+    void setReaderOffline(int reader = 0) noexcept
+    {
+        readerSeen[reader].store(offline, std::memory_order_release);
+    }
+
+    /** Returns true between setReaderOnline() and setReaderOffline() */
+    bool isReaderOnline(int reader = 0) const noexcept
+    {
+        return readerSeen[reader].load(std::memory_order_acquire) != offline;
+    }
+
+    /** Replaces the current object (taking ownership of the new one) and retires the old one */
+    void publish(T* object)
+    {
+        T* old = current.exchange(object, std::memory_order_acq_rel);
+        const uint64 epoch = swapCount.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+        if (old != nullptr)
+        {
+            retired.push_back({ old, epoch });
+        }
+
+        reclaim();
+    }
+
+    /** Deletes retired objects no reader can still be using. Returns true if none are left. */
+    bool reclaim()
+    {
+        // offline readers count as having seen everything
+        uint64 oldestSeen = offline;
+        for (auto& seen : readerSeen)
+        {
+            oldestSeen = jmin(oldestSeen, (uint64) seen.load(std::memory_order_acquire));
+        }
+
+        for (size_t i = 0; i < retired.size();)
+        {
+            if (oldestSeen >= retired[i].epoch)
+            {
+                delete retired[i].object;
+                retired.erase(retired.begin() + (long) i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        return retired.empty();
+    }
+
+private:
+    static const uint64 offline = ~(uint64) 0;
+
+    struct Retired
+    {
+        T* object;
+        uint64 epoch;       // swapCount once it was replaced
+    };
+
+    std::atomic<T*> current;
+    std::atomic<uint64> swapCount;
+    std::atomic<uint64> readerSeen[numReaders];     // swapCount at each reader's last quiescent point, or offline
+
+    std::vector<Retired> retired;
+
+    JUCE_DECLARE_NON_COPYABLE(RcuPointer);
+};
+
+
+#endif  // RCUPOINTER_H_INCLUDED
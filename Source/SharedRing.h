@@ -0,0 +1,380 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SHAREDRING_H_INCLUDED
+#define SHAREDRING_H_INCLUDED
+
+/**
+
+ Layout of the shared-memory ring that EventBroadcaster can write events and
+ spikes into, and a reader for it.
+
+ This header only uses the standard library and POSIX, so consumers can copy
+ it into their own projects. The ring is a header, then numSlots slots of
+ slotSize bytes, then dataSize bytes of payloads. Record n goes into slot
+ n % numSlots, and its payload follows the previous record's in the data area,
+ wrapping around at its end. A reader that falls more than numSlots records or
+ dataSize bytes behind loses the oldest records. Each slot is guarded by a
+ sequence word: 2n + 1 while record n is being written, 2n + 2 once it is
+ complete. Before overwriting older payloads, the writer moves dataEnd past
+ the bytes it is about to write, so that a reader can tell if a payload changed
+ while it was copied.
+
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <time.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <climits>
+        #include <linux/futex.h>
+        #include <sys/syscall.h>
+    #endif
+    #define SHAREDRING_AVAILABLE 1
+#else
+    #define SHAREDRING_AVAILABLE 0
+#endif
+
+static const uint32_t SHAREDRING_MAGIC = 0x5242454F;     // "OEBR"
+// 2: JSON spike payloads start with the trough and peak, and hold peak-to-trough channel
+//    amplitudes instead of each channel's negated sample just after the peak (version 1),
+//    and the header gives the writer's process ID
+// 3: payloads are kept in a data area of their own, so slots no longer have room
+//    for the largest record
+static const uint32_t SHAREDRING_VERSION = 3;
+
+struct SharedRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t slotSize;                      // bytes per slot, including the SharedRingSlot
+    std::atomic<uint32_t> closed;           // set when the writer goes away; reopen by name
+    uint32_t writerPid;                     // process writing the ring
+    uint32_t maxPayloadSize;                // largest payload a record can have
+    uint64_t dataSize;                      // bytes in the payload area
+
+    alignas(64) std::atomic<uint64_t> writeSequence;    // number of records published
+    std::atomic<uint64_t> dataEnd;                      // payload bytes claimed, including any being written
+
+    alignas(64) std::atomic<uint32_t> wakeCount;        // futex word, bumped for each record
+    std::atomic<uint32_t> numWaiters;
+};
+
+/** Fixed-size description of an event or spike. The payload that follows depends on
+    format: the Raw Binary or Compact encoding, or for JSON a spike's float32 trough and
+    peak, the float32 peak-to-trough (max - min) amplitude of each of its numChannels
+    channels, their uint16 electrode channels if the spike was trimmed, and then the
+    metadata values. A JSON TTL event only has the metadata. */
+struct SharedRingRecord
+{
+    int64_t sampleNumber;
+    uint16_t type;              // 0 = TTL, 1 = spike
+    uint16_t format;            // 1 = Raw Binary, 2 = JSON, 3 = Compact
+    uint16_t channelIndex;      // index in the channel catalog
+    uint16_t sortedId;
+    int32_t line;
+    uint8_t state;
+    uint8_t reserved[3];
+    uint32_t payloadSize;
+    uint16_t numChannels;       // electrode channels a spike's payload holds
+    uint16_t reserved2;
+};
+
+struct SharedRingSlot
+{
+    std::atomic<uint64_t> sequence;
+    SharedRingRecord record;
+    uint64_t payloadOffset;     // position of the payload in the stream of payload bytes; take % dataSize
+};
+
+/** Returns the offset of the first slot */
+inline size_t getSharedRingHeaderSize()
+{
+    return (sizeof(SharedRingHeader) + 63) & ~(size_t) 63;
+}
+
+/** Returns the size of a slot, which keeps each on its own cache line */
+inline uint32_t getSharedRingSlotSize()
+{
+    return (uint32_t) ((sizeof(SharedRingSlot) + 63) & ~(size_t) 63);
+}
+
+/** Returns the offset of the payload area */
+inline size_t getSharedRingDataOffset(uint32_t numSlots, uint32_t slotSize)
+{
+    return getSharedRingHeaderSize() + (size_t) numSlots * slotSize;
+}
+
+/** Returns the total size of a ring */
+inline size_t getSharedRingSize(uint32_t numSlots, uint32_t slotSize, uint64_t dataSize)
+{
+    return getSharedRingDataOffset(numSlots, slotSize) + (size_t) dataSize;
+}
+
+#if SHAREDRING_AVAILABLE
+
+/**
+
+ Reads records from a shared-memory ring written by EventBroadcaster.
+
+ Typical use:
+
+     SharedRingReader reader;
+     if (reader.open("/open-ephys-events"))
+     {
+         SharedRingRecord record;
+         std::vector<char> payload(reader.getMaxPayloadSize());
+
+         for (;;)
+         {
+             auto result = reader.read(record, payload.data(), payload.size());
+             if (result == SharedRingReader::EMPTY)
+                 reader.wait(100);
+             else if (result == SharedRingReader::RECORD)
+                 handle(record, payload.data());
+         }
+     }
+
+ */
+
+class SharedRingReader
+{
+public:
+    enum Result { RECORD, EMPTY, LAPPED, CLOSED };
+
+    SharedRingReader()
+        : header        (nullptr)
+        , mappedSize    (0)
+        , nextSequence  (0)
+    {}
+
+    ~SharedRingReader()
+    {
+        close();
+    }
+
+    /** Maps the ring with the given name (e.g. "/open-ephys-events") and skips to its newest record */
+    bool open(const char* name)
+    {
+        close();
+
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t) info.st_size < getSharedRingHeaderSize())
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* memory = mmap(nullptr, (size_t) info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (memory == MAP_FAILED)
+        {
+            return false;
+        }
+
+        header = static_cast<SharedRingHeader*>(memory);
+        mappedSize = (size_t) info.st_size;
+
+        if (header->magic != SHAREDRING_MAGIC || header->version != SHAREDRING_VERSION
+            || header->slotSize < sizeof(SharedRingSlot) || header->dataSize == 0 || header->dataSize < header->maxPayloadSize
+            || getSharedRingSize(header->numSlots, header->slotSize, header->dataSize) > mappedSize)
+        {
+            close();
+            return false;
+        }
+
+        nextSequence = header->writeSequence.load(std::memory_order_acquire);
+        return true;
+    }
+
+    void close()
+    {
+        if (header != nullptr)
+        {
+            munmap(header, mappedSize);
+            header = nullptr;
+            mappedSize = 0;
+        }
+    }
+
+    bool isOpen() const     { return header != nullptr; }
+
+    /** Returns the largest payload a record can have */
+    size_t getMaxPayloadSize() const
+    {
+        return header != nullptr ? header->maxPayloadSize : 0;
+    }
+
+    /** Returns the sequence number of the next record to be read */
+    uint64_t getNextSequence() const    { return nextSequence; }
+
+    /** Copies the next record. Returns LAPPED, and moves on to the oldest record still
+        available, if the writer has overwritten records that weren't read yet. If only
+        the record's payload was overwritten, LAPPED skips just that record. */
+    Result read(SharedRingRecord& record, void* payload, size_t maxPayloadSize)
+    {
+        if (header == nullptr || header->closed.load(std::memory_order_acquire) != 0)
+        {
+            return CLOSED;
+        }
+
+        const uint64_t written = header->writeSequence.load(std::memory_order_acquire);
+
+        if (nextSequence >= written)
+        {
+            return EMPTY;
+        }
+
+        if (written - nextSequence > header->numSlots)
+        {
+            nextSequence = written - header->numSlots;
+            return LAPPED;
+        }
+
+        const SharedRingSlot* slot = getSlot(nextSequence);
+        const uint64_t expected = 2 * nextSequence + 2;
+
+        if (slot->sequence.load(std::memory_order_acquire) != expected)
+        {
+            nextSequence = header->writeSequence.load(std::memory_order_acquire) - header->numSlots + 1;
+            return LAPPED;
+        }
+
+        memcpy(&record, &slot->record, sizeof(record));
+        const uint64_t payloadOffset = slot->payloadOffset;
+
+        size_t size = record.payloadSize;
+        if (size > maxPayloadSize)
+        {
+            size = maxPayloadSize;
+        }
+        if (size > getMaxPayloadSize())
+        {
+            size = getMaxPayloadSize();
+        }
+
+        // in two parts if the payload wraps around the end of the data area
+        const char* data = reinterpret_cast<const char*>(header) + getSharedRingDataOffset(header->numSlots, header->slotSize);
+        const size_t start = (size_t) (payloadOffset % header->dataSize);
+        const size_t firstPart = size < header->dataSize - start ? size : header->dataSize - start;
+        memcpy(payload, data + start, firstPart);
+        memcpy(static_cast<char*>(payload) + firstPart, data, size - firstPart);
+
+        // the writer may have started on this slot again while it was copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) != expected)
+        {
+            nextSequence = header->writeSequence.load(std::memory_order_acquire) - header->numSlots + 1;
+            return LAPPED;
+        }
+
+        // or written over the payload, even if the slot is still there
+        if (header->dataEnd.load(std::memory_order_relaxed) - payloadOffset > header->dataSize)
+        {
+            ++nextSequence;
+            return LAPPED;
+        }
+
+        ++nextSequence;
+        return RECORD;
+    }
+
+    /** Waits up to timeoutMs for a record to be published after the last one read */
+    void wait(int timeoutMs)
+    {
+        if (header == nullptr)
+        {
+            return;
+        }
+
+        const uint32_t wakeCount = header->wakeCount.load(std::memory_order_acquire);
+
+        if (header->writeSequence.load(std::memory_order_acquire) > nextSequence)
+        {
+            return;
+        }
+
+#if defined(__linux__)
+        // sequentially consistent, like the writer's publish and numWaiters check: either
+        // the writer sees this waiter and wakes it, or this sees the writer's record
+        header->numWaiters.fetch_add(1, std::memory_order_seq_cst);
+
+        if (header->writeSequence.load(std::memory_order_seq_cst) <= nextSequence)
+        {
+            struct timespec timeout;
+            timeout.tv_sec = timeoutMs / 1000;
+            timeout.tv_nsec = (long) (timeoutMs % 1000) * 1000000L;
+
+            // returns straight away if a record was published since wakeCount was read
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->wakeCount), FUTEX_WAIT,
+                wakeCount, &timeout, nullptr, 0);
+        }
+
+        header->numWaiters.fetch_sub(1, std::memory_order_release);
+#else
+        // no futex; poll instead
+        (void) wakeCount;
+        for (int waited = 0; waited < timeoutMs; ++waited)
+        {
+            if (header->writeSequence.load(std::memory_order_acquire) > nextSequence)
+            {
+                return;
+            }
+            usleep(1000);
+        }
+#endif
+    }
+
+private:
+    const SharedRingSlot* getSlot(uint64_t sequence) const
+    {
+        const char* slots = reinterpret_cast<const char*>(header) + getSharedRingHeaderSize();
+        return reinterpret_cast<const SharedRingSlot*>(slots + (sequence % header->numSlots) * header->slotSize);
+    }
+
+    SharedRingHeader* header;
+    size_t mappedSize;
+    uint64_t nextSequence;
+
+    SharedRingReader(const SharedRingReader&) = delete;
+    SharedRingReader& operator=(const SharedRingReader&) = delete;
+};
+
+#endif  // SHAREDRING_AVAILABLE
+
+#endif  // SHAREDRING_H_INCLUDED
@@ -0,0 +1,231 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SharedRingWriter.h"
+
+#include <cerrno>
+#include <signal.h>
+
+SharedRingWriter::SharedRingWriter()
+    : header        (nullptr)
+    , mappedSize    (0)
+    , sequence      (0)
+    , dataEnd       (0)
+{}
+
+SharedRingWriter::~SharedRingWriter()
+{
+    destroy();
+}
+
+bool SharedRingWriter::create(const String& ringName, int numSlots, int maxPayloadSize, int64 dataSize)
+{
+    destroy();
+
+#if SHAREDRING_AVAILABLE
+    const uint32 slotSize = getSharedRingSlotSize();
+    dataSize = jmax(dataSize, (int64) maxPayloadSize, (int64) 1);
+    const size_t size = getSharedRingSize((uint32) numSlots, slotSize, (uint64) dataSize);
+
+    int fd = shm_open(ringName.toRawUTF8(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    // readers of an old ring with this name keep their mapping until they see it closed
+    if (fd == -1 && errno == EEXIST && isAbandoned(ringName))
+    {
+        std::cout << "Replacing abandoned shared memory " << ringName << std::endl;
+        shm_unlink(ringName.toRawUTF8());
+        fd = shm_open(ringName.toRawUTF8(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+
+    if (fd == -1)
+    {
+        std::cout << "Failed to create shared memory " << ringName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, (off_t) size) != 0)
+    {
+        std::cout << "Failed to size shared memory " << ringName << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        shm_unlink(ringName.toRawUTF8());
+        return false;
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED)
+    {
+        std::cout << "Failed to map shared memory " << ringName << ": " << strerror(errno) << std::endl;
+        shm_unlink(ringName.toRawUTF8());
+        return false;
+    }
+
+    // ftruncate fills the ring with zeros, so every slot starts out empty
+    header = static_cast<SharedRingHeader*>(memory);
+    header->numSlots = (uint32) numSlots;
+    header->slotSize = slotSize;
+    header->maxPayloadSize = (uint32) maxPayloadSize;
+    header->dataSize = (uint64) dataSize;
+    header->version = SHAREDRING_VERSION;
+    header->writerPid = (uint32) getpid();
+
+    // readers check the magic number last
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHAREDRING_MAGIC;
+
+    name = ringName;
+    mappedSize = size;
+    sequence = 0;
+    dataEnd = 0;
+    return true;
+#else
+    ignoreUnused(ringName, numSlots, maxPayloadSize, dataSize);
+    std::cout << "Shared memory output is not available on this platform" << std::endl;
+    return false;
+#endif
+}
+
+int SharedRingWriter::getMaxPayloadSize() const
+{
+    return header != nullptr ? (int) header->maxPayloadSize : 0;
+}
+
+int64 SharedRingWriter::getDataSize() const
+{
+    return header != nullptr ? (int64) header->dataSize : 0;
+}
+
+bool SharedRingWriter::write(const SharedRingRecord& record, const void* payload)
+{
+#if SHAREDRING_AVAILABLE
+    if (header == nullptr || record.payloadSize > (uint32) getMaxPayloadSize())
+    {
+        return false;
+    }
+
+    char* slots = reinterpret_cast<char*>(header) + getSharedRingHeaderSize();
+    SharedRingSlot* slot = reinterpret_cast<SharedRingSlot*>(slots + (sequence % header->numSlots) * header->slotSize);
+
+    // odd while writing, so readers can tell a torn record; likewise, the bytes about to be
+    // overwritten are claimed first, so readers can tell a payload that changed under them
+    const uint64 payloadOffset = dataEnd;
+    dataEnd += record.payloadSize;
+
+    slot->sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+    header->dataEnd.store(dataEnd, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(&slot->record, &record, sizeof(record));
+    slot->payloadOffset = payloadOffset;
+
+    // in two parts if the payload wraps around the end of the data area
+    char* data = reinterpret_cast<char*>(header) + getSharedRingDataOffset(header->numSlots, header->slotSize);
+    const size_t start = (size_t) (payloadOffset % header->dataSize);
+    const size_t firstPart = jmin((size_t) record.payloadSize, (size_t) header->dataSize - start);
+    memcpy(data + start, payload, firstPart);
+    memcpy(data, static_cast<const char*>(payload) + firstPart, record.payloadSize - firstPart);
+
+    slot->sequence.store(2 * sequence + 2, std::memory_order_release);
+
+    // sequentially consistent, like a waiting reader's numWaiters increment and
+    // writeSequence check, so that they can't both miss each other
+    header->writeSequence.store(++sequence, std::memory_order_seq_cst);
+    header->wakeCount.fetch_add(1, std::memory_order_seq_cst);
+
+#if defined(__linux__)
+    // only make the system call when someone is waiting
+    if (header->numWaiters.load(std::memory_order_seq_cst) > 0)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32*>(&header->wakeCount), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#endif
+
+    return true;
+#else
+    ignoreUnused(record, payload);
+    return false;
+#endif
+}
+
+bool SharedRingWriter::isAbandoned(const String& ringName)
+{
+#if SHAREDRING_AVAILABLE
+    int fd = shm_open(ringName.toRawUTF8(), O_RDONLY, 0);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(SharedRingHeader))
+    {
+        memory = mmap(nullptr, sizeof(SharedRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (memory == MAP_FAILED)
+    {
+        return false; // not a ring, so not ours to remove
+    }
+
+    const SharedRingHeader* existing = static_cast<const SharedRingHeader*>(memory);
+
+    // a ring whose writer closed it or has died (version 1 rings don't say who wrote them)
+    bool abandoned = false;
+    if (existing->magic == SHAREDRING_MAGIC)
+    {
+        const pid_t pid = (pid_t) existing->writerPid;
+        abandoned = existing->closed.load(std::memory_order_acquire) != 0
+            || (pid > 0 && kill(pid, 0) == -1 && errno == ESRCH);
+    }
+
+    munmap(memory, sizeof(SharedRingHeader));
+    return abandoned;
+#else
+    ignoreUnused(ringName);
+    return false;
+#endif
+}
+
+void SharedRingWriter::destroy()
+{
+#if SHAREDRING_AVAILABLE
+    if (header != nullptr)
+    {
+        header->closed.store(1, std::memory_order_release);
+
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32*>(&header->wakeCount), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+
+        munmap(header, mappedSize);
+        shm_unlink(name.toRawUTF8());
+    }
+#endif
+
+    header = nullptr;
+    mappedSize = 0;
+    name = String();
+}
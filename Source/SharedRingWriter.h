@@ -0,0 +1,87 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SHAREDRINGWRITER_H_INCLUDED
+#define SHAREDRINGWRITER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "SharedRing.h"
+
+/**
+
+ Writes events and spikes into a POSIX shared-memory ring (see SharedRing.h)
+ for readers on the same machine.
+
+ Writing never blocks or allocates; readers that fall behind lose the oldest
+ records. Only one thread may write at a time. Not available on Windows.
+
+ */
+
+class SharedRingWriter
+{
+public:
+    /** Constructor; call create() before writing */
+    SharedRingWriter();
+
+    /** Marks the ring as closed for readers and removes it */
+    ~SharedRingWriter();
+
+    /** Creates the ring with the given name, holding up to numSlots records and dataSize bytes
+        of their payloads. The data area is made to hold at least one largest payload. A ring left
+        behind by a writer that closed it or died is replaced; anything else with that name is
+        left alone. Returns false on failure. */
+    bool create(const String& name, int numSlots, int maxPayloadSize, int64 dataSize);
+
+    /** Returns the name the ring was created with */
+    const String& getName() const       { return name; }
+
+    /** Returns the largest payload a record can have */
+    int getMaxPayloadSize() const;
+
+    /** Returns the number of bytes the data area holds */
+    int64 getDataSize() const;
+
+    /** Returns the number of records written since the ring was created */
+    int64 getNumWritten() const         { return (int64) sequence; }
+
+    /** Publishes a record and wakes any waiting readers. Payloads that are too large are dropped. */
+    bool write(const SharedRingRecord& record, const void* payload);
+
+private:
+    void destroy();
+
+    /** Returns true if the shared memory with this name is a ring whose writer has gone */
+    static bool isAbandoned(const String& ringName);
+
+    String name;
+    SharedRingHeader* header;
+    size_t mappedSize;
+    uint64 sequence;
+    uint64 dataEnd;
+
+    JUCE_DECLARE_NON_COPYABLE(SharedRingWriter);
+};
+
+
+#endif  // SHAREDRINGWRITER_H_INCLUDED
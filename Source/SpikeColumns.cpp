@@ -0,0 +1,132 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SpikeColumns.h"
+
+SpikeColumns::SpikeColumns()
+    : capacity            (0)
+    , maxValuesPerSpike   (0)
+    , maxChannelsPerSpike (0)
+    , numSpikes           (0)
+    , shapeChannels       (0)
+    , shapeSamples        (0)
+    , sampleFormat        (COMPACT_SAMPLES_NONE)
+    , channelSubset       (false)
+{}
+
+void SpikeColumns::allocate(int maxSpikes, int maxValues, int maxChannels)
+{
+    sampleNumbers.malloc(maxSpikes);
+    channelIndices.malloc(maxSpikes);
+    sortedIds.malloc(maxSpikes);
+    peakAmplitudes.malloc(maxSpikes);
+    scales.malloc(maxSpikes);
+    electrodeChannels.malloc((size_t) maxSpikes * (size_t) maxChannels);
+    waveforms.malloc((size_t) maxSpikes * (size_t) maxValues * sizeof(float));
+
+    capacity = maxSpikes;
+    maxValuesPerSpike = maxValues;
+    maxChannelsPerSpike = maxChannels;
+    numSpikes = 0;
+}
+
+void SpikeColumns::start(int numChannels, int numSamples, uint8 format, bool subset)
+{
+    jassert(numChannels * numSamples <= maxValuesPerSpike && numChannels <= maxChannelsPerSpike);
+
+    shapeChannels = numChannels;
+    shapeSamples = numSamples;
+    sampleFormat = format;
+    channelSubset = subset;
+    numSpikes = 0;
+}
+
+void SpikeColumns::add(int64 sampleNumber, uint16 channelIndex, uint16 sortedId, float peakAmplitude,
+                       const void* waveform, float scale, const uint16* channels)
+{
+    jassert(numSpikes < capacity);
+
+    sampleNumbers[numSpikes] = sampleNumber;
+    channelIndices[numSpikes] = channelIndex;
+    sortedIds[numSpikes] = sortedId;
+    peakAmplitudes[numSpikes] = peakAmplitude;
+    scales[numSpikes] = scale;
+
+    if (channelSubset)
+    {
+        memcpy(electrodeChannels + numSpikes * shapeChannels, channels, shapeChannels * sizeof(uint16));
+    }
+
+    const size_t waveformSize = (size_t) shapeChannels * (size_t) shapeSamples * getCompactSampleSize(sampleFormat);
+    memcpy(waveforms + numSpikes * waveformSize, waveform, waveformSize);
+
+    ++numSpikes;
+}
+
+CompactColumnsHeader SpikeColumns::makeHeader() const
+{
+    CompactColumnsHeader header = {};
+    header.magic = COMPACT_COLUMNS_MAGIC;
+    header.version = COMPACT_COLUMNS_VERSION;
+    header.sampleFormat = sampleFormat;
+    header.numChannels = (uint16) shapeChannels;
+    header.numSamples = (uint32) shapeSamples;
+    header.numSpikes = (uint32) numSpikes;
+    header.channelSubset = channelSubset ? 1 : 0;
+    return header;
+}
+
+size_t SpikeColumns::getMessageSize() const
+{
+    return getCompactColumnOffsets(makeHeader()).totalSize;
+}
+
+void SpikeColumns::write(char* dest, int64 sendTime) const
+{
+    CompactColumnsHeader header = makeHeader();
+    header.sendTime = sendTime;
+
+    const CompactColumnOffsets offsets = getCompactColumnOffsets(header);
+    const size_t n = (size_t) numSpikes;
+
+    // padding between columns is zeroed so that messages don't leak old memory
+    memset(dest, 0, offsets.waveforms);
+
+    memcpy(dest, &header, sizeof(header));
+    memcpy(dest + offsets.sampleNumbers, sampleNumbers, n * sizeof(int64));
+    memcpy(dest + offsets.channelIndices, channelIndices, n * sizeof(uint16));
+    memcpy(dest + offsets.sortedIds, sortedIds, n * sizeof(uint16));
+    memcpy(dest + offsets.peakAmplitudes, peakAmplitudes, n * sizeof(float));
+
+    if (sampleFormat == COMPACT_SAMPLES_INT16)
+    {
+        memcpy(dest + offsets.scales, scales, n * sizeof(float));
+    }
+
+    if (channelSubset)
+    {
+        memcpy(dest + offsets.electrodeChannels, electrodeChannels, n * shapeChannels * sizeof(uint16));
+    }
+
+    memcpy(dest + offsets.waveforms, waveforms, offsets.totalSize - offsets.waveforms);
+}
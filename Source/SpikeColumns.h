@@ -0,0 +1,110 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPIKECOLUMNS_H_INCLUDED
+#define SPIKECOLUMNS_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#include "CompactFormat.h"
+
+/**
+
+ Collects a batch of spikes as columns (sample numbers, channel indices,
+ sorted IDs, peak amplitudes and optionally the waveforms and the electrode
+ channels they were sent with) and writes them out in the layout of
+ CompactColumnsHeader.
+
+ Storage is allocated up front by allocate(), so adding spikes never
+ allocates. All spikes in a batch have the same number of channels and
+ samples and the same type of waveform values, and either all or none
+ list their electrode channels; start a new batch when these change.
+
+ */
+
+class SpikeColumns
+{
+public:
+    /** Constructor */
+    SpikeColumns();
+
+    /** Makes room for maxSpikes spikes of up to maxValuesPerSpike float32 waveform values
+        and maxChannelsPerSpike electrode channels each */
+    void allocate(int maxSpikes, int maxValuesPerSpike, int maxChannelsPerSpike);
+
+    /** Empties the batch and sets the shape of the spikes that go into it; sampleFormat
+        is a CompactSampleFormat, or COMPACT_SAMPLES_NONE to leave out waveforms */
+    void start(int numChannels, int numSamples, uint8 sampleFormat, bool channelSubset);
+
+    /** Returns true if spikes of this shape and format can be added to the current batch */
+    bool hasShape(int numChannels, int numSamples, uint8 format, bool subset) const
+    {
+        return numChannels == shapeChannels && numSamples == shapeSamples
+            && format == sampleFormat && subset == channelSubset;
+    }
+
+    /** Adds a spike; the waveform holds the channels one after another, in the batch's sample format.
+        The scale is only kept for int16 samples, and the electrode channels for channel subsets. */
+    void add(int64 sampleNumber, uint16 channelIndex, uint16 sortedId, float peakAmplitude,
+             const void* waveform, float scale, const uint16* channels);
+
+    /** Returns the number of spikes that can be added before the batch is full */
+    int getCapacity() const { return capacity; }
+
+    int getNumSpikes() const { return numSpikes; }
+
+    /** Returns the size of the message that write() produces */
+    size_t getMessageSize() const;
+
+    /** Writes the header and columns to dest, which must hold getMessageSize() bytes */
+    void write(char* dest, int64 sendTime) const;
+
+    /** Empties the batch, keeping its shape */
+    void clear() { numSpikes = 0; }
+
+private:
+    CompactColumnsHeader makeHeader() const;
+
+    HeapBlock<int64> sampleNumbers;
+    HeapBlock<uint16> channelIndices;
+    HeapBlock<uint16> sortedIds;
+    HeapBlock<float> peakAmplitudes;
+    HeapBlock<float> scales;
+    HeapBlock<uint16> electrodeChannels;
+    HeapBlock<char> waveforms;
+
+    int capacity;
+    int maxValuesPerSpike;
+    int maxChannelsPerSpike;
+    int numSpikes;
+
+    int shapeChannels;
+    int shapeSamples;
+    uint8 sampleFormat;
+    bool channelSubset;
+
+    JUCE_DECLARE_NON_COPYABLE(SpikeColumns);
+};
+
+
+#endif  // SPIKECOLUMNS_H_INCLUDED
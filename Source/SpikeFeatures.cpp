@@ -0,0 +1,179 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SpikeFeatures.h"
+
+#include <limits>
+
+// SSE2 is always there on x86-64
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define FEATURES_X86 1
+#else
+    #define FEATURES_X86 0
+#endif
+
+float SpikeFeatures::findMinimumScalar(const float* samples, int count)
+{
+    float minimum = std::numeric_limits<float>::infinity();
+
+    for (int i = 0; i < count; ++i)
+    {
+        // same order and NaN handling as _mm_min_ps
+        minimum = samples[i] < minimum ? samples[i] : minimum;
+    }
+
+    return minimum;
+}
+
+float SpikeFeatures::findMinimum(const float* samples, int count)
+{
+#if FEATURES_X86
+    // two accumulators, so consecutive min instructions don't wait on each other
+    __m128 a = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 b = a;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        a = _mm_min_ps(_mm_loadu_ps(samples + i), a);
+        b = _mm_min_ps(_mm_loadu_ps(samples + i + 4), b);
+    }
+
+    float lanes[8];
+    _mm_storeu_ps(lanes, a);
+    _mm_storeu_ps(lanes + 4, b);
+
+    float minimum = findMinimumScalar(lanes, 8);
+    const float rest = findMinimumScalar(samples + i, count - i);
+    minimum = rest < minimum ? rest : minimum;
+#else
+    const float minimum = findMinimumScalar(samples, count);
+#endif
+
+    return minimum;
+}
+
+void SpikeFeatures::findExtremesScalar(const float* samples, int count, float& minimum, float& maximum)
+{
+    minimum = std::numeric_limits<float>::infinity();
+    maximum = -std::numeric_limits<float>::infinity();
+
+    for (int i = 0; i < count; ++i)
+    {
+        // same order and NaN handling as _mm_min_ps and _mm_max_ps
+        minimum = samples[i] < minimum ? samples[i] : minimum;
+        maximum = samples[i] > maximum ? samples[i] : maximum;
+    }
+}
+
+void SpikeFeatures::findExtremes(const float* samples, int count, float& minimum, float& maximum)
+{
+#if FEATURES_X86
+    __m128 low = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 high = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 values = _mm_loadu_ps(samples + i);
+        low = _mm_min_ps(values, low);
+        high = _mm_max_ps(values, high);
+    }
+
+    float lanes[8];
+    _mm_storeu_ps(lanes, low);
+    _mm_storeu_ps(lanes + 4, high);
+
+    float restMinimum, restMaximum, unused;
+    findExtremesScalar(samples + i, count - i, restMinimum, restMaximum);
+    findExtremesScalar(lanes, 4, minimum, unused);
+    findExtremesScalar(lanes + 4, 4, unused, maximum);
+
+    minimum = restMinimum < minimum ? restMinimum : minimum;
+    maximum = restMaximum > maximum ? restMaximum : maximum;
+#else
+    findExtremesScalar(samples, count, minimum, maximum);
+#endif
+}
+
+void SpikeFeatures::findExtremesScalar(const int16* samples, int count, int16& minimum, int16& maximum)
+{
+    minimum = 32767;
+    maximum = -32768;
+
+    for (int i = 0; i < count; ++i)
+    {
+        minimum = jmin(minimum, samples[i]);
+        maximum = jmax(maximum, samples[i]);
+    }
+}
+
+void SpikeFeatures::findExtremes(const int16* samples, int count, int16& minimum, int16& maximum)
+{
+#if FEATURES_X86
+    __m128i low = _mm_set1_epi16(32767);
+    __m128i high = _mm_set1_epi16(-32768);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        low = _mm_min_epi16(values, low);
+        high = _mm_max_epi16(values, high);
+    }
+
+    int16 lanes[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 8), high);
+
+    int16 restMinimum, restMaximum, unused;
+    findExtremesScalar(samples + i, count - i, restMinimum, restMaximum);
+    findExtremesScalar(lanes, 8, minimum, unused);
+    findExtremesScalar(lanes + 8, 8, unused, maximum);
+
+    minimum = jmin(minimum, restMinimum);
+    maximum = jmax(maximum, restMaximum);
+#else
+    findExtremesScalar(samples, count, minimum, maximum);
+#endif
+}
+
+int SpikeFeatures::findPeakChannel(const Spike& spike, int numChannels, int numSamples)
+{
+    int peakChannel = 0;
+    float deepest = std::numeric_limits<float>::infinity();
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float trough = findMinimum(spike.getDataPointer(ch), numSamples);
+
+        if (trough < deepest)
+        {
+            deepest = trough;
+            peakChannel = ch;
+        }
+    }
+
+    return peakChannel;
+}
@@ -0,0 +1,67 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPIKEFEATURES_H_INCLUDED
+#define SPIKEFEATURES_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Vectorized scans over spike waveforms, used to pick out the channels of
+ an electrode that are worth sending and to measure spike amplitudes.
+
+ The SSE kernels give exactly the same results as the scalar ones (see
+ Tests/SpikeFeaturesTest.cpp). Their cost only depends on the number of
+ samples, not on the values. NaN samples are skipped.
+
+ */
+
+class SpikeFeatures
+{
+public:
+    /** Returns the lowest of count samples, or +infinity if there are none */
+    static float findMinimum(const float* samples, int count);
+
+    /** Plain C++ version, also used for the samples left over by the vector kernel */
+    static float findMinimumScalar(const float* samples, int count);
+
+    /** Finds the lowest and highest of count samples; +infinity and -infinity if there are none */
+    static void findExtremes(const float* samples, int count, float& minimum, float& maximum);
+
+    /** Plain C++ version of findExtremes(), also used for the samples left over by the vector kernel */
+    static void findExtremesScalar(const float* samples, int count, float& minimum, float& maximum);
+
+    /** Finds the lowest and highest of count int16 samples; 32767 and -32768 if there are none */
+    static void findExtremes(const int16* samples, int count, int16& minimum, int16& maximum);
+
+    /** Plain C++ version of the int16 findExtremes() */
+    static void findExtremesScalar(const int16* samples, int count, int16& minimum, int16& maximum);
+
+    /** Returns the electrode channel with the deepest trough, i.e. the largest negative
+        deflection, which is where extracellular spikes are biggest */
+    static int findPeakChannel(const Spike& spike, int numChannels, int numSamples);
+};
+
+
+#endif  // SPIKEFEATURES_H_INCLUDED
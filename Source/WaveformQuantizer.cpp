@@ -0,0 +1,148 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "WaveformQuantizer.h"
+
+#include <cmath>
+
+// SSE2 is always there on x86-64; AVX2 is checked for at run time
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define QUANTIZER_X86 1
+#else
+    #define QUANTIZER_X86 0
+#endif
+
+// lets GCC and Clang compile AVX2 code without enabling it for the whole plugin
+#if QUANTIZER_X86 && (defined(__GNUC__) || defined(__clang__))
+    #define QUANTIZER_AVX2_TARGET __attribute__((target("avx2")))
+#else
+    #define QUANTIZER_AVX2_TARGET
+#endif
+
+void WaveformQuantizer::quantizeScalar(const float* src, int16* dest, int count, float scale)
+{
+    const float inverseScale = 1.0f / scale;
+
+    for (int i = 0; i < count; ++i)
+    {
+        // same order and NaN handling as max/min in the vector kernels
+        float value = src[i] * inverseScale;
+        value = value > -32768.0f ? value : -32768.0f;
+        value = value < 32767.0f ? value : 32767.0f;
+
+        dest[i] = (int16) std::nearbyint(value);
+    }
+}
+
+#if QUANTIZER_X86
+
+void WaveformQuantizer::quantizeSSE2(const float* src, int16* dest, int count, float scale)
+{
+    const __m128 inverseScale = _mm_set1_ps(1.0f / scale);
+    const __m128 low = _mm_set1_ps(-32768.0f);
+    const __m128 high = _mm_set1_ps(32767.0f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), inverseScale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), inverseScale);
+
+        a = _mm_min_ps(_mm_max_ps(a, low), high);
+        b = _mm_min_ps(_mm_max_ps(b, low), high);
+
+        // rounds to nearest, then packs with saturation
+        const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), packed);
+    }
+
+    quantizeScalar(src + i, dest + i, count - i, scale);
+}
+
+QUANTIZER_AVX2_TARGET
+void WaveformQuantizer::quantizeAVX2(const float* src, int16* dest, int count, float scale)
+{
+    const __m256 inverseScale = _mm256_set1_ps(1.0f / scale);
+    const __m256 low = _mm256_set1_ps(-32768.0f);
+    const __m256 high = _mm256_set1_ps(32767.0f);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), inverseScale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), inverseScale);
+
+        a = _mm256_min_ps(_mm256_max_ps(a, low), high);
+        b = _mm256_min_ps(_mm256_max_ps(b, low), high);
+
+        // packs work within each 128-bit lane, so put the 64-bit quarters back in order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), packed);
+    }
+
+    quantizeSSE2(src + i, dest + i, count - i, scale);
+}
+
+#else
+
+void WaveformQuantizer::quantizeSSE2(const float* src, int16* dest, int count, float scale)
+{
+    quantizeScalar(src, dest, count, scale);
+}
+
+void WaveformQuantizer::quantizeAVX2(const float* src, int16* dest, int count, float scale)
+{
+    quantizeScalar(src, dest, count, scale);
+}
+
+#endif
+
+void WaveformQuantizer::quantize(const float* src, int16* dest, int count, float scale)
+{
+#if QUANTIZER_X86
+    static const bool useAVX2 = SystemStats::hasAVX2();
+
+    if (useAVX2)
+    {
+        quantizeAVX2(src, dest, count, scale);
+    }
+    else
+    {
+        quantizeSSE2(src, dest, count, scale);
+    }
+#else
+    quantizeScalar(src, dest, count, scale);
+#endif
+}
+
+const char* WaveformQuantizer::getKernelName()
+{
+#if QUANTIZER_X86
+    return SystemStats::hasAVX2() ? "AVX2" : "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,62 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef WAVEFORMQUANTIZER_H_INCLUDED
+#define WAVEFORMQUANTIZER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+/**
+
+ Converts float waveform samples to int16 with a fixed scale, for sending
+ spikes at half the size.
+
+ Each sample becomes round(value / scale), rounded to nearest (ties to even)
+ and saturated to the int16 range, so the error is at most scale / 2 for
+ values within +-32767 * scale. NaN becomes -32768. The AVX2 and SSE2 kernels
+ give exactly the same results as the scalar one (see
+ Tests/WaveformQuantizerTest.cpp).
+
+ */
+
+class WaveformQuantizer
+{
+public:
+    /** Quantizes count samples from src into dest, using the fastest kernel this CPU supports */
+    static void quantize(const float* src, int16* dest, int count, float scale);
+
+    /** Plain C++ version, also used for the samples left over by the vector kernels */
+    static void quantizeScalar(const float* src, int16* dest, int count, float scale);
+
+    /** SSE2 version; the scalar one on other CPUs than x86-64 */
+    static void quantizeSSE2(const float* src, int16* dest, int count, float scale);
+
+    /** AVX2 version, only for CPUs that have it; the scalar one on other CPUs than x86-64 */
+    static void quantizeAVX2(const float* src, int16* dest, int count, float scale);
+
+    /** Returns the name of the kernel that quantize() uses, e.g. for logging */
+    static const char* getKernelName();
+};
+
+
+#endif  // WAVEFORMQUANTIZER_H_INCLUDED
@@ -0,0 +1,88 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+/**
+
+ Timing and allocation counting for the benchmarks. Each benchmark is a
+ plain executable that prints a table; none of them are run by ctest.
+
+ Heap allocations are counted by replacing the global operator new (see
+ Benchmark.cpp), so they include everything allocated through new, but not
+ std::malloc; MessagePool::getNumAllocated() covers the pooled buffers.
+
+ */
+
+#include <chrono>
+#include <cstdint>
+
+namespace Benchmark
+{
+    /** Returns the number of times operator new has been called */
+    int64_t getNumHeapAllocations();
+
+    /** Returns the seconds each measurement should last, from the
+        BENCHMARK_SECONDS environment variable (0.2 by default) */
+    double getMeasurementSeconds();
+
+    /** Calls function(count) with growing counts until it takes long enough to
+        time, and returns the nanoseconds per iteration it reported doing */
+    template <typename Function>
+    double nanosPerIteration(Function&& function)
+    {
+        const double minimumNanos = getMeasurementSeconds() * 1e9;
+
+        // warm up caches, pools and branch predictors
+        function(16);
+
+        for (int64_t count = 16;; count *= 2)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            function(count);
+            const double nanos = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+            if (nanos >= minimumNanos || count >= ((int64_t) 1 << 40))
+            {
+                return nanos / (double) count;
+            }
+        }
+    }
+
+    /** Stops the compiler from optimizing away a result */
+    template <typename T>
+    void keep(const T& value)
+    {
+#if defined(__GNUC__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static const volatile void* sink;
+        sink = &value;
+#endif
+    }
+}
+
+
+#endif  // BENCHMARK_H_INCLUDED
@@ -0,0 +1,259 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "Decimator.h"
+#include "TestHarness.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/**
+
+ Checks that the SSE dot product matches the scalar one, that splitting the
+ input into blocks of any size gives the same outputs at the same positions
+ as one long run, and that the filter keeps the attenuation Decimator.h
+ promises for everything that would alias below the cutoff.
+
+ */
+
+namespace
+{
+    const int NUM_CHANNELS = 3;
+
+    /** Runs signal (the same on every channel, scaled by the channel number plus one) through a
+        decimator in blocks of the given sizes, and returns channel 0's outputs. Checks on the
+        way that each output lands where getNextOutputOffset() says and that the other channels
+        match. */
+    std::vector<float> decimate(Decimator& decimator, const std::vector<float>& signal, const std::vector<int>& blockSizes)
+    {
+        std::vector<float> outputs;
+        std::vector<std::vector<float>> channels(NUM_CHANNELS);
+        std::vector<float> dest;
+
+        decimator.reset();
+
+        size_t start = 0;
+        size_t nextBlock = 0;
+
+        while (start < signal.size())
+        {
+            const int blockSize = (int) jmin(signal.size() - start, (size_t) blockSizes[nextBlock++ % blockSizes.size()]);
+            const int numOutputs = decimator.getNumOutputs(blockSize);
+
+            // outputs are computed up to input samples 0, factor, 2 * factor...
+            if (numOutputs > 0)
+            {
+                expectEquals(start + decimator.getNextOutputOffset(), outputs.size() * decimator.getFactor());
+            }
+
+            const float* inputs[NUM_CHANNELS];
+            for (int c = 0; c < NUM_CHANNELS; ++c)
+            {
+                channels[c].resize(blockSize);
+                for (int i = 0; i < blockSize; ++i)
+                {
+                    channels[c][i] = signal[start + i] * (c + 1);
+                }
+                inputs[c] = channels[c].data();
+            }
+
+            dest.assign((size_t) jmax(1, NUM_CHANNELS * numOutputs), 0.0f);
+            decimator.process(inputs, blockSize, dest.data());
+
+            for (int k = 0; k < numOutputs; ++k)
+            {
+                for (int c = 1; c < NUM_CHANNELS; ++c)
+                {
+                    expect(std::abs(dest[c * numOutputs + k] - dest[k] * (c + 1)) <= 1e-5f * (c + 1));
+                }
+                outputs.push_back(dest[k]);
+            }
+
+            start += blockSize;
+        }
+
+        return outputs;
+    }
+
+    void testDotProduct()
+    {
+        std::mt19937 random(5);
+        std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+
+        std::vector<float> a(300);
+        std::vector<float> b(300);
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            a[i] = values(random);
+            b[i] = values(random);
+        }
+
+        // every tail the 8-wide loop can leave, at every alignment
+        for (int offset = 0; offset < 4; ++offset)
+        {
+            for (int count = 0; count <= 260; ++count)
+            {
+                const float simd = Decimator::dotProduct(a.data() + offset, b.data() + offset, count);
+                const float scalar = Decimator::dotProductScalar(a.data() + offset, b.data() + offset, count);
+
+                // only the order of the additions differs
+                expect(std::abs(simd - scalar) <= 1e-5f * (1.0f + std::sqrt((float) count)));
+            }
+        }
+
+        expectEquals(Decimator::dotProduct(a.data(), b.data(), 0), 0.0f);
+    }
+
+    void testBlockBoundaries()
+    {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+
+        std::vector<float> signal(10000);
+        for (auto& sample : signal)
+        {
+            sample = values(random);
+        }
+
+        for (int factor : { 1, 3, 30 })
+        {
+            Decimator decimator;
+            decimator.prepare(factor, NUM_CHANNELS);
+
+            const std::vector<float> whole = decimate(decimator, signal, { Decimator::MAX_BLOCK_SIZE });
+
+            // one output per factor input samples, the first computed up to sample 0
+            expectEquals(whole.size(), (signal.size() - 1) / factor + 1);
+
+            // blocks shorter than the factor, of one sample, and of every size in between
+            const std::vector<std::vector<int>> splits = {
+                { 1 },
+                { 7, 1024, 1, 333, 29, 30, 31 },
+                { 1000, 5, 1024, 64, 2 }
+            };
+
+            for (const auto& blockSizes : splits)
+            {
+                const std::vector<float> split = decimate(decimator, signal, blockSizes);
+                expectEquals(split.size(), whole.size());
+
+                // the same samples go into each dot product, so the outputs are the same
+                for (size_t k = 0; k < jmin(split.size(), whole.size()); ++k)
+                {
+                    expectEquals(split[k], whole[k]);
+                }
+            }
+        }
+    }
+
+    void testDelay()
+    {
+        for (int factor : { 1, 3, 30 })
+        {
+            Decimator decimator;
+            decimator.prepare(factor, NUM_CHANNELS);
+
+            // the output computed up to getDelay() samples after an impulse is the filter's centre tap
+            const int impulseAt = 50 * factor;
+            std::vector<float> signal(impulseAt + decimator.getDelay() * 2 + 1, 0.0f);
+            signal[impulseAt] = 1.0f;
+
+            const std::vector<float> outputs = decimate(decimator, signal, { 100 });
+            const int peak = (int) (std::max_element(outputs.begin(), outputs.end()) - outputs.begin());
+            expectEquals(peak * factor, impulseAt + decimator.getDelay());
+
+            // and a constant comes through at the same level
+            std::vector<float> constant(decimator.getDelay() * 4 + 100, 0.25f);
+            const std::vector<float> levels = decimate(decimator, constant, { 100 });
+            expect(std::abs(levels.back() - 0.25f) < 1e-5f);
+        }
+    }
+
+    /** Returns the largest output, in dB relative to the input amplitude, once the
+        filter has filled up with a tone of the given frequency in cycles per input sample */
+    double getGainDb(Decimator& decimator, double frequency)
+    {
+        const int settled = decimator.getDelay() * 2 + 1;
+        std::vector<float> signal(settled + 200 * decimator.getFactor());
+        for (size_t i = 0; i < signal.size(); ++i)
+        {
+            signal[i] = (float) std::sin(2 * MathConstants<double>::pi * frequency * i + 0.3);
+        }
+
+        const std::vector<float> outputs = decimate(decimator, signal, { Decimator::MAX_BLOCK_SIZE });
+
+        float peak = 0;
+        for (size_t k = (size_t) (settled / decimator.getFactor() + 1); k < outputs.size(); ++k)
+        {
+            peak = jmax(peak, std::abs(outputs[k]));
+        }
+
+        return 20 * std::log10(jmax((double) peak, 1e-12));
+    }
+
+    void testStopband()
+    {
+        for (int factor : { 2, 3, 10, 30 })
+        {
+            Decimator decimator;
+            decimator.prepare(factor, NUM_CHANNELS);
+
+            // output Nyquist and cutoff, in cycles per input sample
+            const double nyquist = 0.5 / factor;
+            const double cutoff = 0.8 * nyquist;
+
+            // well inside the passband nothing is lost
+            expect(std::abs(getGainDb(decimator, 0.5 * cutoff)) < 0.1);
+
+            // tones above 2 * nyquist - cutoff alias below the cutoff, and must be gone.
+            // Those between the output Nyquist and there only alias into the transition band.
+            const double aliasesBelowCutoff = 2 * nyquist - cutoff;
+
+            for (int step = 0; step <= 40; ++step)
+            {
+                const double frequency = aliasesBelowCutoff + (0.5 - aliasesBelowCutoff) * step / 40;
+                const double gain = getGainDb(decimator, frequency);
+
+                if (!(gain < -70))
+                {
+                    std::printf("factor %d: %.5f cycles/sample only attenuated to %.1f dB\n", factor, frequency, gain);
+                }
+                expect(gain < -70);
+            }
+        }
+    }
+}
+
+int main()
+{
+    testDotProduct();
+    testBlockBoundaries();
+    testDelay();
+    testStopband();
+
+    return TestHarness::finish("DecimatorTest");
+}
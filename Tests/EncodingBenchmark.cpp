@@ -0,0 +1,248 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "EventEncoder.h"
+#include "MessagePool.h"
+#include "Benchmark.h"
+
+#include <memory>
+
+/**
+
+ Measures what EventBroadcaster spends encoding each TTL event and spike in
+ each output format, with the same EventEncoder it uses, outside the GUI.
+
+ Events go through the path they take in inline send mode: captured into a
+ pooled buffer on the processing thread, which is then handed to ZMQ for the
+ binary formats, or written out as JSON into a pooled MessageStream. Handing
+ a buffer to ZMQ is modelled by releasing it straight away, as ZMQ does once
+ the message is sent. Allocations count both heap allocations and buffers
+ the pool had to allocate.
+
+ The plugin's own profiling counters (the "profile" setting) measure the same
+ thing inside the GUI, with the real event and spike classes.
+
+ */
+
+namespace
+{
+    const int NUM_SAMPLES = 40;     // the spike detector's default of 8 before the peak and 32 after
+
+    struct Result
+    {
+        double nanos;
+        double allocations;
+        double bytes;
+    };
+
+    struct Format
+    {
+        const char* name;
+        EventEncoder::Format format;
+        bool quantizeWaveforms;
+    };
+
+    const Format formats[] =
+    {
+        { "Raw Binary",     EventEncoder::RAW_BINARY,       false },
+        { "JSON",           EventEncoder::JSON_STRING,      false },
+        { "Compact",        EventEncoder::COMPACT_BINARY,   false },
+        { "Compact int16",  EventEncoder::COMPACT_BINARY,   true },
+    };
+
+    EventEncoder::Settings makeSettings(const Format& format, int numEncodings)
+    {
+        EventEncoder::Settings settings = {};
+        settings.format = format.format;
+        settings.quantizeWaveforms = format.quantizeWaveforms;
+
+        for (int i = 0; i < numEncodings; i++)
+        {
+            settings.neighbourhoods.add(Array<uint16>());
+        }
+
+        return settings;
+    }
+
+    /** Captures and encodes one event with capture(dest, destSize) the way the plugin does, returning the message size */
+    template <typename Capture>
+    size_t encode(MessagePool* pool, MessagePool::Buffer*& captureBuffer, size_t captureBufferSize,
+                  const EventEncoder::ChannelEncoding& encoding, MessageStream& jsonData, Capture&& capture)
+    {
+        if (capture(captureBuffer->getData(), (int) captureBufferSize) == 0)
+        {
+            std::fprintf(stderr, "capture buffer too small\n");
+            std::abort();
+        }
+
+        const auto& record = *reinterpret_cast<const EventEncoder::EventRecord*>(captureBuffer->getData());
+        const char* payload = captureBuffer->getData() + sizeof(EventEncoder::EventRecord);
+
+        if (record.format != EventEncoder::JSON_STRING)
+        {
+            // sent straight from the capture buffer, which ZMQ then owns
+            const size_t size = record.payloadSize;
+            MessagePool::release(captureBuffer);
+            captureBuffer = pool->acquire(captureBufferSize);
+            return size;
+        }
+
+        EventEncoder::writeJSON(encoding, record, payload, jsonData);
+
+        const size_t size = jsonData.getDataSize();
+        MessagePool::release(jsonData.release());
+        return size;
+    }
+
+    template <typename Capture>
+    Result measure(MessagePool* pool, size_t captureBufferSize, const EventEncoder::ChannelEncoding& encoding, Capture&& capture)
+    {
+        MessagePool::Buffer* captureBuffer = pool->acquire(captureBufferSize);
+        MessageStream jsonData(pool);
+
+        size_t bytes = 0;
+        int64_t iterations = 0;
+        const int64_t heapBefore = Benchmark::getNumHeapAllocations();
+        const int64 poolBefore = pool->getNumAllocated();
+
+        const double nanos = Benchmark::nanosPerIteration([&](int64_t count)
+        {
+            for (int64_t i = 0; i < count; i++)
+            {
+                bytes = encode(pool, captureBuffer, captureBufferSize, encoding, jsonData,
+                    [&](char* dest, int destSize) { return capture(i, dest, destSize); });
+            }
+            iterations += count;
+        });
+
+        const int64_t allocations = Benchmark::getNumHeapAllocations() - heapBefore
+            + (pool->getNumAllocated() - poolBefore);
+
+        MessagePool::release(captureBuffer);
+
+        return { nanos, (double) allocations / (double) iterations, (double) bytes };
+    }
+
+    void printRow(const char* message, int numChannels, const Result* results)
+    {
+        std::printf("%-6s %5d", message, numChannels);
+        for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        {
+            std::printf("   %8.0f %6.2f %7.0f", results[f].nanos, results[f].allocations, results[f].bytes);
+        }
+        std::printf("\n");
+    }
+
+    void benchmarkTtl(MessagePool* pool)
+    {
+        EventChannel channel("Neuropix-PXI-100.ProbeA-AP TTL", "Neuropix-PXI-100.ProbeA-AP", 104, 30000.0f);
+        std::unique_ptr<EventEncoder::ChannelEncoding> encoding(EventEncoder::createEncoding(&channel, 0));
+
+        TTLEvent event(&channel, 1000000, 0, true);
+        const size_t captureBufferSize = sizeof(EventEncoder::EventRecord) + jmax(encoding->rawSize, encoding->compactSize);
+
+        Result results[sizeof(formats) / sizeof(formats[0])];
+
+        for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        {
+            EventEncoder encoder;
+            encoder.resetEncoding(false, false);
+            const EventEncoder::Settings settings = makeSettings(formats[f], 1);
+
+            results[f] = measure(pool, captureBufferSize, *encoding, [&](int64_t i, char* dest, int destSize)
+            {
+                event.setSampleNumber(1000000 + i);
+                return encoder.captureEvent(event, *encoding, settings, dest, destSize);
+            });
+        }
+
+        printRow("TTL", 0, results);
+    }
+
+    void benchmarkSpike(MessagePool* pool, int numChannels)
+    {
+        std::vector<std::unique_ptr<ContinuousChannel>> sources;
+        Array<const ContinuousChannel*> sourceChannels;
+        for (int ch = 0; ch < numChannels; ch++)
+        {
+            sources.emplace_back(new ContinuousChannel("CH" + String(std::to_string(ch + 1)), 0.195f));
+            sourceChannels.add(sources.back().get());
+        }
+
+        SpikeChannel channel("Electrode 1", "Neuropix-PXI-100.ProbeA-AP", 105, 30000.0f, sourceChannels, 8, NUM_SAMPLES - 8);
+        std::unique_ptr<EventEncoder::ChannelEncoding> encoding(EventEncoder::createEncoding(&channel, 0));
+
+        // a trough on every channel, deepest in the middle of the electrode
+        Spike spike(&channel, numChannels, NUM_SAMPLES, 1000000);
+        for (int ch = 0; ch < numChannels; ch++)
+        {
+            float* samples = spike.getDataPointer(ch);
+            const float depth = 80.0f - 60.0f * std::abs(ch - numChannels / 2) / (float) jmax(1, numChannels);
+            for (int s = 0; s < NUM_SAMPLES; s++)
+            {
+                samples[s] = 3.0f * std::sin(0.7f * (float) (s + ch)) - (s == 8 ? depth : 0.0f);
+            }
+        }
+
+        const size_t captureBufferSize = sizeof(EventEncoder::EventRecord) + jmax(encoding->rawSize, encoding->compactSize);
+
+        Result results[sizeof(formats) / sizeof(formats[0])];
+
+        for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        {
+            EventEncoder encoder;
+            encoder.resetEncoding(false, false);
+            const EventEncoder::Settings settings = makeSettings(formats[f], 1);
+
+            results[f] = measure(pool, captureBufferSize, *encoding, [&](int64_t i, char* dest, int destSize)
+            {
+                spike.setSampleNumber(1000000 + i);
+                return encoder.captureSpike(spike, *encoding, settings, dest, destSize);
+            });
+        }
+
+        printRow("spike", numChannels, results);
+    }
+}
+
+int main()
+{
+    MessagePool::Ptr pool = new MessagePool();
+
+    std::printf("                ------ Raw Binary -----   --------- JSON --------   ------- Compact -------   ---- Compact int16 ----\n");
+    std::printf("event  chans   ns/event allocs   bytes   ns/event allocs   bytes   ns/event allocs   bytes   ns/event allocs   bytes\n");
+
+    benchmarkTtl(pool);
+
+    for (int numChannels : { 1, 4, 32, 384 })
+    {
+        benchmarkSpike(pool, numChannels);
+    }
+
+    std::printf("\nSpikes have %d samples per channel. Allocations per event count the heap and the message pool;\n"
+        "%lld pool buffers were allocated in all.\n", NUM_SAMPLES, (long long) pool->getNumAllocated());
+
+    return 0;
+}
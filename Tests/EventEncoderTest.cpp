@@ -0,0 +1,323 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "EventEncoder.h"
+#include "TestHarness.h"
+
+#include <memory>
+#include <vector>
+
+/**
+
+ Checks what EventEncoder captures and writes for TTL events and spikes in
+ each format: the JSON text, the Compact header and its sequence numbers,
+ Raw Binary as serialized by the event itself, spikes trimmed to the
+ channels around their peak, and records that don't fit.
+
+ */
+
+namespace
+{
+    typedef EventEncoder::ChannelEncoding ChannelEncoding;
+    typedef EventEncoder::EventRecord EventRecord;
+
+    const int BUFFER_SIZE = 64 * 1024;
+
+    EventEncoder::Settings makeSettings(EventEncoder::Format format)
+    {
+        EventEncoder::Settings settings = {};
+        settings.format = format;
+        settings.neighbourhoods.add(Array<uint16>());
+        return settings;
+    }
+
+    const EventRecord& getRecord(const std::vector<char>& buffer)
+    {
+        return *reinterpret_cast<const EventRecord*>(buffer.data());
+    }
+
+    const char* getPayload(const std::vector<char>& buffer)
+    {
+        return buffer.data() + sizeof(EventRecord);
+    }
+
+    std::string writeJSON(const ChannelEncoding& encoding, const std::vector<char>& buffer)
+    {
+        MemoryOutputStream stream;
+        EventEncoder::writeJSON(encoding, getRecord(buffer), getPayload(buffer), stream);
+        return stream.toString().text;
+    }
+
+    /** An electrode of numChannels channels, each with a spike whose trough is deepest on peakChannel */
+    struct Electrode
+    {
+        Electrode(int numChannels, int numSamples, int peakChannel)
+        {
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                sources.emplace_back(new ContinuousChannel("CH" + String(std::to_string(ch + 1)), ch == 0 ? 0.5f : 0.195f));
+                sourceChannels.add(sources.back().get());
+            }
+
+            channel.reset(new SpikeChannel("Electrode 1", "Probe/A", 105, 30000.0f, sourceChannels, 2, numSamples - 2));
+            spike.reset(new Spike(channel.get(), numChannels, numSamples, 4321));
+            spike->setSortedId(7);
+
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                float* samples = spike->getDataPointer(ch);
+                for (int s = 0; s < numSamples; s++)
+                {
+                    samples[s] = s == 2 ? -10.0f - (ch == peakChannel ? 40.0f : (float) ch) : (float) s;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<ContinuousChannel>> sources;
+        Array<const ContinuousChannel*> sourceChannels;
+        std::unique_ptr<SpikeChannel> channel;
+        std::unique_ptr<Spike> spike;
+    };
+
+    void testTtlJson()
+    {
+        EventChannel channel("TTL in", "Probe/A", 104, 30000.0f);
+        channel.addEventMetadata(MetadataDescriptor(BaseType::UINT16, 2, "codes"));
+        channel.addEventMetadata(MetadataDescriptor(BaseType::CHAR, 8, "label"));
+        std::unique_ptr<ChannelEncoding> encoding(EventEncoder::createEncoding(&channel, 3));
+
+        expectEquals(encoding->index, 3);
+        expectEquals(encoding->topic.toString(), String("ttl/Probe_A/"));
+        expectEquals(encoding->metadataSize, (size_t) 12);
+
+        TTLEvent event(&channel, 1234, 5, true);
+        const uint16 codes[2] = { 7, 65535 };
+        memcpy(event.getMetadataValue(0)->getRawValuePointer(), codes, sizeof(codes));
+        memcpy(event.getMetadataValue(1)->getRawValuePointer(), "on\0\0\0\0\0\0", 8);
+
+        EventEncoder encoder;
+        encoder.resetEncoding(false, false);
+
+        std::vector<char> buffer(BUFFER_SIZE);
+        const int size = encoder.captureEvent(event, *encoding, makeSettings(EventEncoder::JSON_STRING), buffer.data(), BUFFER_SIZE);
+
+        expectEquals(size, (int) (sizeof(EventRecord) + 12));
+        expectEquals(getRecord(buffer).captureTicks, 0);
+        expectEquals(writeJSON(*encoding, buffer), std::string(
+            "{\"event_type\":\"ttl\",\"stream\":\"Probe/A\",\"source_node\":104,\"sample_rate\":30000,"
+            "\"channel_name\":\"TTL in\",\"sample_number\":1234,\"line\":5,\"state\":true,"
+            "\"metadata\":{\"codes\":[7,65535],\"label\":\"on\"}}"));
+    }
+
+    void testMissingMetadata()
+    {
+        EventChannel channel("TTL in", "Probe/A", 104, 30000.0f);
+        channel.addEventMetadata(MetadataDescriptor(BaseType::UINT16, 2, "codes"));
+        channel.addEventMetadata(MetadataDescriptor(BaseType::INT32, 1, "trial"));
+        std::unique_ptr<ChannelEncoding> encoding(EventEncoder::createEncoding(&channel, 0));
+
+        // an event with only the first of the channel's values
+        EventChannel shorter("TTL in", "Probe/A", 104, 30000.0f);
+        shorter.addEventMetadata(MetadataDescriptor(BaseType::UINT16, 2, "codes"));
+        TTLEvent event(&shorter, 10, 1, true);
+        const uint16 codes[2] = { 3, 4 };
+        memcpy(event.getMetadataValue(0)->getRawValuePointer(), codes, sizeof(codes));
+
+        // a buffer still holding an earlier record
+        EventEncoder encoder;
+        std::vector<char> buffer(BUFFER_SIZE, (char) 0x7f);
+        encoder.captureEvent(event, *encoding, makeSettings(EventEncoder::JSON_STRING), buffer.data(), BUFFER_SIZE);
+
+        expectEquals(writeJSON(*encoding, buffer), std::string(
+            "{\"event_type\":\"ttl\",\"stream\":\"Probe/A\",\"source_node\":104,\"sample_rate\":30000,"
+            "\"channel_name\":\"TTL in\",\"sample_number\":10,\"line\":1,\"state\":true,"
+            "\"metadata\":{\"codes\":[3,4],\"trial\":0}}"));
+    }
+
+    void testTtlCompactAndRaw()
+    {
+        EventChannel channel("TTL in", "Probe/A", 104, 30000.0f);
+        std::unique_ptr<ChannelEncoding> encoding(EventEncoder::createEncoding(&channel, 1));
+
+        EventEncoder encoder;
+        encoder.resetEncoding(true, false);
+
+        std::vector<char> buffer(BUFFER_SIZE);
+        const EventEncoder::Settings compact = makeSettings(EventEncoder::COMPACT_BINARY);
+
+        for (int i = 0; i < 3; i++)
+        {
+            TTLEvent event(&channel, 100 + i, 2, i == 1);
+            const int size = encoder.captureEvent(event, *encoding, compact, buffer.data(), BUFFER_SIZE);
+            expectEquals(size, (int) (sizeof(EventRecord) + COMPACT_TTL_SIZE));
+            expect(getRecord(buffer).captureTicks != 0);
+
+            CompactHeader header;
+            memcpy(&header, getPayload(buffer), sizeof(header));
+            expectEquals(header.magic, COMPACT_MAGIC);
+            expectEquals((int) header.type, 0);
+            expectEquals(header.channelIndex, 1);
+            expectEquals(header.sequence, (uint64) i);
+            expectEquals(header.sampleNumber, 100 + i);
+
+            CompactTtl ttl;
+            memcpy(&ttl, getPayload(buffer) + sizeof(CompactHeader), sizeof(ttl));
+            expectEquals((int) ttl.line, 2);
+            expectEquals((int) ttl.state, i == 1 ? 1 : 0);
+        }
+
+        // lines beyond a byte aren't wrapped
+        TTLEvent highLine(&channel, 150, 300, true);
+        encoder.captureEvent(highLine, *encoding, compact, buffer.data(), BUFFER_SIZE);
+
+        CompactTtl ttl;
+        memcpy(&ttl, getPayload(buffer) + sizeof(CompactHeader), sizeof(ttl));
+        expectEquals(ttl.line, (uint32) 300);
+
+        // a new acquisition numbers from 0 again
+        encoder.resetEncoding(false, false);
+        TTLEvent event(&channel, 200, 2, true);
+        encoder.captureEvent(event, *encoding, compact, buffer.data(), BUFFER_SIZE);
+
+        CompactHeader header;
+        memcpy(&header, getPayload(buffer), sizeof(header));
+        expectEquals(header.sequence, (uint64) 0);
+
+        // Raw Binary is the event's own serialization
+        const int size = encoder.captureEvent(event, *encoding, makeSettings(EventEncoder::RAW_BINARY), buffer.data(), BUFFER_SIZE);
+        expectEquals(size, (int) (sizeof(EventRecord) + encoding->rawSize));
+
+        std::vector<char> serialized(encoding->rawSize);
+        event.serialize(serialized.data(), serialized.size());
+        expect(memcmp(getPayload(buffer), serialized.data(), serialized.size()) == 0);
+
+        // nothing is written past a buffer that's too small
+        std::vector<char> small(sizeof(EventRecord) + encoding->rawSize - 1, 'x');
+        expectEquals(encoder.captureEvent(event, *encoding, makeSettings(EventEncoder::RAW_BINARY), small.data(), (int) small.size()), 0);
+        expect(small.front() == 'x' && small.back() == 'x');
+    }
+
+    void testSpikeJson()
+    {
+        Electrode electrode(4, 6, 2);
+        std::unique_ptr<ChannelEncoding> encoding(EventEncoder::createEncoding(electrode.channel.get(), 0));
+
+        expectEquals(encoding->topic.toString(), String("spike/Probe_A/Electrode 1"));
+        expectEquals(encoding->waveformScale, 0.5f);
+
+        EventEncoder encoder;
+        encoder.resetEncoding(false, false);
+        std::vector<char> buffer(BUFFER_SIZE);
+
+        // every channel
+        EventEncoder::Settings settings = makeSettings(EventEncoder::JSON_STRING);
+        encoder.captureSpike(*electrode.spike, *encoding, settings, buffer.data(), BUFFER_SIZE);
+        expectEquals(writeJSON(*encoding, buffer), std::string(
+            "{\"event_type\":\"spike\",\"stream\":\"Probe/A\",\"source_node\":105,\"electrode\":\"Electrode 1\","
+            "\"num_channels\":4,\"sample_rate\":30000,\"sample_number\":4321,\"sorted_id\":7,"
+            "\"trough\":-50,\"peak\":5,\"amp1\":15,\"amp2\":16,\"amp3\":55,\"amp4\":18}"));
+
+        // the peak channel and the one after it
+        settings.neighbourChannels = 2;
+        settings.neighbourhoods.getReference(0) = EventEncoder::buildNeighbourhoods(4, 2);
+        encoder.captureSpike(*electrode.spike, *encoding, settings, buffer.data(), BUFFER_SIZE);
+        expectEquals((int) getRecord(buffer).numChannels, 2);
+        expectEquals(writeJSON(*encoding, buffer), std::string(
+            "{\"event_type\":\"spike\",\"stream\":\"Probe/A\",\"source_node\":105,\"electrode\":\"Electrode 1\","
+            "\"num_channels\":4,\"sample_rate\":30000,\"sample_number\":4321,\"sorted_id\":7,"
+            "\"trough\":-50,\"peak\":5,\"amp3\":55,\"amp4\":18}"));
+    }
+
+    void testSpikeCompact()
+    {
+        Electrode electrode(8, 5, 7);
+        std::unique_ptr<ChannelEncoding> encoding(EventEncoder::createEncoding(electrode.channel.get(), 0));
+
+        EventEncoder encoder;
+        encoder.resetEncoding(false, true);
+        std::vector<char> buffer(BUFFER_SIZE);
+
+        EventEncoder::Settings settings = makeSettings(EventEncoder::COMPACT_BINARY);
+        settings.batchEnabled = true;
+        settings.quantizeWaveforms = true;
+        settings.neighbourChannels = 3;
+        settings.neighbourhoods.getReference(0) = EventEncoder::buildNeighbourhoods(8, 3);
+
+        const int size = encoder.captureSpike(*electrode.spike, *encoding, settings, buffer.data(), BUFFER_SIZE);
+        const EventRecord& record = getRecord(buffer);
+        expect(record.columnar);
+        expectEquals(size, (int) (sizeof(EventRecord) + COMPACT_WAVEFORM_OFFSET + 3 * 5 * sizeof(int16) + 3 * sizeof(uint16)));
+        expect(record.payloadSize <= encoding->compactSize);
+
+        CompactSpike body;
+        memcpy(&body, getPayload(buffer) + sizeof(CompactHeader), sizeof(body));
+        expectEquals((int) body.sortedId, 7);
+        expectEquals((int) body.numChannels, 3);
+        expectEquals((int) body.numSamples, 5);
+        expectEquals((int) body.sampleFormat, (int) COMPACT_SAMPLES_INT16);
+        expectEquals((int) body.channelSubset, 1);
+        expectEquals(body.scale, 0.5f);
+
+        // the last three channels, as the peak is on the last one
+        uint16 channels[3];
+        memcpy(channels, getPayload(buffer) + COMPACT_WAVEFORM_OFFSET + 3 * 5 * sizeof(int16), sizeof(channels));
+        expectEquals((int) channels[0], 5);
+        expectEquals((int) channels[1], 6);
+        expectEquals((int) channels[2], 7);
+
+        int16 trough;
+        memcpy(&trough, getPayload(buffer) + COMPACT_WAVEFORM_OFFSET + (2 * 5 + 2) * sizeof(int16), sizeof(trough));
+        expectEquals((int) trough, -100);
+
+        // Raw Binary always sends every channel
+        settings.format = EventEncoder::RAW_BINARY;
+        expectEquals(encoder.captureSpike(*electrode.spike, *encoding, settings, buffer.data(), BUFFER_SIZE),
+            (int) (sizeof(EventRecord) + encoding->rawSize));
+    }
+
+    void testNeighbourhoods()
+    {
+        const Array<uint16> neighbourhoods = EventEncoder::buildNeighbourhoods(6, 3);
+        const uint16 expected[] = { 0, 1, 2,  0, 1, 2,  1, 2, 3,  2, 3, 4,  3, 4, 5,  3, 4, 5 };
+
+        expectEquals(neighbourhoods.size(), 18);
+        for (int i = 0; i < neighbourhoods.size(); i++)
+        {
+            expectEquals((int) neighbourhoods.getUnchecked(i), (int) expected[i]);
+        }
+    }
+}
+
+int main()
+{
+    testTtlJson();
+    testMissingMetadata();
+    testTtlCompactAndRaw();
+    testSpikeJson();
+    testSpikeCompact();
+    testNeighbourhoods();
+
+    return TestHarness::finish("EventEncoderTest");
+}
@@ -0,0 +1,218 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "JsonWriter.h"
+#include "MessagePool.h"
+#include "Benchmark.h"
+#include "LegacyJson.h"
+
+/**
+
+ Compares encoding TTL and spike messages with JsonWriter, as the plugin
+ does now, against building a DynamicObject and formatting it with
+ JSON::toString, as it used to (see LegacyJson.h).
+
+ The streamed messages go into a pooled MessageStream with their constant
+ prefix written in advance, like EventBroadcaster::writeJSON(); the legacy
+ ones set every property for every message, like the old sendEvent().
+
+ */
+
+namespace
+{
+    struct Result
+    {
+        double nanos;
+        double allocations;
+        double bytes;
+    };
+
+    template <typename Encode>
+    Result measure(Encode&& encode)
+    {
+        size_t bytes = 0;
+        const int64_t allocationsBefore = Benchmark::getNumHeapAllocations();
+        int64_t iterations = 0;
+
+        const double nanos = Benchmark::nanosPerIteration([&](int64_t count)
+        {
+            for (int64_t i = 0; i < count; i++)
+            {
+                bytes = encode(i);
+            }
+            iterations += count;
+        });
+
+        return { nanos, (double) (Benchmark::getNumHeapAllocations() - allocationsBefore) / (double) iterations, (double) bytes };
+    }
+
+    void printRow(const char* message, int numChannels, const Result& legacy, const Result& streamed)
+    {
+        std::printf("%-6s %5d   %10.0f %8.1f %8.0f   %10.0f %8.2f %8.0f   %7.1fx\n",
+            message, numChannels,
+            legacy.nanos, legacy.allocations, legacy.bytes,
+            streamed.nanos, streamed.allocations, streamed.bytes,
+            legacy.nanos / streamed.nanos);
+    }
+
+    void benchmarkTtl(MessagePool* pool)
+    {
+        Result legacy = measure([](int64_t i)
+        {
+            LegacyVar message;
+            message.setProperty("event_type", "ttl");
+            message.setProperty("stream", std::string("Neuropix-PXI-100.ProbeA-AP"));
+            message.setProperty("source_node", 104);
+            message.setProperty("sample_rate", 30000.0f);
+            message.setProperty("channel_name", std::string("Neuropix-PXI-100.ProbeA-AP TTL"));
+            message.setProperty("sample_number", (int64_t) (1000000 + i));
+            message.setProperty("line", (int) (i & 7));
+            message.setProperty("state", (i & 1) != 0);
+
+            const std::string json = message.toString();
+            Benchmark::keep(json.data());
+            return json.size();
+        });
+
+        MemoryBlock prefix;
+        {
+            MemoryOutputStream prefixStream(prefix, false);
+            JsonWriter json(prefixStream);
+            json.beginObject();
+            json.key("event_type");     json.value("ttl", 3);
+            json.key("stream");         json.value(String("Neuropix-PXI-100.ProbeA-AP"));
+            json.key("source_node");    json.value(104);
+            json.key("sample_rate");    json.value(30000.0f);
+            json.key("channel_name");   json.value(String("Neuropix-PXI-100.ProbeA-AP TTL"));
+        }
+
+        MessageStream stream(pool);
+
+        Result streamed = measure([&](int64_t i)
+        {
+            JsonWriter json(stream);
+            json.resumeObject(prefix.getData(), prefix.getSize());
+            json.key("sample_number");  json.value((int64) (1000000 + i));
+            json.key("line");           json.value((int) (i & 7));
+            json.key("state");          json.value((i & 1) != 0);
+            json.endObject();
+
+            // handed to ZMQ, which releases it once it's sent
+            const size_t size = stream.getDataSize();
+            MessagePool::release(stream.release());
+            return size;
+        });
+
+        printRow("TTL", 0, legacy, streamed);
+    }
+
+    void benchmarkSpike(MessagePool* pool, int numChannels)
+    {
+        std::vector<float> amplitudes((size_t) numChannels);
+        for (int ch = 0; ch < numChannels; ch++)
+        {
+            amplitudes[(size_t) ch] = 40.0f + 0.37f * (float) ch;
+        }
+
+        Result legacy = measure([&](int64_t i)
+        {
+            LegacyVar message;
+            message.setProperty("event_type", "spike");
+            message.setProperty("stream", std::string("Neuropix-PXI-100.ProbeA-AP"));
+            message.setProperty("source_node", 105);
+            message.setProperty("electrode", std::string("Electrode 1"));
+            message.setProperty("num_channels", numChannels);
+            message.setProperty("sample_rate", 30000.0f);
+            message.setProperty("sample_number", (int64_t) (1000000 + i));
+            message.setProperty("sorted_id", 0);
+
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                message.setProperty("amp" + std::to_string(ch + 1), amplitudes[(size_t) ch]);
+            }
+
+            const std::string json = message.toString();
+            Benchmark::keep(json.data());
+            return json.size();
+        });
+
+        MemoryBlock prefix;
+        {
+            MemoryOutputStream prefixStream(prefix, false);
+            JsonWriter json(prefixStream);
+            json.beginObject();
+            json.key("event_type");     json.value("spike", 5);
+            json.key("stream");         json.value(String("Neuropix-PXI-100.ProbeA-AP"));
+            json.key("source_node");    json.value(105);
+            json.key("electrode");      json.value(String("Electrode 1"));
+            json.key("num_channels");   json.value(numChannels);
+            json.key("sample_rate");    json.value(30000.0f);
+        }
+
+        MessageStream stream(pool);
+
+        Result streamed = measure([&](int64_t i)
+        {
+            JsonWriter json(stream);
+            json.resumeObject(prefix.getData(), prefix.getSize());
+            json.key("sample_number");  json.value((int64) (1000000 + i));
+            json.key("sorted_id");      json.value(0);
+
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                json.key("amp", ch + 1);
+                json.value(amplitudes[(size_t) ch]);
+            }
+
+            json.endObject();
+
+            const size_t size = stream.getDataSize();
+            MessagePool::release(stream.release());
+            return size;
+        });
+
+        printRow("spike", numChannels, legacy, streamed);
+    }
+}
+
+int main()
+{
+    MessagePool::Ptr pool = new MessagePool();
+
+    std::printf("                 ------- LegacyJson -------    -------- JsonWriter -------\n");
+    std::printf("message  chans     ns/msg  allocs    bytes       ns/msg  allocs    bytes   speedup\n");
+
+    benchmarkTtl(pool);
+
+    for (int numChannels : { 1, 4, 32, 384 })
+    {
+        benchmarkSpike(pool, numChannels);
+    }
+
+    std::printf("\nJsonWriter allocations are pool buffers; %lld were taken from the heap in all.\n",
+        (long long) pool->getNumAllocated());
+
+    return 0;
+}
@@ -0,0 +1,440 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "JsonWriter.h"
+#include "LegacyJson.h"
+#include "TestHarness.h"
+
+#include <limits>
+#include <vector>
+
+/**
+
+ Checks that JsonWriter encodes messages exactly as the DynamicObject and
+ JSON::toString path did (see LegacyJson.h): the same tokens in the same
+ order, with keys and strings that decode to the same bytes. Only the
+ whitespace between tokens and the spelling of numbers may differ; numbers
+ must have the same value, and floats, which the old path widened to
+ double, must come back as the same float.
+
+ */
+
+namespace
+{
+    struct Token
+    {
+        enum Kind { PUNCTUATION, STRING, NUMBER, LITERAL, INVALID };
+
+        Kind kind;
+        std::string text;   // decoded, for strings
+    };
+
+    void appendUTF8(std::string& out, uint32_t c)
+    {
+        if (c < 0x80)
+        {
+            out += (char) c;
+        }
+        else if (c < 0x800)
+        {
+            out += (char) (0xC0 | (c >> 6));
+            out += (char) (0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            out += (char) (0xE0 | (c >> 12));
+            out += (char) (0x80 | ((c >> 6) & 0x3F));
+            out += (char) (0x80 | (c & 0x3F));
+        }
+        else
+        {
+            out += (char) (0xF0 | (c >> 18));
+            out += (char) (0x80 | ((c >> 12) & 0x3F));
+            out += (char) (0x80 | ((c >> 6) & 0x3F));
+            out += (char) (0x80 | (c & 0x3F));
+        }
+    }
+
+    uint32_t readHex4(const std::string& json, size_t& i)
+    {
+        uint32_t value = (uint32_t) std::stoul(json.substr(i, 4), nullptr, 16);
+        i += 4;
+        return value;
+    }
+
+    std::vector<Token> tokenize(const std::string& json)
+    {
+        std::vector<Token> tokens;
+        size_t i = 0;
+
+        while (i < json.size())
+        {
+            const char c = json[i];
+
+            if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+            {
+                ++i;
+            }
+            else if (std::strchr("{}[]:,", c) != nullptr)
+            {
+                tokens.push_back({ Token::PUNCTUATION, std::string(1, c) });
+                ++i;
+            }
+            else if (c == '"')
+            {
+                std::string text;
+                ++i;
+
+                while (i < json.size() && json[i] != '"')
+                {
+                    if (json[i] != '\\')
+                    {
+                        // control characters have to be escaped
+                        if ((unsigned char) json[i] < 0x20)
+                        {
+                            return { { Token::INVALID, json.substr(i) } };
+                        }
+                        text += json[i++];
+                        continue;
+                    }
+
+                    const char escape = json[i + 1];
+                    i += 2;
+
+                    switch (escape)
+                    {
+                    case '"':   text += '"'; break;
+                    case '\\':  text += '\\'; break;
+                    case '/':   text += '/'; break;
+                    case 'a':   text += '\a'; break;
+                    case 'b':   text += '\b'; break;
+                    case 'f':   text += '\f'; break;
+                    case 'n':   text += '\n'; break;
+                    case 'r':   text += '\r'; break;
+                    case 't':   text += '\t'; break;
+                    case 'u':
+                    {
+                        uint32_t codePoint = readHex4(json, i);
+                        if (codePoint >= 0xD800 && codePoint < 0xDC00 && json.compare(i, 2, "\\u") == 0)
+                        {
+                            i += 2;
+                            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (readHex4(json, i) - 0xDC00);
+                        }
+                        appendUTF8(text, codePoint);
+                        break;
+                    }
+                    default:
+                        return { { Token::INVALID, json.substr(i - 2) } };
+                    }
+                }
+
+                tokens.push_back({ Token::STRING, text });
+                ++i;
+            }
+            else
+            {
+                const size_t start = i;
+                while (i < json.size() && std::strchr("{}[]:,\" \n\r\t", json[i]) == nullptr)
+                {
+                    ++i;
+                }
+
+                const std::string word = json.substr(start, i - start);
+                tokens.push_back({ word == "true" || word == "false" || word == "null" ? Token::LITERAL : Token::NUMBER, word });
+            }
+        }
+
+        return tokens;
+    }
+
+    bool isInteger(const std::string& number)
+    {
+        return number.find_first_of(".eE") == std::string::npos;
+    }
+
+    bool numbersMatch(const std::string& legacy, const std::string& streamed)
+    {
+        if (isInteger(legacy) && isInteger(streamed))
+        {
+            return legacy == streamed;     // doubles can't hold every int64
+        }
+
+        const double legacyValue = std::strtod(legacy.c_str(), nullptr);
+        const double streamedValue = std::strtod(streamed.c_str(), nullptr);
+
+        if (legacyValue == streamedValue)
+        {
+            return true;
+        }
+
+        // a float the old path widened to double, written as the shortest text for that float
+        return legacyValue == (double) (float) legacyValue
+            && (float) streamedValue == (float) legacyValue;
+    }
+
+    /** Checks that the two encodings match token for token; returns false, describing the first difference, if not */
+    bool encodingsMatch(const std::string& legacy, const std::string& streamed, std::string& difference)
+    {
+        const std::vector<Token> legacyTokens = tokenize(legacy);
+        const std::vector<Token> streamedTokens = tokenize(streamed);
+
+        for (size_t i = 0; i < std::max(legacyTokens.size(), streamedTokens.size()); i++)
+        {
+            if (i >= legacyTokens.size() || i >= streamedTokens.size())
+            {
+                difference = "different number of tokens";
+                return false;
+            }
+
+            const Token& a = legacyTokens[i];
+            const Token& b = streamedTokens[i];
+
+            const bool same = a.kind == b.kind && a.kind != Token::INVALID
+                && (a.kind == Token::NUMBER ? numbersMatch(a.text, b.text) : a.text == b.text);
+
+            if (!same)
+            {
+                difference = "token " + std::to_string(i) + ": '" + a.text + "' became '" + b.text + "'";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::string toString(const MemoryOutputStream& stream)
+    {
+        return std::string(static_cast<const char*>(stream.getData()), stream.getDataSize());
+    }
+
+    void expectMatch(const LegacyVar& legacy, const MemoryOutputStream& streamed, const char* what)
+    {
+        std::string difference;
+        if (!encodingsMatch(legacy.toString(), toString(streamed), difference))
+        {
+            TestHarness::fail(__FILE__, __LINE__, std::string(what) + ": " + difference
+                + "\n  legacy:   " + legacy.toString() + "\n  streamed: " + toString(streamed));
+        }
+    }
+
+    // names and text that need every kind of escaping
+    const std::vector<std::string> awkwardText =
+    {
+        "",
+        "plain",
+        "Neuropix-PXI-100.ProbeA-AP",
+        "quote \" and backslash \\ and slash /",
+        "tab\tnewline\nreturn\rbell\abackspace\bformfeed\f",
+        "\x01\x02\x1f and \x7f",
+        "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\xa7\xa0",       // two, three and four byte UTF-8
+    };
+
+    void testTtlMessage()
+    {
+        for (auto& name : awkwardText)
+        {
+            LegacyVar legacy;
+            legacy.setProperty("event_type", "ttl");
+            legacy.setProperty("stream", name);
+            legacy.setProperty("source_node", 104);
+            legacy.setProperty("sample_rate", 30000.0f);
+            legacy.setProperty("channel_name", name + " TTL");
+            legacy.setProperty("sample_number", (int64_t) 1234567890123);
+            legacy.setProperty("line", 7);
+            legacy.setProperty("state", true);
+
+            // the prefix is written once in updateSettings(), the rest for each event
+            MemoryBlock prefix;
+            {
+                MemoryOutputStream prefixStream(prefix, false);
+                JsonWriter json(prefixStream);
+                json.beginObject();
+                json.key("event_type");     json.value("ttl", 3);
+                json.key("stream");         json.value(String(name));
+                json.key("source_node");    json.value(104);
+                json.key("sample_rate");    json.value(30000.0f);
+                json.key("channel_name");   json.value(String(name + " TTL"));
+            }
+
+            MemoryOutputStream streamed;
+            JsonWriter json(streamed);
+            json.resumeObject(prefix.getData(), prefix.getSize());
+            json.key("sample_number");  json.value((int64) 1234567890123);
+            json.key("line");           json.value(7);
+            json.key("state");          json.value(true);
+            json.endObject();
+
+            expectMatch(legacy, streamed, "TTL message");
+        }
+    }
+
+    void testSpikeMessage()
+    {
+        for (int numChannels : { 1, 4, 32, 384 })
+        {
+            LegacyVar legacy;
+            legacy.setProperty("event_type", "spike");
+            legacy.setProperty("stream", "example_data");
+            legacy.setProperty("source_node", 105);
+            legacy.setProperty("electrode", "Tetrode 1");
+            legacy.setProperty("num_channels", numChannels);
+            legacy.setProperty("sample_rate", 30000.0f);
+            legacy.setProperty("sample_number", (int64_t) -1);
+            legacy.setProperty("sorted_id", 0);
+
+            MemoryOutputStream streamed;
+            JsonWriter json(streamed);
+            json.beginObject();
+            json.key("event_type");     json.value("spike", 5);
+            json.key("stream");         json.value(String("example_data"));
+            json.key("source_node");    json.value(105);
+            json.key("electrode");      json.value(String("Tetrode 1"));
+            json.key("num_channels");   json.value(numChannels);
+            json.key("sample_rate");    json.value(30000.0f);
+            json.key("sample_number");  json.value((int64) -1);
+            json.key("sorted_id");      json.value(0);
+
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                // values whose shortest float and double spellings differ
+                const float amplitude = 0.1f * (float) ch - 12.345678f;
+
+                legacy.setProperty("amp" + std::to_string(ch + 1), amplitude);
+                json.key("amp", ch + 1);
+                json.value(amplitude);
+            }
+
+            json.endObject();
+
+            expectMatch(legacy, streamed, "spike message");
+        }
+    }
+
+    void testMetadata()
+    {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        const float infinity = std::numeric_limits<float>::infinity();
+        const double doubleNaN = std::numeric_limits<double>::quiet_NaN();
+
+        LegacyVar metadata;
+        metadata.setProperty("float", 1.0f / 3.0f);
+        metadata.setProperty("double", 1.0 / 3.0);
+        metadata.setProperty("tiny", std::numeric_limits<float>::denorm_min());
+        metadata.setProperty("huge", std::numeric_limits<double>::max());
+        metadata.setProperty("negative_zero", -0.0);
+        metadata.setProperty("float_nan", nan);
+        metadata.setProperty("float_inf", infinity);
+        metadata.setProperty("float_minus_inf", -infinity);
+        metadata.setProperty("double_nan", doubleNaN);
+        metadata.setProperty("int64_min", std::numeric_limits<int64_t>::min());
+        metadata.setProperty("int64_max", std::numeric_limits<int64_t>::max());
+        metadata.setProperty("uint32_max", (int64_t) 4294967295u);
+        metadata.setProperty("values", LegacyVar::array({ 1.5f, nan, -infinity, 2.0f }));
+        metadata.setProperty("no_values", LegacyVar::array({}));
+
+        for (auto& text : awkwardText)
+        {
+            metadata.setProperty(text + " key", text);
+        }
+
+        LegacyVar legacy;
+        legacy.setProperty("sample_number", (int64_t) 0);
+        legacy.setProperty("metadata", metadata);
+
+        MemoryOutputStream streamed;
+        JsonWriter json(streamed);
+        json.beginObject();
+        json.key("sample_number");      json.value((int64) 0);
+        json.key("metadata");
+        json.beginObject();
+        json.key("float");              json.value(1.0f / 3.0f);
+        json.key("double");             json.value(1.0 / 3.0);
+        json.key("tiny");               json.value(std::numeric_limits<float>::denorm_min());
+        json.key("huge");               json.value(std::numeric_limits<double>::max());
+        json.key("negative_zero");      json.value(-0.0);
+        json.key("float_nan");          json.value(nan);
+        json.key("float_inf");          json.value(infinity);
+        json.key("float_minus_inf");    json.value(-infinity);
+        json.key("double_nan");         json.value(doubleNaN);
+        json.key("int64_min");          json.value(std::numeric_limits<int64>::min());
+        json.key("int64_max");          json.value(std::numeric_limits<int64>::max());
+        json.key("uint32_max");         json.value((int64) 4294967295u);
+        json.key("values");
+        json.beginArray();
+        json.value(1.5f);
+        json.value(nan);
+        json.value(-infinity);
+        json.value(2.0f);
+        json.endArray();
+        json.key("no_values");
+        json.beginArray();
+        json.endArray();
+
+        for (auto& text : awkwardText)
+        {
+            json.key(String(text + " key"));
+            json.value(text.data(), text.size());
+        }
+
+        json.endObject();
+        json.endObject();
+
+        expectMatch(legacy, streamed, "metadata");
+    }
+
+    void testExactOutput()
+    {
+        // the streamed form is compact, which the checks above can't see
+        MemoryOutputStream streamed;
+        JsonWriter json(streamed);
+        json.beginObject();
+        json.key("a");      json.value(1);
+        json.key("b");
+        json.beginArray();
+        json.value(0.5f);
+        json.value(std::numeric_limits<double>::infinity());
+        json.value(false);
+        json.endArray();
+        json.key("c");
+        json.beginObject();
+        json.key("d", 12);  json.null();
+        json.endObject();
+        json.key(String("\"e\""));
+        json.value(std::numeric_limits<uint64>::max());
+        json.endObject();
+
+        expectEquals(toString(streamed), std::string("{\"a\":1,\"b\":[0.5,null,false],\"c\":{\"d12\":null},\"\\\"e\\\"\":18446744073709551615}"));
+    }
+}
+
+int main()
+{
+    testTtlMessage();
+    testSpikeMessage();
+    testMetadata();
+    testExactOutput();
+
+    return TestHarness::finish("JsonWriterTest");
+}
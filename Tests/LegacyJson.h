@@ -0,0 +1,220 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LEGACYJSON_H_INCLUDED
+#define LEGACYJSON_H_INCLUDED
+
+/**
+
+ The way messages were encoded before JsonWriter, for comparing against:
+ a DynamicObject whose properties are kept in the order they were first
+ set, holding vars (int, int64, double, bool, String or an array of them),
+ formatted the way JSON::toString formats them. Floats are stored as the
+ doubles they convert to, as var did.
+
+ It allocates the way the old path did, too: a heap string for each name
+ and text value, a node per property, and a growing output string, so the
+ benchmark can compare the two.
+
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class LegacyVar
+{
+public:
+    enum Type { VOID, INT, INT64, DOUBLE, BOOL, STRING, ARRAY, OBJECT };
+
+    LegacyVar() : type(VOID) {}
+    LegacyVar(int value) : type(INT), integer(value) {}
+    LegacyVar(int64_t value) : type(INT64), integer(value) {}
+    LegacyVar(double value) : type(DOUBLE), number(value) {}
+    LegacyVar(float value) : type(DOUBLE), number(value) {}
+    LegacyVar(bool value) : type(BOOL), integer(value ? 1 : 0) {}
+    LegacyVar(const char* value) : type(STRING), text(value) {}
+    LegacyVar(const std::string& value) : type(STRING), text(value) {}
+
+    static LegacyVar array(std::vector<LegacyVar> elements)
+    {
+        LegacyVar v;
+        v.type = ARRAY;
+        v.elements = std::make_shared<std::vector<LegacyVar>>(std::move(elements));
+        return v;
+    }
+
+    /** Adds a property, or replaces its value where it was first set */
+    LegacyVar& setProperty(const std::string& name, const LegacyVar& value)
+    {
+        if (type != OBJECT)
+        {
+            type = OBJECT;
+            properties = std::make_shared<std::vector<std::pair<std::string, LegacyVar>>>();
+        }
+
+        for (auto& property : *properties)
+        {
+            if (property.first == name)
+            {
+                property.second = value;
+                return *this;
+            }
+        }
+
+        properties->emplace_back(name, value);
+        return *this;
+    }
+
+    /** Formats the value as JSON::toString(var, false) would */
+    std::string toString() const
+    {
+        std::string out;
+        write(out, 0);
+        return out;
+    }
+
+private:
+    static const int indentSize = 2;
+
+    void write(std::string& out, int indentLevel) const
+    {
+        switch (type)
+        {
+        case VOID:      out += "null"; break;
+        case INT:
+        case INT64:     out += std::to_string(integer); break;
+        case BOOL:      out += integer != 0 ? "true" : "false"; break;
+        case STRING:    writeString(out, text); break;
+
+        case DOUBLE:
+            if (std::isfinite(number))
+            {
+                char digits[32];
+                std::snprintf(digits, sizeof(digits), "%.17g", number);
+                out += digits;
+            }
+            else
+            {
+                out += "null";
+            }
+            break;
+
+        case ARRAY:
+            out += '[';
+            for (size_t i = 0; i < elements->size(); i++)
+            {
+                if (i > 0)
+                    out += ", ";
+                (*elements)[i].write(out, indentLevel + indentSize);
+            }
+            out += ']';
+            break;
+
+        case OBJECT:
+            out += "{\n";
+            for (size_t i = 0; i < properties->size(); i++)
+            {
+                out.append((size_t) (indentLevel + indentSize), ' ');
+                writeString(out, (*properties)[i].first);
+                out += ": ";
+                (*properties)[i].second.write(out, indentLevel + indentSize);
+                out += i + 1 < properties->size() ? ",\n" : "\n";
+            }
+            out.append((size_t) indentLevel, ' ');
+            out += '}';
+            break;
+        }
+    }
+
+    // quotes, backslashes and control characters are escaped, and
+    // everything outside printable ASCII becomes \u escapes of UTF-16
+    static void writeString(std::string& out, const std::string& utf8)
+    {
+        out += '"';
+
+        for (size_t i = 0; i < utf8.size();)
+        {
+            uint32_t c = (unsigned char) utf8[i++];
+
+            switch (c)
+            {
+            case '"':   out += "\\\""; continue;
+            case '\\':  out += "\\\\"; continue;
+            case '\a':  out += "\\a"; continue;
+            case '\b':  out += "\\b"; continue;
+            case '\f':  out += "\\f"; continue;
+            case '\n':  out += "\\n"; continue;
+            case '\r':  out += "\\r"; continue;
+            case '\t':  out += "\\t"; continue;
+            default:    break;
+            }
+
+            if (c >= 32 && c < 127)
+            {
+                out += (char) c;
+                continue;
+            }
+
+            // decode the rest of a multi-byte sequence
+            int extraBytes = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+            if (extraBytes > 0)
+                c &= 0x3F >> extraBytes;
+            while (extraBytes-- > 0 && i < utf8.size())
+                c = (c << 6) | ((unsigned char) utf8[i++] & 0x3F);
+
+            if (c >= 0x10000)
+            {
+                c -= 0x10000;
+                writeEscaped(out, 0xD800 + (c >> 10));
+                writeEscaped(out, 0xDC00 + (c & 0x3FF));
+            }
+            else
+            {
+                writeEscaped(out, c);
+            }
+        }
+
+        out += '"';
+    }
+
+    static void writeEscaped(std::string& out, uint32_t codeUnit)
+    {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int) codeUnit);
+        out += escaped;
+    }
+
+    Type type;
+    int64_t integer = 0;
+    double number = 0;
+    std::string text;
+    std::shared_ptr<std::vector<LegacyVar>> elements;
+    std::shared_ptr<std::vector<std::pair<std::string, LegacyVar>>> properties;
+};
+
+
+#endif  // LEGACYJSON_H_INCLUDED
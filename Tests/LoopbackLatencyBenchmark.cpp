@@ -0,0 +1,620 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "EventEncoder.h"
+#include "EventSender.h"
+#include "LatencyHistogram.h"
+#include "MessagePool.h"
+#include "SharedRingWriter.h"
+
+#include <zmq.h>
+
+#include <memory>
+#include <thread>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+/**
+
+ Measures the end-to-end latency of events through ZMQ: from an event
+ reaching the plugin's handler until a subscriber has received its message,
+ over each transport a subscriber can use (tcp and ipc from other processes
+ on the machine, inproc from the same one), and for comparison through the
+ shared-memory ring that readers on the same machine can use instead.
+
+ A driver thread produces TTL events or spikes at a fixed rate, arriving in
+ processing blocks as they do in the plugin. Each event is captured with
+ EventEncoder into a pooled buffer and handed to the plugin's EventSender,
+ which sends it on its own or adds it to a batch (or, for batched Compact
+ spikes, to spike columns) that goes out at the end of the block. Here the
+ finished messages go to an XPUB socket, without copying, as the plugin
+ sends them. A SUB socket on its own thread receives them and adds the
+ time since capture of each event they carry to a LatencyHistogram. For the
+ ring, EventSender writes each record into a SharedRingWriter, and a
+ SharedRingReader on its own thread waits on the futex for them.
+
+ This covers what the plugin's own profiling doesn't: the time ZMQ takes to
+ deliver a message once it has it. The rate, the length of a processing
+ block and the seconds each case runs for can be set with LOOPBACK_RATE
+ (10000 events per second by default), LOOPBACK_BLOCK_MS (1024 samples at
+ 30 kHz by default) and LOOPBACK_SECONDS (1 by default).
+
+ */
+
+namespace
+{
+    const int NUM_SAMPLES = 40;
+    const int SPIKE_CHANNELS = 32;
+
+    struct Result
+    {
+        int64 numSent;
+        int64 numReceived;
+        int64 numDropped;
+        double eventsPerSecond;
+        LatencyHistogram latency;
+    };
+
+    /** How events are captured and sent in one case */
+    struct Mode
+    {
+        const char* name;
+        EventEncoder::Format format;
+        bool batched;
+        bool spikeColumns;      // batched Compact spikes are sent as columns; spikes only
+    };
+
+    double getSetting(const char* name, double defaultValue)
+    {
+        const char* setting = std::getenv(name);
+        const double value = setting != nullptr ? std::atof(setting) : 0.0;
+        return value > 0 ? value : defaultValue;
+    }
+
+    void check(int status, const char* what)
+    {
+        if (status == -1)
+        {
+            std::fprintf(stderr, "%s: %s\n", what, zmq_strerror(zmq_errno()));
+            std::exit(1);
+        }
+    }
+
+    /** A channel, an event on it, and a way to capture that event */
+    struct Source
+    {
+        virtual ~Source() {}
+        virtual const EventEncoder::ChannelEncoding& getEncoding() const = 0;
+        virtual int capture(EventEncoder& encoder, const EventEncoder::Settings& settings, int64 sampleNumber, char* dest, int destSize) = 0;
+    };
+
+    struct TtlSource : public Source
+    {
+        TtlSource()
+            : channel("TTL in", "Probe-A", 104, 30000.0f),
+              encoding(EventEncoder::createEncoding(&channel, 0)),
+              event(&channel, 0, 1, true)
+        { }
+
+        const EventEncoder::ChannelEncoding& getEncoding() const override { return *encoding; }
+
+        int capture(EventEncoder& encoder, const EventEncoder::Settings& settings, int64 sampleNumber, char* dest, int destSize) override
+        {
+            event.setSampleNumber(sampleNumber);
+            return encoder.captureEvent(event, *encoding, settings, dest, destSize);
+        }
+
+        EventChannel channel;
+        std::unique_ptr<EventEncoder::ChannelEncoding> encoding;
+        TTLEvent event;
+    };
+
+    struct SpikeSource : public Source
+    {
+        SpikeSource()
+        {
+            for (int ch = 0; ch < SPIKE_CHANNELS; ch++)
+            {
+                sources.emplace_back(new ContinuousChannel("CH" + String(std::to_string(ch + 1)), 0.195f));
+                sourceChannels.add(sources.back().get());
+            }
+
+            channel.reset(new SpikeChannel("Electrode 1", "Probe-A", 105, 30000.0f, sourceChannels, 8, NUM_SAMPLES - 8));
+            encoding.reset(EventEncoder::createEncoding(channel.get(), 0));
+            spike.reset(new Spike(channel.get(), SPIKE_CHANNELS, NUM_SAMPLES, 0));
+
+            for (int ch = 0; ch < SPIKE_CHANNELS; ch++)
+            {
+                float* samples = spike->getDataPointer(ch);
+                for (int s = 0; s < NUM_SAMPLES; s++)
+                {
+                    samples[s] = 3.0f * std::sin(0.7f * (float) (s + ch)) - (s == 8 ? 60.0f : 0.0f);
+                }
+            }
+        }
+
+        const EventEncoder::ChannelEncoding& getEncoding() const override { return *encoding; }
+
+        int capture(EventEncoder& encoder, const EventEncoder::Settings& settings, int64 sampleNumber, char* dest, int destSize) override
+        {
+            spike->setSampleNumber(sampleNumber);
+            return encoder.captureSpike(*spike, *encoding, settings, dest, destSize);
+        }
+
+        std::vector<std::unique_ptr<ContinuousChannel>> sources;
+        Array<const ContinuousChannel*> sourceChannels;
+        std::unique_ptr<SpikeChannel> channel;
+        std::unique_ptr<EventEncoder::ChannelEncoding> encoding;
+        std::unique_ptr<Spike> spike;
+    };
+
+    /** Sends EventSender's messages out of an XPUB socket as the plugin does, noting which
+        events each one carried so that the receiver can match them to their capture times */
+    class LoopbackSender : public EventSender
+    {
+    public:
+        /** socket may be nullptr, to send nothing but what goes into the shared-memory ring */
+        LoopbackSender(void* socket_, const EventEncoder::ChannelEncoding& encoding_, int64 maxMessages)
+            : socket(socket_), encoding(encoding_), firstEvents((size_t) maxMessages), endEvents((size_t) maxMessages),
+              numCaptured(0), numAccounted(0), numDropped(0), numMessages(0)
+        { }
+
+        MessagePool* getMessagePool() const { return messagePool.get(); }
+
+        /** Call before sending each captured event */
+        void addCaptured() { ++numCaptured; }
+
+        int64 getNumDropped() const { return numDropped; }
+
+        /** Returns the number of messages sent so far; safe to call from the receiver */
+        int64 getNumMessages() const { return numMessages.load(std::memory_order_acquire); }
+
+        /** Returns the first event and one past the last event carried by the nth message sent */
+        void getEvents(int64 message, int64& first, int64& end) const
+        {
+            first = firstEvents[(size_t) message];
+            end = endEvents[(size_t) message];
+        }
+
+    protected:
+        int sendMessage(const MsgPart* parts, int numParts) override
+        {
+            // a message carries every event captured since the last one, as
+            // each case only sends one type and format
+            const int64 first = numAccounted;
+            numAccounted = numCaptured;
+
+            for (int i = 0; i < numParts; ++i)
+            {
+                if (socket == nullptr)
+                {
+                    MessagePool::release(parts[i].buffer);
+                    continue;
+                }
+
+                const MsgPart& part = parts[i];
+                const int flags = (i < numParts - 1 ? ZMQ_SNDMORE : 0) | ZMQ_DONTWAIT;
+                int status;
+
+                if (part.buffer != nullptr)
+                {
+                    zmq_msg_t msg;
+                    zmq_msg_init_data(&msg, const_cast<void*>(part.data), part.size, &MessagePool::releaseFromZMQ, part.buffer);
+
+                    status = zmq_msg_send(&msg, socket, flags);
+                    if (status == -1)
+                    {
+                        zmq_msg_close(&msg);
+                    }
+                }
+                else
+                {
+                    status = zmq_send(socket, part.data, part.size, flags);
+                }
+
+                if (status == -1)
+                {
+                    // the rest of a multi-part message is never dropped once the first part is queued
+                    for (int j = i + 1; j < numParts; ++j)
+                    {
+                        MessagePool::release(parts[j].buffer);
+                    }
+                    numDropped += numAccounted - first;
+                    return -1;
+                }
+            }
+
+            const int64 n = numMessages.load(std::memory_order_relaxed);
+            firstEvents[(size_t) n] = first;
+            endEvents[(size_t) n] = numAccounted;
+            numMessages.store(n + 1, std::memory_order_release);
+            return 0;
+        }
+
+        const EventEncoder::ChannelEncoding& getSendEncoding(uint16 channelIndex) const override
+        {
+            return encoding;
+        }
+
+    private:
+        void* socket;
+        const EventEncoder::ChannelEncoding& encoding;
+
+        std::vector<int64> firstEvents;
+        std::vector<int64> endEvents;
+        int64 numCaptured;
+        int64 numAccounted;
+        int64 numDropped;
+        std::atomic<int64> numMessages;
+    };
+
+    /** Captures events in blocks at the given rate and sends them with sender, as the plugin's
+        processing thread does; captureTicks gets the capture time of each event */
+    void drive(LoopbackSender& sender, Source& source, const Mode& mode, double rate, double blockSeconds,
+               int64 numEvents, int64* captureTicks)
+    {
+        EventEncoder encoder;
+        encoder.resetEncoding(false, mode.spikeColumns);
+
+        EventEncoder::Settings settings = {};
+        settings.format = mode.format;
+        settings.batchEnabled = mode.batched;
+        settings.neighbourhoods.add(Array<uint16>());
+
+        const EventEncoder::ChannelEncoding& encoding = source.getEncoding();
+
+        // the plugin's defaults, with columns that include the waveforms
+        EventSender::SendSettings sendSettings = {};
+        sendSettings.maxBatchEvents = 1000;
+        sendSettings.spikeColumns = mode.spikeColumns;
+        sendSettings.columnWaveforms = mode.spikeColumns;
+        sendSettings.maxValuesPerSpike = encoding.numChannels * encoding.totalSamples;
+        sendSettings.maxChannelsPerSpike = encoding.numChannels;
+        sender.prepareToSend(sendSettings);
+
+        MessagePool* pool = sender.getMessagePool();
+        const size_t captureBufferSize = sizeof(EventEncoder::EventRecord) + jmax(encoding.rawSize, encoding.compactSize);
+        MessagePool::Buffer* captureBuffer = pool->acquire(captureBufferSize);
+
+        const int64 eventsPerBlock = jmax((int64) 1, (int64) (rate * blockSeconds + 0.5));
+        const auto blockInterval = std::chrono::duration<double>((double) eventsPerBlock / rate);
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int64 block = 0; block * eventsPerBlock < numEvents; block++)
+        {
+            // a block is processed once all of it has arrived
+            std::this_thread::sleep_until(start
+                + std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockInterval * (double) (block + 1)));
+
+            const int64 end = jmin(numEvents, (block + 1) * eventsPerBlock);
+            for (int64 i = block * eventsPerBlock; i < end; i++)
+            {
+                captureTicks[i] = Time::getHighResolutionTicks();
+                source.capture(encoder, settings, i, captureBuffer->getData(), (int) captureBufferSize);
+
+                sender.addCaptured();
+                sender.sendRecord(captureBuffer);
+
+                // passed on with the message
+                if (captureBuffer == nullptr)
+                {
+                    captureBuffer = pool->acquire(captureBufferSize);
+                }
+            }
+
+            sender.flushBatch();
+        }
+
+        MessagePool::release(captureBuffer);
+    }
+
+    /** Receives messages until stopped, matching each one to the events the sender noted it carried */
+    void receive(void* socket, const int64* captureTicks, const LoopbackSender& sender,
+                 const std::atomic<bool>& driverDone, Result& result)
+    {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        int64 numMessages = 0;
+
+        for (;;)
+        {
+            if (zmq_msg_recv(&msg, socket, 0) == -1)
+            {
+                // nothing for a while: finished, or the rest was lost
+                if (zmq_errno() == EAGAIN && driverDone.load())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (zmq_msg_more(&msg))
+            {
+                continue;
+            }
+
+            const int64 now = Time::getHighResolutionTicks();
+            const int64 index = numMessages++;
+
+            // the sender notes a message just after ZMQ takes it
+            while (sender.getNumMessages() <= index)
+            {
+                std::this_thread::yield();
+            }
+
+            int64 first, end;
+            sender.getEvents(index, first, end);
+
+            for (int64 i = first; i < end; i++)
+            {
+                result.latency.add(now - captureTicks[i]);
+            }
+            result.numReceived += end - first;
+
+            if (driverDone.load() && numMessages == sender.getNumMessages())
+            {
+                break;
+            }
+        }
+
+        zmq_msg_close(&msg);
+    }
+
+#if SHAREDRING_AVAILABLE
+    /** As run(), but through the shared-memory ring rather than ZMQ */
+    void runRing(Source& source, const Mode& mode, double rate, double blockSeconds, double seconds, Result& result)
+    {
+        const std::string name = "/event-broadcaster-loopback-" + std::to_string(getpid());
+        const size_t maxPayloadSize = jmax(source.getEncoding().rawSize, source.getEncoding().compactSize);
+
+        // the plugin's default size
+        SharedRingWriter writer;
+        if (!writer.create(name.c_str(), 4096, (int) maxPayloadSize, 16 * 1024 * 1024))
+        {
+            std::exit(1);
+        }
+
+        SharedRingReader reader;
+        if (!reader.open(name.c_str()))
+        {
+            std::fprintf(stderr, "Failed to open shared memory %s\n", name.c_str());
+            std::exit(1);
+        }
+
+        const int64 numEvents = (int64) (rate * seconds);
+        std::vector<int64> captureTicks((size_t) numEvents);
+        std::atomic<bool> driverDone { false };
+
+        // records carry the event's number as their sample number, so need no matching up
+        std::thread receiver([&]
+        {
+            SharedRingRecord record;
+            std::vector<char> payload(reader.getMaxPayloadSize());
+
+            for (;;)
+            {
+                // checked before reading, so that the last record isn't missed
+                const bool done = driverDone.load();
+
+                switch (reader.read(record, payload.data(), payload.size()))
+                {
+                case SharedRingReader::RECORD:
+                    result.latency.add(Time::getHighResolutionTicks() - captureTicks[(size_t) record.sampleNumber]);
+                    result.numReceived++;
+                    break;
+                case SharedRingReader::EMPTY:
+                    if (done)
+                    {
+                        return;
+                    }
+                    reader.wait(100);
+                    break;
+                case SharedRingReader::LAPPED:
+                    result.numDropped++;
+                    break;
+                case SharedRingReader::CLOSED:
+                    return;
+                }
+            }
+        });
+
+        // nothing goes out over ZMQ
+        LoopbackSender sender(nullptr, source.getEncoding(), numEvents);
+        sender.setSharedRing(&writer);
+
+        const auto start = std::chrono::steady_clock::now();
+        drive(sender, source, mode, rate, blockSeconds, numEvents, captureTicks.data());
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        driverDone = true;
+        receiver.join();
+
+        result.numSent = numEvents;
+        result.eventsPerSecond = (double) numEvents / elapsed;
+    }
+#endif
+
+    void run(void* context, const char* transport, Source& source, const Mode& mode,
+             double rate, double blockSeconds, double seconds, Result& result)
+    {
+#if SHAREDRING_AVAILABLE
+        if (std::strcmp(transport, "shm") == 0)
+        {
+            runRing(source, mode, rate, blockSeconds, seconds, result);
+            return;
+        }
+#endif
+
+        void* publisher = zmq_socket(context, ZMQ_XPUB);
+        void* subscriber = zmq_socket(context, ZMQ_SUB);
+        const int linger = 0, timeout = 200, noDrop = 1;
+        zmq_setsockopt(publisher, ZMQ_LINGER, &linger, sizeof(linger));
+
+        // full queues fail the send, rather than dropping messages that the subscriber then can't match up
+        zmq_setsockopt(publisher, ZMQ_XPUB_NODROP, &noDrop, sizeof(noDrop));
+        zmq_setsockopt(subscriber, ZMQ_LINGER, &linger, sizeof(linger));
+        zmq_setsockopt(subscriber, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // each case has its own endpoint, as closing a socket frees its endpoint in the background
+        static int numRuns = 0;
+        const std::string name = "event-broadcaster-loopback-" + std::to_string(++numRuns);
+
+        std::string endpoint;
+        if (std::strcmp(transport, "tcp") == 0)
+        {
+            endpoint = "tcp://127.0.0.1:*";
+        }
+        else if (std::strcmp(transport, "ipc") == 0)
+        {
+#ifndef _WIN32
+            endpoint = "ipc:///tmp/" + name + "-" + std::to_string(getpid());
+#endif
+        }
+        else
+        {
+            endpoint = "inproc://" + name;
+        }
+
+        check(zmq_bind(publisher, endpoint.c_str()), "bind");
+
+        char boundEndpoint[256];
+        size_t boundEndpointSize = sizeof(boundEndpoint);
+        check(zmq_getsockopt(publisher, ZMQ_LAST_ENDPOINT, boundEndpoint, &boundEndpointSize), "ZMQ_LAST_ENDPOINT");
+        check(zmq_connect(subscriber, boundEndpoint), "connect");
+        check(zmq_setsockopt(subscriber, ZMQ_SUBSCRIBE, "", 0), "subscribe");
+
+        // wait for the subscription, so that nothing is sent before anyone is listening
+        char subscription[16];
+        check(zmq_recv(publisher, subscription, sizeof(subscription), 0), "receive subscription");
+
+        const int64 numEvents = (int64) (rate * seconds);
+        std::vector<int64> captureTicks((size_t) numEvents);
+        std::atomic<bool> driverDone { false };
+
+        // never more messages than events
+        LoopbackSender sender(publisher, source.getEncoding(), numEvents);
+
+        std::thread receiver(receive, subscriber, captureTicks.data(), std::cref(sender), std::cref(driverDone), std::ref(result));
+
+        const auto start = std::chrono::steady_clock::now();
+        drive(sender, source, mode, rate, blockSeconds, numEvents, captureTicks.data());
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        driverDone = true;
+        receiver.join();
+
+        zmq_close(subscriber);
+        zmq_close(publisher);
+
+        if (endpoint.compare(0, 6, "ipc://") == 0)
+        {
+            std::remove(endpoint.c_str() + 6);  // ZMQ doesn't always get to it once the socket is closed
+        }
+
+        result.numSent = numEvents - sender.getNumDropped();
+        result.numDropped = sender.getNumDropped();
+        result.eventsPerSecond = (double) numEvents / elapsed;
+    }
+
+    double toMicros(int64 nanos)
+    {
+        return (double) nanos / 1000.0;
+    }
+}
+
+int main()
+{
+    const double rate = getSetting("LOOPBACK_RATE", 10000);
+    const double blockSeconds = getSetting("LOOPBACK_BLOCK_MS", 1024 / 30.0) * 1.0e-3;
+    const double seconds = getSetting("LOOPBACK_SECONDS", 1);
+
+    int major, minor, patch;
+    zmq_version(&major, &minor, &patch);
+    std::printf("ZMQ %d.%d.%d, %.0f events per second in %.1f ms blocks for %.1f s per case; latencies in microseconds\n\n",
+        major, minor, patch, rate, blockSeconds * 1.0e3, seconds);
+
+    std::printf("transport  event   mode             events/s   received  dropped      p50      p99    p99.9      max\n");
+
+    const char* transports[] = {
+        "tcp",
+#ifndef _WIN32
+        "ipc",
+#endif
+        "inproc",
+#if SHAREDRING_AVAILABLE
+        "shm",
+#endif
+    };
+
+    const Mode modes[] = {
+        { "Raw Binary",    EventEncoder::RAW_BINARY,     false, false },
+        { "JSON",          EventEncoder::JSON_STRING,    false, false },
+        { "Compact",       EventEncoder::COMPACT_BINARY, false, false },
+        { "Raw batch",     EventEncoder::RAW_BINARY,     true,  false },
+        { "JSON batch",    EventEncoder::JSON_STRING,    true,  false },
+        { "Compact batch", EventEncoder::COMPACT_BINARY, true,  false },
+        { "columns",       EventEncoder::COMPACT_BINARY, true,  true },
+    };
+
+    void* context = zmq_ctx_new();
+
+    for (const char* transport : transports)
+    {
+        for (int type = 0; type < 2; type++)
+        {
+            for (auto& mode : modes)
+            {
+                // records go into the ring as they're captured, whether batched or not
+                if ((mode.spikeColumns && type == 0) || (mode.batched && std::strcmp(transport, "shm") == 0))
+                {
+                    continue;
+                }
+
+                std::unique_ptr<Source> source(type == 0 ? (Source*) new TtlSource() : (Source*) new SpikeSource());
+
+                std::unique_ptr<Result> result(new Result());
+                run(context, transport, *source, mode, rate, blockSeconds, seconds, *result);
+
+                std::printf("%-9s  %-6s  %-13s  %10.0f %10lld %8lld %8.1f %8.1f %8.1f %8.1f\n",
+                    transport, type == 0 ? "TTL" : "spike", mode.name, result->eventsPerSecond,
+                    (long long) result->numReceived, (long long) result->numDropped,
+                    toMicros(result->latency.getPercentile(0.5)), toMicros(result->latency.getPercentile(0.99)),
+                    toMicros(result->latency.getPercentile(0.999)), toMicros(result->latency.getMax()));
+            }
+        }
+    }
+
+    zmq_ctx_term(context);
+
+    std::printf("\nSpikes have %d channels of %d samples. Latency runs from capture to the subscriber receiving the\n"
+        "last frame, so it includes encoding, batching until the end of the block, ZMQ's I/O thread and the\n"
+        "transport. Batches and columns carry up to 1000 events. For shm it runs to a reader waiting on the\n"
+        "shared-memory ring getting the record; dropped counts records it was lapped on.\n",
+        SPIKE_CHANNELS, NUM_SAMPLES);
+
+    return 0;
+}
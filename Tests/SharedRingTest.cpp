@@ -0,0 +1,354 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "LatencyHistogram.h"
+#include "SharedRing.h"
+#include "SharedRingWriter.h"
+#include "TestHarness.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+/**
+
+ Checks that SharedRingWriter only replaces shared memory left behind by a
+ ring writer that has gone, that payloads of any size come back intact
+ (including across the end of the data area) or are reported as lapped once
+ overwritten, and that a reader waiting on the futex is woken for every
+ record: each record is written once the reader has taken the one before,
+ after long enough for it to go back to sleep, so a missed wake-up leaves
+ the reader waiting until its timeout. Prints the wake-up latency percentiles.
+
+ */
+
+namespace
+{
+    const int PAYLOAD_SIZE = 64;
+
+    std::string getRingName(const char* test)
+    {
+        return "/oebr-test-" + std::to_string(getpid()) + "-" + test;
+    }
+
+    /** Leaves shared memory with the given name that looks like a ring written by pid */
+    void createLeftoverRing(const std::string& name, uint32 magic, bool closed, pid_t pid)
+    {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        expect(fd != -1);
+        expectEquals(ftruncate(fd, (off_t) getSharedRingSize(16, getSharedRingSlotSize(), 256)), 0);
+
+        void* memory = mmap(nullptr, sizeof(SharedRingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        expect(memory != MAP_FAILED);
+
+        SharedRingHeader* header = static_cast<SharedRingHeader*>(memory);
+        header->magic = magic;
+        header->version = SHAREDRING_VERSION;
+        header->numSlots = 16;
+        header->slotSize = getSharedRingSlotSize();
+        header->maxPayloadSize = 256;
+        header->dataSize = 256;
+        header->closed.store(closed ? 1 : 0);
+        header->writerPid = (uint32) pid;
+
+        munmap(memory, sizeof(SharedRingHeader));
+    }
+
+    bool exists(const std::string& name)
+    {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1)
+        {
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    /** Returns the ID of a process that has exited */
+    pid_t getDeadPid()
+    {
+        pid_t child = fork();
+        if (child == 0)
+        {
+            _exit(0);
+        }
+
+        int status;
+        waitpid(child, &status, 0);
+        return child;
+    }
+
+    void testRoundTrip()
+    {
+        const std::string name = getRingName("roundtrip");
+
+        SharedRingWriter writer;
+        expect(writer.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+
+        SharedRingReader reader;
+        expect(reader.open(name.c_str()));
+
+        SharedRingRecord record = {};
+        char payload[PAYLOAD_SIZE];
+        expect(reader.read(record, payload, sizeof(payload)) == SharedRingReader::EMPTY);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            SharedRingRecord written = {};
+            written.sampleNumber = 1000 + i;
+            written.channelIndex = (uint16) i;
+            written.payloadSize = 4;
+            expect(writer.write(written, "abcd"));
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            expect(reader.read(record, payload, sizeof(payload)) == SharedRingReader::RECORD);
+            expectEquals(record.sampleNumber, (int64_t) (1000 + i));
+            expectEquals((int) record.channelIndex, i);
+            expect(memcmp(payload, "abcd", 4) == 0);
+        }
+        expect(reader.read(record, payload, sizeof(payload)) == SharedRingReader::EMPTY);
+    }
+
+    void testVariableSizes()
+    {
+        const std::string name = getRingName("sizes");
+        const int maxPayloadSize = 1000;
+
+        SharedRingWriter writer;
+        expect(writer.create(name.c_str(), 16, maxPayloadSize, 2048));
+        expectEquals(writer.getMaxPayloadSize(), maxPayloadSize);
+
+        SharedRingReader reader;
+        expect(reader.open(name.c_str()));
+        expectEquals(reader.getMaxPayloadSize(), (size_t) maxPayloadSize);
+
+        std::vector<char> written(maxPayloadSize);
+        std::vector<char> payload(maxPayloadSize);
+        SharedRingRecord record = {};
+
+        // sizes that don't divide the data area, so payloads keep landing across its end
+        for (int i = 0; i < 200; ++i)
+        {
+            const int size = (i * 37) % (maxPayloadSize + 1);
+            for (int j = 0; j < size; ++j)
+            {
+                written[j] = (char) (i + j);
+            }
+
+            SharedRingRecord sent = {};
+            sent.sortedId = (uint16) i;
+            sent.payloadSize = (uint32) size;
+            expect(writer.write(sent, written.data()));
+
+            expect(reader.read(record, payload.data(), payload.size()) == SharedRingReader::RECORD);
+            expectEquals((int) record.sortedId, i);
+            expectEquals((int) record.payloadSize, size);
+            expect(memcmp(payload.data(), written.data(), (size_t) size) == 0);
+        }
+
+        SharedRingRecord tooLarge = {};
+        tooLarge.payloadSize = maxPayloadSize + 1;
+        expect(!writer.write(tooLarge, written.data()));
+
+        // five records fit in the slots, but only the last two payloads in the data area
+        for (int i = 0; i < 5; ++i)
+        {
+            SharedRingRecord sent = {};
+            sent.sortedId = (uint16) i;
+            sent.payloadSize = (uint32) maxPayloadSize;
+            memset(written.data(), i, written.size());
+            expect(writer.write(sent, written.data()));
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            expect(reader.read(record, payload.data(), payload.size()) == SharedRingReader::LAPPED);
+        }
+
+        for (int i = 3; i < 5; ++i)
+        {
+            expect(reader.read(record, payload.data(), payload.size()) == SharedRingReader::RECORD);
+            expectEquals((int) record.sortedId, i);
+            expectEquals((int) payload[0], i);
+            expectEquals((int) payload[maxPayloadSize - 1], i);
+        }
+        expect(reader.read(record, payload.data(), payload.size()) == SharedRingReader::EMPTY);
+    }
+
+    void testExclusiveCreate()
+    {
+        const std::string name = getRingName("exclusive");
+
+        // a live writer keeps its ring
+        {
+            SharedRingWriter first;
+            expect(first.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+
+            SharedRingWriter second;
+            expect(!second.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+
+            SharedRingReader reader;
+            expect(reader.open(name.c_str()));
+        }
+        expect(!exists(name));
+
+        // a ring that its writer closed, but didn't remove
+        createLeftoverRing(name, SHAREDRING_MAGIC, true, getpid());
+        {
+            SharedRingWriter writer;
+            expect(writer.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+        }
+
+        // a ring whose writer died without closing it
+        createLeftoverRing(name, SHAREDRING_MAGIC, false, getDeadPid());
+        {
+            SharedRingWriter writer;
+            expect(writer.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+        }
+
+        // a ring whose writer is still running
+        createLeftoverRing(name, SHAREDRING_MAGIC, false, getpid());
+        {
+            SharedRingWriter writer;
+            expect(!writer.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+        }
+        expect(exists(name));
+        shm_unlink(name.c_str());
+
+        // something else altogether
+        createLeftoverRing(name, 0x12345678, true, getDeadPid());
+        {
+            SharedRingWriter writer;
+            expect(!writer.create(name.c_str(), 16, PAYLOAD_SIZE, 16 * PAYLOAD_SIZE));
+        }
+        expect(exists(name));
+        shm_unlink(name.c_str());
+    }
+
+    void testWakeLatency()
+    {
+        const std::string name = getRingName("latency");
+        const int numRecords = 2000;
+        const int timeoutMs = 5000;
+
+        SharedRingWriter writer;
+        expect(writer.create(name.c_str(), 4096, PAYLOAD_SIZE, 4096 * PAYLOAD_SIZE));
+
+        SharedRingReader reader;
+        expect(reader.open(name.c_str()));
+
+        LatencyHistogram latencies;
+        std::atomic<int> numRead { 0 };
+        int numOutOfOrder = 0;
+        int numLapped = 0;
+        std::atomic<bool> timedOut { false };
+
+        std::thread readerThread([&]
+        {
+            SharedRingRecord record;
+            char payload[PAYLOAD_SIZE];
+
+            while (numRead < numRecords)
+            {
+                switch (reader.read(record, payload, sizeof(payload)))
+                {
+                case SharedRingReader::RECORD:
+                    latencies.add(Time::getHighResolutionTicks() - record.sampleNumber);
+                    numOutOfOrder += record.sortedId != (uint16) numRead ? 1 : 0;
+                    ++numRead;
+                    break;
+                case SharedRingReader::EMPTY:
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    reader.wait(timeoutMs);
+
+                    // the writer only waits for this reader and a short sleep, so only a missed
+                    // wake-up makes a wait last its whole timeout; stop rather than wait out the rest
+                    if (std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(timeoutMs))
+                    {
+                        timedOut = true;
+                        return;
+                    }
+                    break;
+                }
+                case SharedRingReader::LAPPED:
+                    ++numLapped;
+                    break;
+                case SharedRingReader::CLOSED:
+                    return;
+                }
+            }
+        });
+
+        for (int i = 0; i < numRecords; ++i)
+        {
+            while (numRead.load() < i && !timedOut.load())
+            {
+                std::this_thread::yield();
+            }
+
+            // long enough for the reader to be back in the futex most of the time
+            std::this_thread::sleep_for(std::chrono::microseconds(i % 8 == 0 ? 200 : 20));
+
+            SharedRingRecord record = {};
+            record.sortedId = (uint16) i;
+            record.sampleNumber = Time::getHighResolutionTicks();
+            writer.write(record, "");
+        }
+
+        readerThread.join();
+
+        // a missed wake-up leaves the reader asleep until its timeout, as nothing else is written
+        expect(!timedOut.load());
+
+        expectEquals(numRead.load(), numRecords);
+        expectEquals(numOutOfOrder, 0);
+        expectEquals(numLapped, 0);
+
+        std::printf("wake-up latency over %d records: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+            (int) latencies.getCount(),
+            latencies.getPercentile(0.5) / 1000.0,
+            latencies.getPercentile(0.99) / 1000.0,
+            latencies.getPercentile(0.999) / 1000.0,
+            latencies.getMax() / 1000.0);
+    }
+}
+
+int main()
+{
+    testRoundTrip();
+    testVariableSizes();
+    testExclusiveCreate();
+    testWakeLatency();
+
+    return TestHarness::finish("SharedRingTest");
+}
@@ -0,0 +1,245 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "SpikeFeatures.h"
+#include "TestHarness.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+/**
+
+ Checks that the vector kernels in SpikeFeatures give exactly what the
+ scalar versions and a plain reference give, for every length up to a few
+ vectors (so every tail length), at every alignment, with NaN samples
+ anywhere and with int16 samples at the ends of their range.
+
+ */
+
+namespace
+{
+    const int MAX_LENGTH = 100;
+    const float NaN = std::numeric_limits<float>::quiet_NaN();
+    const float INF = std::numeric_limits<float>::infinity();
+
+    /** The result the kernels should give, worked out independently of them */
+    void referenceExtremes(const float* samples, int count, float& minimum, float& maximum)
+    {
+        minimum = INF;
+        maximum = -INF;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (!std::isnan(samples[i]))
+            {
+                minimum = std::min(minimum, samples[i]);
+                maximum = std::max(maximum, samples[i]);
+            }
+        }
+    }
+
+    void checkFloat(const float* samples, int count)
+    {
+        float expectedMinimum, expectedMaximum;
+        referenceExtremes(samples, count, expectedMinimum, expectedMaximum);
+
+        expectEquals(SpikeFeatures::findMinimum(samples, count), expectedMinimum);
+        expectEquals(SpikeFeatures::findMinimumScalar(samples, count), expectedMinimum);
+
+        float minimum, maximum;
+        SpikeFeatures::findExtremes(samples, count, minimum, maximum);
+        expectEquals(minimum, expectedMinimum);
+        expectEquals(maximum, expectedMaximum);
+
+        SpikeFeatures::findExtremesScalar(samples, count, minimum, maximum);
+        expectEquals(minimum, expectedMinimum);
+        expectEquals(maximum, expectedMaximum);
+    }
+
+    void checkInt16(const int16* samples, int count)
+    {
+        int16 expectedMinimum = 32767;
+        int16 expectedMaximum = -32768;
+        for (int i = 0; i < count; ++i)
+        {
+            expectedMinimum = std::min(expectedMinimum, samples[i]);
+            expectedMaximum = std::max(expectedMaximum, samples[i]);
+        }
+
+        int16 minimum, maximum;
+        SpikeFeatures::findExtremes(samples, count, minimum, maximum);
+        expectEquals(minimum, expectedMinimum);
+        expectEquals(maximum, expectedMaximum);
+
+        SpikeFeatures::findExtremesScalar(samples, count, minimum, maximum);
+        expectEquals(minimum, expectedMinimum);
+        expectEquals(maximum, expectedMaximum);
+    }
+
+    void testEveryLength()
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> values(-200.0f, 200.0f);
+
+        // a few samples of slack at the start, to try every alignment
+        std::vector<float> buffer(MAX_LENGTH + 4);
+
+        for (int offset = 0; offset < 4; ++offset)
+        {
+            for (int count = 0; count < MAX_LENGTH; ++count)
+            {
+                for (auto& sample : buffer)
+                {
+                    sample = values(random);
+                }
+                checkFloat(buffer.data() + offset, count);
+
+                // the extremes in every position, so tails and lanes both get them
+                for (int i = 0; i < count; ++i)
+                {
+                    const float original = buffer[offset + i];
+                    buffer[offset + i] = -1000.0f;
+                    checkFloat(buffer.data() + offset, count);
+                    buffer[offset + i] = 1000.0f;
+                    checkFloat(buffer.data() + offset, count);
+                    buffer[offset + i] = original;
+                }
+            }
+        }
+    }
+
+    void testNaN()
+    {
+        std::vector<float> samples(MAX_LENGTH);
+
+        for (int count = 0; count < MAX_LENGTH; ++count)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                samples[i] = (float) ((i * 37) % 23) - 11.0f;
+            }
+
+            // one NaN in every position, including in front of the extremes
+            for (int i = 0; i < count; ++i)
+            {
+                const float original = samples[i];
+                samples[i] = NaN;
+                checkFloat(samples.data(), count);
+                samples[i] = original;
+            }
+
+            // all NaN is the same as no samples at all
+            std::fill(samples.begin(), samples.begin() + count, NaN);
+            checkFloat(samples.data(), count);
+
+            float minimum, maximum;
+            SpikeFeatures::findExtremes(samples.data(), count, minimum, maximum);
+            expectEquals(minimum, INF);
+            expectEquals(maximum, -INF);
+        }
+    }
+
+    void testInfinities()
+    {
+        const float samples[] = { 1.0f, INF, -INF, 2.0f, 3.0f, NaN, -5.0f, 0.0f, -0.0f };
+        for (int count = 0; count <= 9; ++count)
+        {
+            checkFloat(samples, count);
+        }
+    }
+
+    void testInt16()
+    {
+        std::mt19937 random(2);
+        std::uniform_int_distribution<int> values(-32768, 32767);
+
+        std::vector<int16> buffer(MAX_LENGTH + 8);
+
+        for (int offset = 0; offset < 8; offset += 3)
+        {
+            for (int count = 0; count < MAX_LENGTH; ++count)
+            {
+                for (auto& sample : buffer)
+                {
+                    sample = (int16) values(random);
+                }
+                checkInt16(buffer.data() + offset, count);
+
+                // the ends of the range, which are also where the kernels start from
+                for (int i = 0; i < count; ++i)
+                {
+                    const int16 original = buffer[offset + i];
+                    buffer[offset + i] = -32768;
+                    checkInt16(buffer.data() + offset, count);
+                    buffer[offset + i] = 32767;
+                    checkInt16(buffer.data() + offset, count);
+                    buffer[offset + i] = original;
+                }
+
+                std::fill(buffer.begin() + offset, buffer.begin() + offset + count, (int16) -32768);
+                checkInt16(buffer.data() + offset, count);
+                std::fill(buffer.begin() + offset, buffer.begin() + offset + count, (int16) 32767);
+                checkInt16(buffer.data() + offset, count);
+            }
+        }
+
+        int16 minimum, maximum;
+        SpikeFeatures::findExtremes(buffer.data(), 0, minimum, maximum);
+        expectEquals(minimum, (int16) 32767);
+        expectEquals(maximum, (int16) -32768);
+    }
+
+    void testPeakChannel()
+    {
+        const int numChannels = 4;
+        const int numSamples = 40;
+
+        Spike spike(numChannels, numSamples);
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            std::fill(spike.getDataPointer(ch), spike.getDataPointer(ch) + numSamples, 10.0f);
+        }
+
+        // the first channel wins a tie
+        expectEquals(SpikeFeatures::findPeakChannel(spike, numChannels, numSamples), 0);
+
+        spike.getDataPointer(2)[numSamples - 1] = -50.0f;  // in the scalar tail
+        spike.getDataPointer(1)[3] = -40.0f;
+        spike.getDataPointer(3)[5] = NaN;
+        expectEquals(SpikeFeatures::findPeakChannel(spike, numChannels, numSamples), 2);
+    }
+}
+
+int main()
+{
+    testEveryLength();
+    testNaN();
+    testInfinities();
+    testInt16();
+    testPeakChannel();
+
+    return TestHarness::finish("SpikeFeaturesTest");
+}
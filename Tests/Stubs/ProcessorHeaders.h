@@ -0,0 +1,641 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PROCESSORHEADERS_H_INCLUDED
+#define PROCESSORHEADERS_H_INCLUDED
+
+/**
+
+ Stand-ins for the parts of JUCE and the plugin API that the plugin's
+ self-contained units use, so that their tests and benchmarks build
+ without the GUI. Only what those units call is provided, and it behaves
+ like the real thing as far as they can tell.
+
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef int8_t      int8;
+typedef uint8_t     uint8;
+typedef int16_t     int16;
+typedef uint16_t    uint16;
+typedef int32_t     int32;
+typedef uint32_t    uint32;
+typedef int64_t     int64;
+typedef uint64_t    uint64;
+
+#if !defined(NDEBUG) && !defined(JUCE_DEBUG)
+    #define JUCE_DEBUG 1
+#endif
+
+// assertions stay on in every build, so that tests catch them
+#define jassert(expression) \
+    do { if (!(expression)) { std::fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #expression); std::abort(); } } while (false)
+
+#define jassertfalse jassert(false)
+
+#define JUCE_DECLARE_NON_COPYABLE(className) \
+    className(const className&) = delete; \
+    className& operator=(const className&) = delete
+
+template <typename T> T jmin(T a, T b)          { return b < a ? b : a; }
+template <typename T> T jmax(T a, T b)          { return a < b ? b : a; }
+template <typename T> T jmax(T a, T b, T c)     { return jmax(a, jmax(b, c)); }
+template <typename T> T jlimit(T lowest, T highest, T value) { return value < lowest ? lowest : (highest < value ? highest : value); }
+
+inline int roundToInt(double value) { return (int) std::lround(value); }
+inline void zeromem(void* memory, size_t numBytes) { std::memset(memory, 0, numBytes); }
+template <typename... Types> void ignoreUnused(Types&&...) noexcept {}
+
+template <typename T>
+struct MathConstants
+{
+    static constexpr T pi = static_cast<T>(3.141592653589793238L);
+};
+
+
+template <typename T>
+class Atomic
+{
+public:
+    Atomic(T initial = T()) : value(initial) {}
+
+    T get() const noexcept                  { return value.load(); }
+    void set(T newValue) noexcept           { value.store(newValue); }
+    Atomic& operator=(T newValue) noexcept  { value.store(newValue); return *this; }
+    T operator++() noexcept                 { return ++value; }
+    T operator--() noexcept                 { return --value; }
+    T operator+=(T amount) noexcept         { return value += amount; }
+    T operator-=(T amount) noexcept         { return value -= amount; }
+    bool compareAndSetBool(T newValue, T expected) noexcept { return value.compare_exchange_strong(expected, newValue); }
+
+    std::atomic<T> value;
+};
+
+
+template <typename T>
+class HeapBlock
+{
+public:
+    HeapBlock() {}
+    explicit HeapBlock(size_t numElements) : data(static_cast<T*>(std::malloc(numElements * sizeof(T)))) {}
+    HeapBlock(size_t numElements, bool initialiseToZero)
+        : data(static_cast<T*>(initialiseToZero ? std::calloc(numElements, sizeof(T)) : std::malloc(numElements * sizeof(T)))) {}
+    ~HeapBlock() { std::free(data); }
+
+    operator T*() const noexcept            { return data; }
+    T* get() const noexcept                 { return data; }
+    T* getData() const noexcept             { return data; }
+    T* operator->() const noexcept          { return data; }
+    template <typename IndexType> T& operator[](IndexType index) const noexcept { return data[index]; }
+    template <typename IndexType> T* operator+(IndexType index) const noexcept  { return data + index; }
+
+    void malloc(size_t numElements)         { std::free(data); data = static_cast<T*>(std::malloc(numElements * sizeof(T))); }
+    void calloc(size_t numElements)         { std::free(data); data = static_cast<T*>(std::calloc(numElements, sizeof(T))); }
+    void allocate(size_t numElements, bool initialiseToZero) { initialiseToZero ? calloc(numElements) : malloc(numElements); }
+    void realloc(size_t numElements)        { data = static_cast<T*>(std::realloc(data, numElements * sizeof(T))); }
+    void free()                             { std::free(data); data = nullptr; }
+    void clear(size_t numElements)          { std::memset(data, 0, numElements * sizeof(T)); }
+
+private:
+    T* data = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(HeapBlock);
+};
+
+
+class AbstractFifo
+{
+public:
+    AbstractFifo(int capacity) : bufferSize(capacity) {}
+
+    int getTotalSize() const noexcept       { return bufferSize; }
+    int getFreeSpace() const noexcept       { return bufferSize - getNumReady() - 1; }
+
+    int getNumReady() const noexcept
+    {
+        const int vs = validStart.load(), ve = validEnd.load();
+        return ve >= vs ? ve - vs : bufferSize - (vs - ve);
+    }
+
+    void prepareToWrite(int numToWrite, int& startIndex1, int& blockSize1, int& startIndex2, int& blockSize2) const noexcept
+    {
+        const int vs = validStart.load(), ve = validEnd.load();
+        const int freeSpace = ve >= vs ? bufferSize - (ve - vs) : vs - ve;
+        numToWrite = std::min(numToWrite, freeSpace - 1);
+
+        startIndex1 = ve;
+        blockSize1 = std::min(bufferSize - ve, numToWrite);
+        startIndex2 = 0;
+        blockSize2 = std::max(0, numToWrite - blockSize1);
+    }
+
+    void finishedWrite(int numWritten) noexcept
+    {
+        int newEnd = validEnd.load() + numWritten;
+        if (newEnd >= bufferSize)
+            newEnd -= bufferSize;
+        validEnd.store(newEnd);
+    }
+
+    void prepareToRead(int numWanted, int& startIndex1, int& blockSize1, int& startIndex2, int& blockSize2) const noexcept
+    {
+        const int vs = validStart.load(), ve = validEnd.load();
+        const int numReady = ve >= vs ? ve - vs : bufferSize - (vs - ve);
+        numWanted = std::min(numWanted, numReady);
+
+        startIndex1 = vs;
+        blockSize1 = std::min(bufferSize - vs, numWanted);
+        startIndex2 = 0;
+        blockSize2 = std::max(0, numWanted - blockSize1);
+    }
+
+    void finishedRead(int numRead) noexcept
+    {
+        int newStart = validStart.load() + numRead;
+        if (newStart >= bufferSize)
+            newStart -= bufferSize;
+        validStart.store(newStart);
+    }
+
+private:
+    int bufferSize;
+    std::atomic<int> validStart { 0 }, validEnd { 0 };
+};
+
+
+class ReferenceCountedObject
+{
+public:
+    void incReferenceCount() noexcept       { ++refCount; }
+    void decReferenceCount() noexcept       { if (--refCount == 0) delete this; }
+    int getReferenceCount() const noexcept  { return refCount.load(); }
+
+protected:
+    ReferenceCountedObject() {}
+    virtual ~ReferenceCountedObject() {}
+
+private:
+    std::atomic<int> refCount { 0 };
+};
+
+template <typename ObjectType>
+class ReferenceCountedObjectPtr
+{
+public:
+    ReferenceCountedObjectPtr() {}
+    ReferenceCountedObjectPtr(ObjectType* object) : referencedObject(object)    { if (object != nullptr) object->incReferenceCount(); }
+    ReferenceCountedObjectPtr(const ReferenceCountedObjectPtr& other) : ReferenceCountedObjectPtr(other.referencedObject) {}
+    ~ReferenceCountedObjectPtr()            { if (referencedObject != nullptr) referencedObject->decReferenceCount(); }
+
+    ReferenceCountedObjectPtr& operator=(const ReferenceCountedObjectPtr& other) { return *this = other.referencedObject; }
+    ReferenceCountedObjectPtr& operator=(ObjectType* newObject)
+    {
+        if (newObject != nullptr)
+            newObject->incReferenceCount();
+        ObjectType* oldObject = referencedObject;
+        referencedObject = newObject;
+        if (oldObject != nullptr)
+            oldObject->decReferenceCount();
+        return *this;
+    }
+
+    ObjectType* get() const noexcept        { return referencedObject; }
+    ObjectType* operator->() const noexcept { return referencedObject; }
+    operator ObjectType*() const noexcept   { return referencedObject; }
+
+private:
+    ObjectType* referencedObject = nullptr;
+};
+
+
+/** UTF-8 text; only what the units above use */
+class String
+{
+public:
+    String() {}
+    String(const char* text) : text(text) {}
+    String(const std::string& text) : text(text) {}
+
+    const char* toRawUTF8() const noexcept      { return text.c_str(); }
+    size_t getNumBytesAsUTF8() const noexcept   { return text.size(); }
+    bool isEmpty() const noexcept               { return text.empty(); }
+    bool isNotEmpty() const noexcept            { return !text.empty(); }
+
+    String replaceCharacter(char characterToReplace, char characterToInsertInstead) const
+    {
+        std::string result(text);
+        std::replace(result.begin(), result.end(), characterToReplace, characterToInsertInstead);
+        return String(result);
+    }
+
+    bool operator==(const String& other) const noexcept { return text == other.text; }
+    bool operator!=(const String& other) const noexcept { return text != other.text; }
+
+    std::string text;
+};
+
+inline String operator+(const String& a, const String& b)   { return String(a.text + b.text); }
+inline String operator+(const char* a, const String& b)     { return String(a + b.text); }
+inline String operator+(const String& a, const char* b)     { return String(a.text + b); }
+
+inline std::ostream& operator<<(std::ostream& stream, const String& string) { return stream << string.text; }
+
+
+/** A resizable array of copyable values */
+template <typename ElementType>
+class Array
+{
+public:
+    int size() const noexcept                   { return (int) elements.size(); }
+    bool isEmpty() const noexcept               { return elements.empty(); }
+    void add(const ElementType& element)        { elements.push_back(element); }
+    void clear()                                { elements.clear(); }
+    void ensureStorageAllocated(int minNumElements) { elements.reserve((size_t) minNumElements); }
+
+    ElementType getUnchecked(int index) const   { return elements[(size_t) index]; }
+    ElementType& getReference(int index) noexcept { return elements[(size_t) index]; }
+    const ElementType& getReference(int index) const noexcept { return elements[(size_t) index]; }
+
+    ElementType* begin() noexcept               { return elements.data(); }
+    ElementType* end() noexcept                 { return elements.data() + elements.size(); }
+    const ElementType* begin() const noexcept   { return elements.data(); }
+    const ElementType* end() const noexcept     { return elements.data() + elements.size(); }
+
+private:
+    std::vector<ElementType> elements;
+};
+
+
+class OutputStream
+{
+public:
+    virtual ~OutputStream() {}
+    virtual void flush() = 0;
+    virtual bool setPosition(int64 newPosition) = 0;
+    virtual int64 getPosition() = 0;
+    virtual bool write(const void* dataToWrite, size_t numberOfBytes) = 0;
+};
+
+
+class MemoryBlock
+{
+public:
+    MemoryBlock() {}
+    MemoryBlock(const void* source, size_t numBytes) : bytes(static_cast<const char*>(source), numBytes) {}
+
+    void* getData() const noexcept          { return const_cast<char*>(bytes.data()); }
+    size_t getSize() const noexcept         { return bytes.size(); }
+    bool isEmpty() const noexcept           { return bytes.empty(); }
+    void setSize(size_t newSize, bool initialiseToZero = false) { bytes.resize(newSize); (void) initialiseToZero; }
+    void reset()                            { bytes.clear(); }
+    void replaceWith(const void* source, size_t numBytes) { bytes.assign(static_cast<const char*>(source), numBytes); }
+    void append(const void* source, size_t numBytes) { bytes.append(static_cast<const char*>(source), numBytes); }
+    String toString() const                 { return String(bytes); }
+
+    bool operator==(const MemoryBlock& other) const noexcept { return bytes == other.bytes; }
+
+private:
+    std::string bytes;
+};
+
+
+class MemoryOutputStream : public OutputStream
+{
+public:
+    MemoryOutputStream() : block(&internal) {}
+    MemoryOutputStream(MemoryBlock& destination, bool appendToExistingBlockContent)
+        : block(&destination), position(appendToExistingBlockContent ? destination.getSize() : 0)
+    {
+        if (!appendToExistingBlockContent)
+            destination.reset();
+    }
+
+    void flush() override {}
+    int64 getPosition() override            { return (int64) position; }
+    bool setPosition(int64 newPosition) override { position = (size_t) newPosition; return true; }
+
+    bool write(const void* dataToWrite, size_t numberOfBytes) override
+    {
+        block->setSize(position);
+        block->append(dataToWrite, numberOfBytes);
+        position += numberOfBytes;
+        return true;
+    }
+
+    const void* getData() const noexcept    { return block->getData(); }
+    size_t getDataSize() const noexcept     { return position; }
+    String toString() const                 { return String(std::string(static_cast<const char*>(getData()), position)); }
+    void reset() noexcept                   { block->reset(); position = 0; }
+
+private:
+    MemoryBlock internal;
+    MemoryBlock* block;
+    size_t position = 0;
+};
+
+
+struct SystemStats
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static bool hasSSE2()   { return __builtin_cpu_supports("sse2"); }
+    static bool hasAVX2()   { return __builtin_cpu_supports("avx2"); }
+#else
+    static bool hasSSE2()   { return false; }
+    static bool hasAVX2()   { return false; }
+#endif
+};
+
+
+struct Time
+{
+    static int64 getHighResolutionTicks() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int64 getHighResolutionTicksPerSecond() noexcept { return 1000000000; }
+
+    static double highResolutionTicksToSeconds(int64 ticks) noexcept { return (double) ticks * 1.0e-9; }
+};
+
+
+// ---- plugin API: channels, events and spikes ----
+
+/** Types of metadata values */
+enum class BaseType { CHAR, INT8, UINT8, INT16, UINT16, INT32, UINT32, INT64, UINT64, FLOAT, DOUBLE };
+
+inline size_t getBaseTypeSize(BaseType type)
+{
+    switch (type)
+    {
+    case BaseType::CHAR:
+    case BaseType::INT8:
+    case BaseType::UINT8:   return 1;
+    case BaseType::INT16:
+    case BaseType::UINT16:  return 2;
+    case BaseType::INT32:
+    case BaseType::UINT32:
+    case BaseType::FLOAT:   return 4;
+    case BaseType::INT64:
+    case BaseType::UINT64:
+    case BaseType::DOUBLE:  return 8;
+    }
+    return 0;
+}
+
+/** Describes one metadata field of a channel's events */
+class MetadataDescriptor
+{
+public:
+    MetadataDescriptor(BaseType type, unsigned int length, const String& name)
+        : type(type), length(length), name(name)
+    { }
+
+    BaseType getType() const                { return type; }
+    unsigned int getLength() const          { return length; }
+    size_t getDataSize() const              { return length * getBaseTypeSize(type); }
+    String getName() const                  { return name; }
+
+private:
+    BaseType type;
+    unsigned int length;
+    String name;
+};
+
+/** The value of one metadata field of an event */
+class MetadataValue
+{
+public:
+    MetadataValue(const MetadataDescriptor& descriptor) : value(descriptor.getDataSize()) {}
+
+    const void* getRawValuePointer() const  { return value.data(); }
+    void* getRawValuePointer()              { return value.data(); }
+    size_t getDataSize() const              { return value.size(); }
+
+private:
+    std::vector<char> value;
+};
+
+/** A channel whose events carry the metadata fields added to it */
+class MetadataEventObject
+{
+public:
+    void addEventMetadata(const MetadataDescriptor& descriptor) { descriptors.push_back(descriptor); }
+
+    size_t getEventMetadataCount() const    { return descriptors.size(); }
+    const MetadataDescriptor* getEventMetadataDescriptor(int index) const { return &descriptors[(size_t) index]; }
+
+    size_t getTotalEventMetadataSize() const
+    {
+        size_t size = 0;
+        for (auto& descriptor : descriptors)
+            size += descriptor.getDataSize();
+        return size;
+    }
+
+private:
+    std::vector<MetadataDescriptor> descriptors;
+};
+
+/** Settings shared by event, spike and continuous channels */
+class ChannelInfoObject
+{
+public:
+    ChannelInfoObject(const String& name, const String& streamName, uint16 nodeId, float sampleRate)
+        : name(name), streamName(streamName), nodeId(nodeId), sampleRate(sampleRate)
+    { }
+
+    String getName() const                  { return name; }
+    String getStreamName() const            { return streamName; }
+    uint16 getNodeId() const                { return nodeId; }
+    float getSampleRate() const             { return sampleRate; }
+
+private:
+    String name;
+    String streamName;
+    uint16 nodeId;
+    float sampleRate;
+};
+
+class ContinuousChannel : public ChannelInfoObject
+{
+public:
+    ContinuousChannel(const String& name, float bitVolts)
+        : ChannelInfoObject(name, "stream", 100, 30000.0f), bitVolts(bitVolts)
+    { }
+
+    float getBitVolts() const               { return bitVolts; }
+
+private:
+    float bitVolts;
+};
+
+/** A TTL event channel; TTL data is the line number and state */
+class EventChannel : public ChannelInfoObject, public MetadataEventObject
+{
+public:
+    using ChannelInfoObject::ChannelInfoObject;
+
+    size_t getDataSize() const              { return 2; }
+};
+
+/** An electrode; spike data is the waveform of each of its channels */
+class SpikeChannel : public ChannelInfoObject, public MetadataEventObject
+{
+public:
+    SpikeChannel(const String& name, const String& streamName, uint16 nodeId, float sampleRate,
+                 const Array<const ContinuousChannel*>& sourceChannels, unsigned int prePeakSamples, unsigned int postPeakSamples)
+        : ChannelInfoObject(name, streamName, nodeId, sampleRate), sourceChannels(sourceChannels),
+          prePeakSamples(prePeakSamples), postPeakSamples(postPeakSamples)
+    { }
+
+    unsigned int getNumChannels() const     { return (unsigned int) sourceChannels.size(); }
+    unsigned int getPrePeakSamples() const  { return prePeakSamples; }
+    unsigned int getPostPeakSamples() const { return postPeakSamples; }
+    const Array<const ContinuousChannel*>& getSourceChannels() const { return sourceChannels; }
+    size_t getDataSize() const              { return getNumChannels() * (prePeakSamples + postPeakSamples) * sizeof(float); }
+
+private:
+    Array<const ContinuousChannel*> sourceChannels;
+    unsigned int prePeakSamples;
+    unsigned int postPeakSamples;
+};
+
+/** An event or spike, with a value for each metadata field of its channel */
+class EventBase
+{
+public:
+    EventBase(const MetadataEventObject* channel, int64 sampleNumber) : sampleNumber(sampleNumber)
+    {
+        for (size_t i = 0; channel != nullptr && i < channel->getEventMetadataCount(); i++)
+            metadata.emplace_back(*channel->getEventMetadataDescriptor((int) i));
+    }
+    virtual ~EventBase() {}
+
+    int64 getSampleNumber() const           { return sampleNumber; }
+    void setSampleNumber(int64 newSampleNumber) { sampleNumber = newSampleNumber; }
+
+    size_t getMetadataValueCount() const    { return metadata.size(); }
+    const MetadataValue* getMetadataValue(int index) const { return &metadata[(size_t) index]; }
+    MetadataValue* getMetadataValue(int index) { return &metadata[(size_t) index]; }
+
+    /** Writes the event as the GUI does: the fixed part, its data, then its metadata */
+    virtual void serialize(void* dstBuffer, size_t dstSize) const = 0;
+
+protected:
+    /** Writes the fixed part (baseSize bytes, as the plugin expects), then data, then the metadata values, as far as they fit */
+    void serializeParts(void* dstBuffer, size_t dstSize, size_t baseSize, const void* data, size_t dataSize) const
+    {
+        char* dest = static_cast<char*>(dstBuffer);
+        std::memset(dest, 0, std::min(dstSize, baseSize));
+        std::memcpy(dest + 8, &sampleNumber, sizeof(sampleNumber));
+        size_t offset = baseSize;
+
+        const size_t n = std::min(dataSize, dstSize - std::min(dstSize, offset));
+        std::memcpy(dest + offset, data, n);
+        offset += n;
+
+        for (auto& value : metadata)
+        {
+            const size_t size = value.getDataSize();
+            if (offset + size > dstSize)
+                break;
+            std::memcpy(dest + offset, value.getRawValuePointer(), size);
+            offset += size;
+        }
+    }
+
+private:
+    int64 sampleNumber;
+    std::vector<MetadataValue> metadata;
+};
+
+class TTLEvent : public EventBase
+{
+public:
+    TTLEvent(const EventChannel* channel, int64 sampleNumber, int line, bool state)
+        : EventBase(channel, sampleNumber), line(line), state(state)
+    { }
+
+    int getLine() const                     { return line; }
+    bool getState() const                   { return state; }
+
+    void serialize(void* dstBuffer, size_t dstSize) const override
+    {
+        const uint8 data[2] = { (uint8) line, (uint8) (state ? 1 : 0) };
+        serializeParts(dstBuffer, dstSize, 24, data, sizeof(data));
+    }
+
+private:
+    int line;
+    bool state;
+};
+
+/** A spike's waveform, one run of samples per channel; tests fill it in directly */
+class Spike : public EventBase
+{
+public:
+    Spike(int numChannels, int numSamples)
+        : Spike(nullptr, numChannels, numSamples, 0)
+    { }
+
+    Spike(const SpikeChannel* channel, int numChannels, int numSamples, int64 sampleNumber)
+        : EventBase(channel, sampleNumber), numSamples(numSamples),
+          data((size_t) numChannels * numSamples), thresholds((size_t) numChannels)
+    { }
+
+    const float* getDataPointer(int channel) const  { return data.data() + (size_t) channel * numSamples; }
+    float* getDataPointer(int channel)              { return data.data() + (size_t) channel * numSamples; }
+
+    uint16 getSortedId() const              { return sortedId; }
+    void setSortedId(uint16 newSortedId)    { sortedId = newSortedId; }
+
+    /** Writes the fixed part, the waveform and the metadata, then a threshold per channel */
+    void serialize(void* dstBuffer, size_t dstSize) const override
+    {
+        const size_t thresholdsSize = thresholds.size() * sizeof(float);
+        serializeParts(dstBuffer, dstSize - thresholdsSize, 26, data.data(), data.size() * sizeof(float));
+        std::memcpy(static_cast<char*>(dstBuffer) + dstSize - thresholdsSize, thresholds.data(), thresholdsSize);
+    }
+
+private:
+    int numSamples;
+    uint16 sortedId = 0;
+    std::vector<float> data;
+    std::vector<float> thresholds;
+};
+
+
+#endif  // PROCESSORHEADERS_H_INCLUDED
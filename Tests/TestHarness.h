@@ -0,0 +1,85 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TESTHARNESS_H_INCLUDED
+#define TESTHARNESS_H_INCLUDED
+
+/**
+
+ Just enough of a test harness for the plugin's unit tests: each test is a
+ plain executable that checks its expectations and returns non-zero if any
+ of them failed, so that ctest can run it.
+
+ */
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+namespace TestHarness
+{
+    inline int& failureCount()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    inline void fail(const char* file, int line, const std::string& message)
+    {
+        std::fprintf(stderr, "%s:%d: %s\n", file, line, message.c_str());
+        ++failureCount();
+    }
+
+    template <typename A, typename B>
+    void checkEquals(const A& actual, const B& expected, const char* actualText, const char* file, int line)
+    {
+        if (!(actual == expected))
+        {
+            std::ostringstream message;
+            message << actualText << " is " << actual << ", expected " << expected;
+            fail(file, line, message.str());
+        }
+    }
+
+    /** Prints a summary and returns the exit code for main() */
+    inline int finish(const char* testName)
+    {
+        if (failureCount() == 0)
+        {
+            std::printf("%s: all passed\n", testName);
+            return 0;
+        }
+
+        std::printf("%s: %d failed\n", testName, failureCount());
+        return 1;
+    }
+}
+
+#define expect(condition) \
+    do { if (!(condition)) TestHarness::fail(__FILE__, __LINE__, "expected " #condition); } while (false)
+
+#define expectEquals(actual, expected) \
+    TestHarness::checkEquals((actual), (expected), #actual, __FILE__, __LINE__)
+
+
+#endif  // TESTHARNESS_H_INCLUDED
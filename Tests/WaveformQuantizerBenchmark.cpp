@@ -0,0 +1,140 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "WaveformQuantizer.h"
+#include "Benchmark.h"
+
+#include <random>
+#include <vector>
+
+/**
+
+ Measures what quantizing spike waveforms to int16 costs and what it saves:
+ the conversion time per spike for each kernel, the bytes of waveform per
+ spike as float32 and as int16 (plus its float32 scale), and the error of
+ the int16 samples on synthetic spikes at a typical headstage resolution.
+
+ */
+
+namespace
+{
+    struct Shape
+    {
+        int numChannels;
+        int numSamples;
+    };
+
+    /** Noise with a trough and a smaller peak on every channel, in microvolts */
+    std::vector<float> makeWaveforms(const Shape& shape, int numSpikes)
+    {
+        std::mt19937 random(4);
+        std::normal_distribution<float> noise(0.0f, 10.0f);
+
+        std::vector<float> samples((size_t) numSpikes * shape.numChannels * shape.numSamples);
+        size_t i = 0;
+
+        for (int spike = 0; spike < numSpikes; ++spike)
+        {
+            for (int ch = 0; ch < shape.numChannels; ++ch)
+            {
+                const float size = 200.0f / (1.0f + (float) ((ch + spike) % 8));
+                for (int s = 0; s < shape.numSamples; ++s)
+                {
+                    const float t = (float) (s - shape.numSamples / 3);
+                    samples[i++] = noise(random) - size * std::exp(-t * t / 8.0f)
+                        + 0.4f * size * std::exp(-(t - 8.0f) * (t - 8.0f) / 32.0f);
+                }
+            }
+        }
+
+        return samples;
+    }
+
+    typedef void(*Kernel)(const float* src, int16* dest, int count, float scale);
+
+    double nanosPerSpike(Kernel kernel, const std::vector<float>& waveforms, int spikeSize, int numSpikes, float scale)
+    {
+        std::vector<int16> dest((size_t) spikeSize);
+
+        return Benchmark::nanosPerIteration([&](int64_t count)
+        {
+            for (int64_t i = 0; i < count; ++i)
+            {
+                kernel(waveforms.data() + (size_t) (i % numSpikes) * spikeSize, dest.data(), spikeSize, scale);
+                Benchmark::keep(dest[0]);
+            }
+        });
+    }
+}
+
+int main()
+{
+    // a typical headstage resolution, in microvolts per step
+    const float scale = 0.195f;
+    const int numSpikes = 64;
+
+    const Shape shapes[] = { { 1, 40 }, { 4, 40 }, { 32, 40 }, { 64, 82 }, { 384, 82 } };
+
+    std::printf("Scale %.3f uV; quantize() uses %s\n\n", scale, WaveformQuantizer::getKernelName());
+    std::printf("                ---- bytes/spike ----    ------------ ns/spike ------------    rms err  max err\n");
+    std::printf("chans samples    float32    int16       scalar      SSE2      AVX2   quantize        uV       uV\n");
+
+    for (auto& shape : shapes)
+    {
+        const int spikeSize = shape.numChannels * shape.numSamples;
+        const std::vector<float> waveforms = makeWaveforms(shape, numSpikes);
+
+        const double scalar = nanosPerSpike(WaveformQuantizer::quantizeScalar, waveforms, spikeSize, numSpikes, scale);
+        const double sse2 = nanosPerSpike(WaveformQuantizer::quantizeSSE2, waveforms, spikeSize, numSpikes, scale);
+        const double avx2 = SystemStats::hasAVX2()
+            ? nanosPerSpike(WaveformQuantizer::quantizeAVX2, waveforms, spikeSize, numSpikes, scale)
+            : 0.0;
+        const double fastest = nanosPerSpike(WaveformQuantizer::quantize, waveforms, spikeSize, numSpikes, scale);
+
+        // accuracy over every sample of every spike
+        std::vector<int16> quantized(waveforms.size());
+        WaveformQuantizer::quantize(waveforms.data(), quantized.data(), (int) waveforms.size(), scale);
+
+        double sumSquares = 0.0;
+        double maxError = 0.0;
+        for (size_t i = 0; i < waveforms.size(); ++i)
+        {
+            const double error = std::abs((double) quantized[i] * scale - (double) waveforms[i]);
+            sumSquares += error * error;
+            maxError = std::max(maxError, error);
+        }
+
+        std::printf("%5d %7d   %8d %8d   %10.1f %9.1f %9.1f %10.1f   %7.4f  %7.4f\n",
+            shape.numChannels, shape.numSamples,
+            spikeSize * (int) sizeof(float), spikeSize * (int) sizeof(int16) + (int) sizeof(float),
+            scalar, sse2, avx2, fastest,
+            std::sqrt(sumSquares / (double) waveforms.size()), maxError);
+    }
+
+    std::printf("\nint16 bytes include the float32 scale sent with each spike. A half-step error is %.4f uV;\n"
+                "the rms error of uniform rounding is %.4f uV.\n", scale / 2, scale / std::sqrt(12.0));
+
+    return 0;
+}
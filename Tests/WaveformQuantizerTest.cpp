@@ -0,0 +1,192 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2015 Christopher Stawarz and Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ProcessorHeaders.h>
+
+#include "WaveformQuantizer.h"
+#include "TestHarness.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+/**
+
+ Checks that the AVX2 and SSE2 quantizer kernels give bit-for-bit the same
+ int16 samples as the scalar one, for every length from 0 to 99 (so every
+ tail each kernel leaves over) at several alignments, with values that
+ round to even, saturate, or are NaN or infinite, and that the scalar one
+ gives the documented results for them.
+
+ */
+
+namespace
+{
+    const int MAX_LENGTH = 100;
+    const int16 GUARD = 0x5A5A;
+    const float NaN = std::numeric_limits<float>::quiet_NaN();
+    const float INF = std::numeric_limits<float>::infinity();
+
+    typedef void(*Kernel)(const float* src, int16* dest, int count, float scale);
+
+    struct NamedKernel
+    {
+        const char* name;
+        Kernel kernel;
+    };
+
+    std::vector<NamedKernel> getKernels()
+    {
+        std::vector<NamedKernel> kernels = { { "quantize", WaveformQuantizer::quantize } };
+
+#if defined(__x86_64__) || defined(_M_X64)
+        kernels.push_back({ "SSE2", WaveformQuantizer::quantizeSSE2 });
+
+        if (SystemStats::hasAVX2())
+        {
+            kernels.push_back({ "AVX2", WaveformQuantizer::quantizeAVX2 });
+        }
+        else
+        {
+            std::printf("No AVX2 on this CPU; only checking SSE2\n");
+        }
+#endif
+        return kernels;
+    }
+
+    /** Runs every kernel on src and checks each against the scalar one, including that
+        nothing past count is written */
+    void checkKernels(const std::vector<NamedKernel>& kernels, const float* src, int count, float scale)
+    {
+        std::vector<int16> expected(count + 1, GUARD);
+        WaveformQuantizer::quantizeScalar(src, expected.data(), count, scale);
+        expectEquals(expected[count], GUARD);
+
+        for (auto& kernel : kernels)
+        {
+            // every alignment of the destination too
+            for (int offset = 0; offset < 2; ++offset)
+            {
+                std::vector<int16> actual(offset + count + 1, GUARD);
+                kernel.kernel(src, actual.data() + offset, count, scale);
+
+                if (memcmp(actual.data() + offset, expected.data(), (count + 1) * sizeof(int16)) != 0)
+                {
+                    TestHarness::fail(__FILE__, __LINE__, std::string(kernel.name) + " differs from scalar for "
+                        + std::to_string(count) + " samples at scale " + std::to_string(scale));
+                }
+            }
+        }
+    }
+
+    void testScalar()
+    {
+        const float src[] = { 0.0f, -0.0f, 0.5f, 1.5f, 2.5f, -0.5f, -1.5f, -2.5f,
+                              32766.5f, 32767.0f, 32767.4f, 32768.0f, 1e9f, INF,
+                              -32767.5f, -32768.0f, -32768.5f, -1e9f, -INF, NaN, -NaN };
+        const int16 expected[] = { 0, 0, 0, 2, 2, 0, -2, -2,
+                                   32766, 32767, 32767, 32767, 32767, 32767,
+                                   -32768, -32768, -32768, -32768, -32768, -32768, -32768 };
+        const int count = (int) (sizeof(src) / sizeof(src[0]));
+
+        int16 dest[count];
+        WaveformQuantizer::quantizeScalar(src, dest, count, 1.0f);
+
+        for (int i = 0; i < count; ++i)
+        {
+            expectEquals(dest[i], expected[i]);
+        }
+
+        // the error is at most half a step
+        const float scale = 0.195f;
+        for (int i = -1000; i <= 1000; ++i)
+        {
+            const float value = i * 0.0371f;
+            int16 step;
+            WaveformQuantizer::quantizeScalar(&value, &step, 1, scale);
+            expect(std::abs(step * scale - value) <= scale * 0.5f * 1.0001f);
+        }
+    }
+
+    void testEveryLength(const std::vector<NamedKernel>& kernels)
+    {
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> values(-40000.0f, 40000.0f);
+        std::uniform_int_distribution<int> steps(-33000, 33000);
+        std::uniform_int_distribution<int> kinds(0, 15);
+
+        const float scales[] = { 1.0f, 0.5f, 0.195f, 3.0f };
+        std::vector<float> buffer(MAX_LENGTH + 4);
+
+        for (float scale : scales)
+        {
+            for (int offset = 0; offset < 4; ++offset)
+            {
+                for (int count = 0; count < MAX_LENGTH; ++count)
+                {
+                    for (auto& sample : buffer)
+                    {
+                        switch (kinds(random))
+                        {
+                        case 0:  sample = NaN; break;
+                        case 1:  sample = (steps(random) + 0.5f) * scale; break;    // a tie, if the scale allows
+                        case 2:  sample = random() % 2 ? INF : -INF; break;
+                        case 3:  sample = (random() % 2 ? 32767.5f : -32768.5f) * scale; break;
+                        default: sample = values(random) * scale; break;
+                        }
+                    }
+
+                    checkKernels(kernels, buffer.data() + offset, count, scale);
+                }
+            }
+        }
+    }
+
+    void testAllNaN(const std::vector<NamedKernel>& kernels)
+    {
+        std::vector<float> src(MAX_LENGTH, NaN);
+
+        for (int count = 0; count < MAX_LENGTH; ++count)
+        {
+            checkKernels(kernels, src.data(), count, 0.195f);
+        }
+
+        std::vector<int16> dest(MAX_LENGTH);
+        WaveformQuantizer::quantize(src.data(), dest.data(), MAX_LENGTH, 0.195f);
+        for (auto sample : dest)
+        {
+            expectEquals(sample, (int16) -32768);
+        }
+    }
+}
+
+int main()
+{
+    const auto kernels = getKernels();
+
+    testScalar();
+    testEveryLength(kernels);
+    testAllNaN(kernels);
+
+    return TestHarness::finish("WaveformQuantizerTest");
+}